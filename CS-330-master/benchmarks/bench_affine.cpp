@@ -0,0 +1,150 @@
+#include <iostream>             // cout
+#include <iomanip>              // setw, setprecision
+#include <cstdlib>              // EXIT_SUCCESS
+#include <chrono>               // steady_clock
+#include <vector>               // vector
+
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+
+#include <cs330/affine_transform.h> // Affine 3x4 transforms
+
+using namespace std; // Standard namespace
+
+/* Millions of transforms per second for the Affine3x4 operations against the
+ * glm::mat4 code they replace, one transform at a time: composing a parent with
+ * a child, the inverse, the normal matrix and building from translation,
+ * rotation and scale. The bytes per transform are what an instance upload
+ * takes. The largest difference from glm over every output is printed as well.
+ */
+
+namespace
+{
+    const size_t TRANSFORMS = 16384;
+    const int REPEATS = 50;
+}
+
+// Best time in milliseconds of run()
+template <typename Run>
+double UMeasure(Run run)
+{
+    double best = 1e30;
+    for (int repeat = 0; repeat < REPEATS; ++repeat)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        run();
+        chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+        if (elapsed.count() < best)
+            best = elapsed.count();
+    }
+    return best;
+}
+
+// Largest element difference between the affine transforms and the top rows of the matrices
+float UMaxError(const Affine3x4* affines, const glm::mat4* matrices, size_t count)
+{
+    float error = 0.0f;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const Affine3x4 expected = Affine3x4::FromMat4(matrices[i]);
+        for (int row = 0; row < 3; ++row)
+        {
+            for (int column = 0; column < 4; ++column)
+            {
+                const float b = expected.Rows[row][column];
+                error = glm::max(error, glm::abs(affines[i].Rows[row][column] - b) / glm::max(1.0f, glm::abs(b)));
+            }
+        }
+    }
+    return error;
+}
+
+int main()
+{
+    // Random transforms, a few units around the origin
+    vector<glm::vec3> positions(TRANSFORMS), scales(TRANSFORMS);
+    vector<glm::quat> rotations(TRANSFORMS);
+    srand(330);
+    for (size_t i = 0; i < TRANSFORMS; ++i)
+    {
+        positions[i] = glm::vec3(rand() % 200 - 100, rand() % 200 - 100, rand() % 200 - 100) * 0.05f;
+        scales[i] = glm::vec3(rand() % 100 + 1, rand() % 100 + 1, rand() % 100 + 1) * 0.02f;
+        rotations[i] = glm::normalize(glm::quat((float)(rand() % 200 - 100), (float)(rand() % 200 - 100), (float)(rand() % 200 - 100), (float)(rand() % 200 - 100)));
+    }
+
+    vector<glm::mat4> models(TRANSFORMS), matrices(TRANSFORMS);
+    vector<Affine3x4> affineModels(TRANSFORMS), affines(TRANSFORMS);
+    vector<glm::mat3> normals(TRANSFORMS), referenceNormals(TRANSFORMS);
+    const glm::mat4 parent = glm::translate(glm::vec3(1.0f, 2.0f, 3.0f)) * glm::rotate(0.5f, glm::vec3(0.0f, 1.0f, 0.0f));
+    const Affine3x4 affineParent = Affine3x4::FromMat4(parent);
+
+    double mat4Ms[4], affineMs[4];
+    float error = 0.0f;
+    mat4Ms[0] = UMeasure([&]()
+    {
+        for (size_t i = 0; i < TRANSFORMS; ++i)
+            models[i] = glm::translate(positions[i]) * glm::mat4_cast(rotations[i]) * glm::scale(scales[i]);
+    });
+    affineMs[0] = UMeasure([&]()
+    {
+        for (size_t i = 0; i < TRANSFORMS; ++i)
+            affineModels[i] = Affine3x4::FromTRS(positions[i], rotations[i], scales[i]);
+    });
+    error = glm::max(error, UMaxError(&affineModels[0], &models[0], TRANSFORMS));
+
+    mat4Ms[1] = UMeasure([&]()
+    {
+        for (size_t i = 0; i < TRANSFORMS; ++i)
+            matrices[i] = parent * models[i];
+    });
+    affineMs[1] = UMeasure([&]()
+    {
+        for (size_t i = 0; i < TRANSFORMS; ++i)
+            affines[i] = affineParent * affineModels[i];
+    });
+    error = glm::max(error, UMaxError(&affines[0], &matrices[0], TRANSFORMS));
+
+    mat4Ms[2] = UMeasure([&]()
+    {
+        for (size_t i = 0; i < TRANSFORMS; ++i)
+            matrices[i] = glm::inverse(models[i]);
+    });
+    affineMs[2] = UMeasure([&]()
+    {
+        for (size_t i = 0; i < TRANSFORMS; ++i)
+            affines[i] = affineModels[i].Inverse();
+    });
+    error = glm::max(error, UMaxError(&affines[0], &matrices[0], TRANSFORMS));
+
+    mat4Ms[3] = UMeasure([&]()
+    {
+        for (size_t i = 0; i < TRANSFORMS; ++i)
+            referenceNormals[i] = glm::transpose(glm::inverse(glm::mat3(models[i])));
+    });
+    affineMs[3] = UMeasure([&]()
+    {
+        for (size_t i = 0; i < TRANSFORMS; ++i)
+            normals[i] = affineModels[i].NormalMatrix();
+    });
+    for (size_t i = 0; i < TRANSFORMS; ++i)
+    {
+        for (int element = 0; element < 9; ++element)
+        {
+            const float b = (&referenceNormals[i][0][0])[element];
+            error = glm::max(error, glm::abs((&normals[i][0][0])[element] - b) / glm::max(1.0f, glm::abs(b)));
+        }
+    }
+
+    cout << "Transforms: " << TRANSFORMS << ", bytes per instance: mat4 " << sizeof(glm::mat4) << ", Affine3x4 " << sizeof(Affine3x4) << endl;
+    cout << fixed << setprecision(1);
+    cout << setw(16) << "M transforms/s" << setw(10) << "mat4" << setw(10) << "3x4" << setw(10) << "speedup" << endl;
+    const char* const OPERATIONS[4] = { "TRS", "parent * child", "inverse", "normal matrix" };
+    for (int operation = 0; operation < 4; ++operation)
+    {
+        cout << setw(16) << OPERATIONS[operation] << setw(10) << TRANSFORMS / (mat4Ms[operation] * 1000.0)
+            << setw(10) << TRANSFORMS / (affineMs[operation] * 1000.0) << setw(9) << mat4Ms[operation] / affineMs[operation] << "x" << endl;
+    }
+    cout << scientific << setprecision(2) << "Largest relative difference from glm: " << error << endl;
+
+    return EXIT_SUCCESS;
+}
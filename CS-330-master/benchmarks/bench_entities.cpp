@@ -0,0 +1,144 @@
+#include <iostream>             // cout
+#include <iomanip>              // setw, setprecision
+#include <cstdlib>              // EXIT_SUCCESS
+#include <chrono>               // steady_clock
+#include <cmath>                // sin, cos
+#include <vector>               // vector
+#ifdef __SSE__
+#include <xmmintrin.h>          // SSE intrinsics
+#endif
+
+#include <cs330/entity_store.h> // Structure of arrays entities
+
+using namespace std; // Standard namespace
+
+/* Per-frame animation of 1M entities: each one orbits the Y axis and spins
+ * around it, which reads and writes position x/z and the rotation quaternion
+ * and leaves scale, color and bounds alone. Compares an array of structs with
+ * the EntityStore arrays, looped in plain C++ and with SSE.
+ */
+
+namespace
+{
+    const uint32_t ENTITY_COUNT = 1000000;
+    const int FRAMES = 50;
+
+    // The array of structs baseline, the layout of the scattered globals
+    struct Entity
+    {
+        glm::vec3 Position;
+        glm::quat Rotation;
+        glm::vec3 Scale;
+        glm::vec3 Color;
+        float BoundsRadius;
+    };
+}
+
+// Rotates every entity by angle around Y; c and s are its cosine and sine
+void UAnimateStructs(vector<Entity>& entities, float c, float s)
+{
+    for (size_t i = 0; i < entities.size(); ++i)
+    {
+        Entity& e = entities[i];
+        float x = e.Position.x, z = e.Position.z;
+        e.Position.x = c * x + s * z;
+        e.Position.z = c * z - s * x;
+        glm::quat q = e.Rotation;
+        e.Rotation = glm::quat(c * q.w - s * q.y, c * q.x + s * q.z, c * q.y + s * q.w, c * q.z - s * q.x);
+    }
+}
+
+void UAnimateArrays(EntityStore& store, float c, float s)
+{
+    float* px = store.Array(ENTITY_POSITION_X);
+    float* pz = store.Array(ENTITY_POSITION_Z);
+    float* qx = store.Array(ENTITY_ROTATION_X);
+    float* qy = store.Array(ENTITY_ROTATION_Y);
+    float* qz = store.Array(ENTITY_ROTATION_Z);
+    float* qw = store.Array(ENTITY_ROTATION_W);
+    const uint32_t n = store.PaddedCount();
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        float x = px[i], z = pz[i];
+        px[i] = c * x + s * z;
+        pz[i] = c * z - s * x;
+        float rx = qx[i], ry = qy[i], rz = qz[i], rw = qw[i];
+        qw[i] = c * rw - s * ry;
+        qx[i] = c * rx + s * rz;
+        qy[i] = c * ry + s * rw;
+        qz[i] = c * rz - s * rx;
+    }
+}
+
+#ifdef __SSE__
+void UAnimateArraysSse(EntityStore& store, float c, float s)
+{
+    float* px = store.Array(ENTITY_POSITION_X);
+    float* pz = store.Array(ENTITY_POSITION_Z);
+    float* qx = store.Array(ENTITY_ROTATION_X);
+    float* qy = store.Array(ENTITY_ROTATION_Y);
+    float* qz = store.Array(ENTITY_ROTATION_Z);
+    float* qw = store.Array(ENTITY_ROTATION_W);
+    const __m128 vc = _mm_set1_ps(c), vs = _mm_set1_ps(s);
+    const uint32_t n = store.PaddedCount();
+    for (uint32_t i = 0; i < n; i += 4)
+    {
+        __m128 x = _mm_load_ps(px + i), z = _mm_load_ps(pz + i);
+        _mm_store_ps(px + i, _mm_add_ps(_mm_mul_ps(vc, x), _mm_mul_ps(vs, z)));
+        _mm_store_ps(pz + i, _mm_sub_ps(_mm_mul_ps(vc, z), _mm_mul_ps(vs, x)));
+        __m128 rx = _mm_load_ps(qx + i), ry = _mm_load_ps(qy + i), rz = _mm_load_ps(qz + i), rw = _mm_load_ps(qw + i);
+        _mm_store_ps(qw + i, _mm_sub_ps(_mm_mul_ps(vc, rw), _mm_mul_ps(vs, ry)));
+        _mm_store_ps(qx + i, _mm_add_ps(_mm_mul_ps(vc, rx), _mm_mul_ps(vs, rz)));
+        _mm_store_ps(qy + i, _mm_add_ps(_mm_mul_ps(vc, ry), _mm_mul_ps(vs, rw)));
+        _mm_store_ps(qz + i, _mm_sub_ps(_mm_mul_ps(vc, rz), _mm_mul_ps(vs, rx)));
+    }
+}
+#endif
+
+// Best frame time in milliseconds of an animation step
+template <typename Step>
+double UMeasure(Step step)
+{
+    const float angle = 0.01f;
+    const float c = cos(angle), s = sin(angle);
+    double best = 1e30;
+    for (int frame = 0; frame < FRAMES; ++frame)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        step(c, s);
+        chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+        if (elapsed.count() < best)
+            best = elapsed.count();
+    }
+    return best;
+}
+
+int main()
+{
+    vector<Entity> structs(ENTITY_COUNT);
+    EntityStore store;
+    for (uint32_t i = 0; i < ENTITY_COUNT; ++i)
+    {
+        glm::vec3 position(float(i & 1023), 0.0f, float(i >> 10));
+        glm::quat rotation(1.0f, 0.0f, 0.0f, 0.0f);
+        Entity entity = { position, rotation, glm::vec3(1.0f), glm::vec3(0.5f), 0.87f };
+        structs[i] = entity;
+        store.Create(position, rotation, glm::vec3(1.0f), glm::vec3(0.5f), 0.87f);
+    }
+
+    cout << "Entities: " << ENTITY_COUNT << ", struct size: " << sizeof(Entity) << " bytes" << endl;
+    cout << setw(22) << "layout" << setw(12) << "ms/frame" << setw(14) << "M entities/s" << endl;
+
+    double ms = UMeasure([&](float c, float s) { UAnimateStructs(structs, c, s); });
+    cout << setw(22) << "array of structs" << setw(12) << fixed << setprecision(3) << ms << setw(14) << setprecision(1) << ENTITY_COUNT / ms / 1000.0 << endl;
+
+    ms = UMeasure([&](float c, float s) { UAnimateArrays(store, c, s); });
+    cout << setw(22) << "struct of arrays" << setw(12) << setprecision(3) << ms << setw(14) << setprecision(1) << ENTITY_COUNT / ms / 1000.0 << endl;
+
+#ifdef __SSE__
+    ms = UMeasure([&](float c, float s) { UAnimateArraysSse(store, c, s); });
+    cout << setw(22) << "struct of arrays, SSE" << setw(12) << setprecision(3) << ms << setw(14) << setprecision(1) << ENTITY_COUNT / ms / 1000.0 << endl;
+#endif
+
+    return EXIT_SUCCESS;
+}
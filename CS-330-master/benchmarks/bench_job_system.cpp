@@ -0,0 +1,80 @@
+#include <iostream>             // cout
+#include <iomanip>              // setw, setprecision
+#include <cstdlib>              // EXIT_SUCCESS
+#include <chrono>               // steady_clock
+#include <vector>               // vector
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+
+#include <cs330/job_system.h>   // Work-stealing job system
+
+using namespace std; // Standard namespace
+
+/* Scaling benchmark for the job system: builds a model matrix per object, the
+ * same work URender does for the tut_04_05 lattice, with 1 to 64 threads.
+ * Every row queues the same GRAIN sized jobs, including the 1 thread baseline,
+ * which ParallelFor would otherwise run inline without any job overhead.
+ */
+
+namespace
+{
+    const int OBJECT_COUNT = 1 << 20;
+    const int GRAIN = 1024;
+    const int REPEATS = 5;
+}
+
+// Builds the model matrices of objects [first, last)
+void UBuildMatrices(int first, int last, const glm::mat4& rotation, vector<glm::mat4>& models)
+{
+    const glm::mat4 scale = glm::scale(glm::vec3(2.0f, 2.0f, 2.0f));
+    for (int index = first; index < last; ++index)
+    {
+        glm::vec3 location(float(index & 1023) * 10.0f, float(index >> 10) * 10.0f, 0.0f);
+        models[index] = glm::translate(location) * rotation * scale;
+    }
+}
+
+// Best time in milliseconds to build all matrices with the given number of threads
+double UMeasure(unsigned threads, vector<glm::mat4>& models)
+{
+    JobSystem jobs(threads);
+    const glm::mat4 rotation = glm::rotate(45.0f, glm::vec3(1.0f, 1.0f, 1.0f));
+
+    double best = 1e30;
+    for (int repeat = 0; repeat < REPEATS; ++repeat)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        JobCounter counter;
+        for (int first = 0; first < OBJECT_COUNT; first += GRAIN)
+        {
+            int last = first + GRAIN < OBJECT_COUNT ? first + GRAIN : OBJECT_COUNT;
+            jobs.Run([&, first, last]() { UBuildMatrices(first, last, rotation, models); }, &counter);
+        }
+        jobs.Wait(counter);
+        chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+        if (elapsed.count() < best)
+            best = elapsed.count();
+    }
+    return best;
+}
+
+int main()
+{
+    vector<glm::mat4> models(OBJECT_COUNT);
+
+    cout << "Model matrices per run: " << OBJECT_COUNT << ", hardware threads: " << thread::hardware_concurrency() << endl;
+    cout << setw(8) << "threads" << setw(12) << "ms" << setw(12) << "speedup" << endl;
+
+    double baseline = 0.0;
+    for (unsigned threads = 1; threads <= 64; threads *= 2)
+    {
+        double ms = UMeasure(threads, models);
+        if (threads == 1)
+            baseline = ms;
+        cout << setw(8) << threads << setw(12) << fixed << setprecision(3) << ms << setw(12) << setprecision(2) << baseline / ms << endl;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,144 @@
+#include <iostream>             // cout
+#include <iomanip>              // setw, setprecision
+#include <cstdlib>              // EXIT_SUCCESS
+#include <chrono>               // steady_clock
+#include <vector>               // vector
+
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+
+#include <cs330/matrix_batch.h> // Batch matrix kernels
+
+using namespace std; // Standard namespace
+
+/* Millions of matrices per second for the MatrixBatch kernels at each
+ * instruction set this CPU has, against glm one matrix at a time. The glm
+ * column composes as tut_04_04 wrote it, translate * mat4_cast * scale with two
+ * full matrix products; "scalar" is the glm code of the kernels' tails, which
+ * scales the columns instead. Arrays of TRANSFORMS stay in the L2 cache.
+ * The largest difference from glm over every output is printed as well.
+ */
+
+namespace
+{
+    const size_t TRANSFORMS = 16384;
+    const int REPEATS = 50;
+}
+
+// Best time in milliseconds of run()
+template <typename Run>
+double UMeasure(Run run)
+{
+    double best = 1e30;
+    for (int repeat = 0; repeat < REPEATS; ++repeat)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        run();
+        chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+        if (elapsed.count() < best)
+            best = elapsed.count();
+    }
+    return best;
+}
+
+// Largest element difference between two arrays of floats
+float UMaxError(const float* a, const float* b, size_t count)
+{
+    float error = 0.0f;
+    for (size_t i = 0; i < count; ++i)
+        error = glm::max(error, glm::abs(a[i] - b[i]) / glm::max(1.0f, glm::abs(b[i])));
+    return error;
+}
+
+// Prints one cell: millions of matrices per second, or - for an instruction set the CPU does not have
+void UCell(double ms)
+{
+    if (ms < 0.0)
+        cout << setw(10) << "-";
+    else
+        cout << setw(10) << TRANSFORMS / (ms * 1000.0);
+}
+
+int main()
+{
+    // Random transforms, a few units around the origin
+    vector<glm::vec3> positions(TRANSFORMS), scales(TRANSFORMS);
+    vector<glm::quat> rotations(TRANSFORMS);
+    srand(330);
+    for (size_t i = 0; i < TRANSFORMS; ++i)
+    {
+        positions[i] = glm::vec3(rand() % 200 - 100, rand() % 200 - 100, rand() % 200 - 100) * 0.05f;
+        scales[i] = glm::vec3(rand() % 100 + 1, rand() % 100 + 1, rand() % 100 + 1) * 0.02f;
+        rotations[i] = glm::normalize(glm::quat((float)(rand() % 200 - 100), (float)(rand() % 200 - 100), (float)(rand() % 200 - 100), (float)(rand() % 200 - 100)));
+    }
+    const glm::mat4 viewProjection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 100.0f)
+        * glm::lookAt(glm::vec3(2.0f, 1.0f, 4.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    // glm references
+    vector<glm::mat4> models(TRANSFORMS), clips(TRANSFORMS), matrices(TRANSFORMS);
+    vector<Affine3x4> affines(TRANSFORMS), referenceAffines(TRANSFORMS);
+    vector<glm::mat3> normals(TRANSFORMS), referenceNormals(TRANSFORMS);
+    double glmMs[4];
+    glmMs[0] = UMeasure([&]()
+    {
+        for (size_t i = 0; i < TRANSFORMS; ++i)
+            models[i] = glm::translate(positions[i]) * glm::mat4_cast(rotations[i]) * glm::scale(scales[i]);
+    });
+    glmMs[1] = UMeasure([&]()
+    {
+        for (size_t i = 0; i < TRANSFORMS; ++i)
+            referenceAffines[i] = Affine3x4::FromMat4(glm::translate(positions[i]) * glm::mat4_cast(rotations[i]) * glm::scale(scales[i]));
+    });
+    glmMs[2] = UMeasure([&]()
+    {
+        for (size_t i = 0; i < TRANSFORMS; ++i)
+            clips[i] = viewProjection * models[i];
+    });
+    glmMs[3] = UMeasure([&]()
+    {
+        for (size_t i = 0; i < TRANSFORMS; ++i)
+            referenceNormals[i] = glm::transpose(glm::inverse(glm::mat3(models[i])));
+    });
+
+    const MatrixBatch::Level detected = MatrixBatch::Detect();
+    double levelMs[4][4];
+    float error = 0.0f;
+    for (int level = MatrixBatch::LEVEL_SCALAR; level <= MatrixBatch::LEVEL_AVX512; ++level)
+    {
+        if (level > detected)
+        {
+            for (int kernel = 0; kernel < 4; ++kernel)
+                levelMs[kernel][level] = -1.0;
+            continue;
+        }
+        MatrixBatch batch((MatrixBatch::Level)level);
+        levelMs[0][level] = UMeasure([&]() { batch.ComposeTRS(&positions[0], &rotations[0], &scales[0], &matrices[0], TRANSFORMS); });
+        error = glm::max(error, UMaxError(&matrices[0][0][0], &models[0][0][0], TRANSFORMS * 16));
+        levelMs[1][level] = UMeasure([&]() { batch.ComposeTRS(&positions[0], &rotations[0], &scales[0], &affines[0], TRANSFORMS); });
+        error = glm::max(error, UMaxError(&affines[0].Rows[0][0], &referenceAffines[0].Rows[0][0], TRANSFORMS * 12));
+        levelMs[2][level] = UMeasure([&]() { batch.Multiply(viewProjection, &models[0], &matrices[0], TRANSFORMS); });
+        error = glm::max(error, UMaxError(&matrices[0][0][0], &clips[0][0][0], TRANSFORMS * 16));
+        levelMs[3][level] = UMeasure([&]() { batch.NormalMatrices(&models[0], &normals[0], TRANSFORMS); });
+        error = glm::max(error, UMaxError(&normals[0][0][0], &referenceNormals[0][0][0], TRANSFORMS * 9));
+    }
+
+    cout << "Transforms: " << TRANSFORMS << ", widest instruction set: " << MatrixBatch::LevelName(detected) << endl;
+    cout << fixed << setprecision(1);
+    cout << setw(16) << "M matrices/s" << setw(10) << "glm";
+    for (int level = MatrixBatch::LEVEL_SCALAR; level <= MatrixBatch::LEVEL_AVX512; ++level)
+        cout << setw(10) << MatrixBatch::LevelName((MatrixBatch::Level)level);
+    cout << setw(10) << "speedup" << endl;
+
+    const char* const KERNELS[4] = { "TRS to mat4", "TRS to 3x4", "VP * model", "normal matrix" };
+    for (int kernel = 0; kernel < 4; ++kernel)
+    {
+        cout << setw(16) << KERNELS[kernel];
+        UCell(glmMs[kernel]);
+        for (int level = MatrixBatch::LEVEL_SCALAR; level <= MatrixBatch::LEVEL_AVX512; ++level)
+            UCell(levelMs[kernel][level]);
+        cout << setw(9) << glmMs[kernel] / levelMs[kernel][detected] << "x" << endl;
+    }
+    cout << scientific << setprecision(2) << "Largest relative difference from glm: " << error << endl;
+
+    return EXIT_SUCCESS;
+}
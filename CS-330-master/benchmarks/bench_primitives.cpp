@@ -0,0 +1,194 @@
+#include <iostream>             // cout
+#include <iomanip>              // setw, setprecision
+#include <cstdlib>              // EXIT_SUCCESS
+#include <chrono>               // steady_clock
+#include <vector>               // vector
+
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+
+#include <cs330/primitives.h>   // Procedural primitive meshes
+
+using namespace std; // Standard namespace
+
+/* Mesh generation costs of the tut_04_04 cylinder and sphere functions (a
+ * glm::rotate matrix per vertex, then interleaved into a vector<float> one
+ * push_back at a time, as UCreateMesh does) against PrimitiveGenerator writing
+ * the same triangles into a preallocated buffer. Both run on one thread.
+ * The tutorial sphere uses n rings for n segments; here both versions use
+ * RINGS so the segment count can go up to 4096.
+ */
+
+namespace
+{
+    const int RINGS = 64;
+    const int REPEATS = 5;
+    const int SEGMENTS[] = { 16, 64, 256, 1024, 4096 };
+}
+
+// tut_04_04: position of vertex(i) on a circle with n subdivisions
+glm::vec3 UCircularCoordinates(int i, int n)
+{
+    float angle = glm::radians(360.0f * i / n);
+    glm::vec4 vertex(1.0f, 0.0f, 0.0f, 1.0f);
+    vertex = glm::rotate(angle, glm::vec3(0.0, 1.0f, 0.0f)) * vertex;
+    return glm::vec3(vertex);
+}
+
+// tut_04_04: position of vertex(i, j) on a sphere, with rings and segments split
+glm::vec3 USphericalCoordinates(int i, int j, int rings, int segments)
+{
+    float longitude = glm::radians(360.0f * j / segments);
+    float latitude = glm::radians(180.0f * i / rings) - glm::radians(90.0f);
+    glm::vec4 vertex(1.0f, 0.0f, 0.0f, 1.0f);
+    vertex = glm::rotate(latitude, glm::vec3(0.0, 0.0f, 1.0f)) * vertex;
+    vertex = glm::rotate(longitude, glm::vec3(0.0, 1.0f, 0.0f)) * vertex;
+    return glm::vec3(vertex);
+}
+
+// tut_04_04 UCreateMesh without the GL upload
+void UInterleave(const vector<glm::vec3>& positions, const vector<glm::vec3>& normals, vector<float>& verts)
+{
+    for (size_t i = 0; i < positions.size(); i++)
+    {
+        verts.push_back(positions[i].x);
+        verts.push_back(positions[i].y);
+        verts.push_back(positions[i].z);
+        verts.push_back(normals[i].x);
+        verts.push_back(normals[i].y);
+        verts.push_back(normals[i].z);
+    }
+}
+
+// tut_04_04 UCreateCylinderMesh
+size_t UOldCylinder(int n)
+{
+    vector<glm::vec3> positions(n * 6);
+    vector<glm::vec3> normals(n * 6);
+    for (int i = 0; i < n; i++)
+    {
+        glm::vec3 a = UCircularCoordinates(i + 0, n);
+        glm::vec3 b = UCircularCoordinates(i + 1, n);
+        glm::vec3* p = &positions[i * 6];
+        glm::vec3* q = &normals[i * 6];
+        p[0] = a - glm::vec3(0.0f, 0.5f, 0.0f);
+        p[1] = b - glm::vec3(0.0f, 0.5f, 0.0f);
+        p[2] = a + glm::vec3(0.0f, 0.5f, 0.0f);
+        q[0] = a;
+        q[1] = b;
+        q[2] = a;
+        p[3] = b - glm::vec3(0.0f, 0.5f, 0.0f);
+        p[4] = b + glm::vec3(0.0f, 0.5f, 0.0f);
+        p[5] = a + glm::vec3(0.0f, 0.5f, 0.0f);
+        q[3] = b;
+        q[4] = b;
+        q[5] = a;
+    }
+    vector<float> verts;
+    UInterleave(positions, normals, verts);
+    return verts.size() / 6;
+}
+
+// tut_04_04 UCreateSphereMesh
+size_t UOldSphere(int rings, int segments)
+{
+    vector<glm::vec3> positions(rings * segments * 6);
+    vector<glm::vec3> normals(rings * segments * 6);
+    for (int i = 0; i < rings; i++)
+        for (int j = 0; j < segments; j++)
+        {
+            glm::vec3 a = USphericalCoordinates(i + 0, j + 0, rings, segments);
+            glm::vec3 b = USphericalCoordinates(i + 0, j + 1, rings, segments);
+            glm::vec3 c = USphericalCoordinates(i + 1, j + 1, rings, segments);
+            glm::vec3 d = USphericalCoordinates(i + 1, j + 0, rings, segments);
+            glm::vec3* p = &positions[(i * segments + j) * 6];
+            glm::vec3* q = &normals[(i * segments + j) * 6];
+            p[0] = q[0] = a;
+            p[1] = q[1] = b;
+            p[2] = q[2] = c;
+            p[3] = q[3] = a;
+            p[4] = q[4] = c;
+            p[5] = q[5] = d;
+        }
+    vector<float> verts;
+    UInterleave(positions, normals, verts);
+    return verts.size() / 6;
+}
+
+// Best time in milliseconds of build(); vertices gets what it returned
+template <typename Build>
+double UMeasure(Build build, size_t& vertices)
+{
+    double best = 1e30;
+    for (int repeat = 0; repeat < REPEATS; ++repeat)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        vertices = build();
+        chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+        if (elapsed.count() < best)
+            best = elapsed.count();
+    }
+    return best;
+}
+
+// Prints one row: vertices, both times and the speedup
+void UReport(const char* name, int segments, size_t vertices, double oldMs, double newMs)
+{
+    cout << setw(10) << name << setw(10) << segments << setw(12) << vertices
+         << setw(12) << oldMs << setw(12) << newMs << setw(10) << oldMs / newMs << "x" << endl;
+}
+
+int main()
+{
+    PrimitiveGenerator generator;
+    vector<PrimitiveVertex> output;
+
+    cout << fixed << setprecision(3);
+    cout << setw(10) << "" << setw(10) << "segments" << setw(12) << "vertices"
+         << setw(12) << "old ms" << setw(12) << "new ms" << setw(11) << "speedup" << endl;
+
+    for (size_t k = 0; k < sizeof(SEGMENTS) / sizeof(SEGMENTS[0]); ++k)
+    {
+        const int segments = SEGMENTS[k];
+        size_t oldVertices = 0, newVertices = 0;
+
+        double oldMs = UMeasure([&]() { return UOldCylinder(segments); }, oldVertices);
+        output.resize(PrimitiveGenerator::CylinderVertexCount(segments, 1, false));
+        double newMs = UMeasure([&]() { return generator.Cylinder(&output[0], segments, 1, 1.0f, 1.0f, false); }, newVertices);
+        UReport("cylinder", segments, newVertices, oldMs, newMs);
+
+        // The tutorial sphere also emits the degenerate triangles at the poles
+        oldMs = UMeasure([&]() { return UOldSphere(RINGS, segments); }, oldVertices);
+        output.resize(PrimitiveGenerator::SphereVertexCount(segments, RINGS));
+        newMs = UMeasure([&]() { return generator.Sphere(&output[0], segments, RINGS, 1.0f); }, newVertices);
+        UReport("sphere", segments, newVertices, oldMs, newMs);
+    }
+
+    // Primitives the tutorials had no function for
+    cout << endl << setw(10) << "" << setw(10) << "segments" << setw(12) << "vertices" << setw(12) << "ms" << endl;
+    for (size_t k = 0; k < sizeof(SEGMENTS) / sizeof(SEGMENTS[0]); ++k)
+    {
+        const int segments = SEGMENTS[k];
+        size_t vertices = 0;
+
+        output.resize(PrimitiveGenerator::CapsuleVertexCount(segments, RINGS / 2));
+        double ms = UMeasure([&]() { return generator.Capsule(&output[0], segments, RINGS / 2, 0.5f, 1.0f); }, vertices);
+        cout << setw(10) << "capsule" << setw(10) << segments << setw(12) << vertices << setw(12) << ms << endl;
+
+        output.resize(PrimitiveGenerator::TorusVertexCount(segments, RINGS));
+        ms = UMeasure([&]() { return generator.Torus(&output[0], segments, RINGS, 1.0f, 0.25f); }, vertices);
+        cout << setw(10) << "torus" << setw(10) << segments << setw(12) << vertices << setw(12) << ms << endl;
+
+        output.resize(PrimitiveGenerator::GridVertexCount(segments, RINGS));
+        ms = UMeasure([&]() { return generator.Grid(&output[0], segments, RINGS, 1.0f, 1.0f); }, vertices);
+        cout << setw(10) << "grid" << setw(10) << segments << setw(12) << vertices << setw(12) << ms << endl;
+
+        // Box faces of segments / 16 tiles a side
+        const int divisions = segments / 16;
+        output.resize(PrimitiveGenerator::BoxVertexCount(divisions));
+        ms = UMeasure([&]() { return generator.Box(&output[0], divisions, glm::vec3(1.0f)); }, vertices);
+        cout << setw(10) << "box" << setw(10) << divisions << setw(12) << vertices << setw(12) << ms << endl;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,94 @@
+#include <iostream>             // cout
+#include <iomanip>              // setw, setprecision
+#include <cstdlib>              // EXIT_SUCCESS
+#include <chrono>               // steady_clock
+#include <vector>               // vector
+
+#include <cs330/scene_graph.h>  // Cached world transforms
+
+using namespace std; // Standard namespace
+
+/* Scene graph update costs for a room of chairs shaped like the tut_04_04 one:
+ * a root, two rounded cubes of 9 parts each and 4 legs, 25 nodes per chair.
+ * Compares recomputing every world matrix, as drawing from scratch does, with
+ * updating after nothing moved and after one chair moved.
+ */
+
+namespace
+{
+    const int CHAIR_COUNT = 10000;
+    const int REPEATS = 20;
+}
+
+// Adds a rounded cube node with a cube, 4 edge and 4 corner children
+void UAddRoundedCube(SceneGraph& graph, int parent, glm::vec3 center, glm::vec3 sizes)
+{
+    int node = graph.AddNode(parent, center);
+    graph.AddNode(node, glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), sizes);
+    glm::vec3 half = sizes * 0.5f;
+    for (int corner = 0; corner < 4; ++corner)
+    {
+        glm::vec3 offset(corner & 1 ? half.x : -half.x, corner & 2 ? half.y : -half.y, corner & 2 ? half.z : -half.z);
+        graph.AddNode(node, glm::vec3(0.0f, offset.y, offset.z), glm::angleAxis(glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f)), glm::vec3(0.1f, sizes.x, 0.1f));
+        graph.AddNode(node, offset, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.1f));
+    }
+}
+
+// Adds a chair and returns its root node
+int UAddChair(SceneGraph& graph, glm::vec3 position)
+{
+    int chair = graph.AddNode(SceneGraph::NO_NODE, position);
+    UAddRoundedCube(graph, chair, glm::vec3(0.0f), glm::vec3(1.0f, 0.2f, 1.0f));
+    UAddRoundedCube(graph, chair, glm::vec3(0.0f, 1.0f, -0.5f), glm::vec3(1.2f, 0.5f, 0.2f));
+    for (int leg = 0; leg < 4; ++leg)
+        graph.AddNode(chair, glm::vec3(leg & 1 ? 0.5f : -0.5f, -0.5f, leg & 2 ? 0.5f : -0.5f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(0.04f, 1.0f, 0.04f));
+    return chair;
+}
+
+// Best time in milliseconds of change followed by an update, and the matrices the update computed
+template <typename Change>
+double UMeasure(SceneGraph& graph, Change change, unsigned& updated)
+{
+    double best = 1e30;
+    for (int repeat = 0; repeat < REPEATS; ++repeat)
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        change(repeat);
+        updated = graph.Update();
+        chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+        if (elapsed.count() < best)
+            best = elapsed.count();
+    }
+    return best;
+}
+
+int main()
+{
+    SceneGraph graph;
+    vector<int> chairs;
+    for (int i = 0; i < CHAIR_COUNT; ++i)
+        chairs.push_back(UAddChair(graph, glm::vec3(float(i % 100) * 2.0f, 0.0f, float(i / 100) * 2.0f)));
+    graph.Update();
+
+    cout << "Chairs: " << CHAIR_COUNT << ", nodes: " << graph.NodeCount() << endl;
+    cout << setw(22) << "" << setw(12) << "ms" << setw(12) << "matrices" << endl;
+
+    unsigned updated = 0;
+    double ms = UMeasure(graph, [&](int repeat)
+    {
+        for (size_t i = 0; i < chairs.size(); ++i)
+            graph.SetPosition(chairs[i], graph.Position(chairs[i]) + glm::vec3(0.0f, repeat & 1 ? 1.0f : -1.0f, 0.0f));
+    }, updated);
+    cout << setw(22) << "every chair moved" << setw(12) << fixed << setprecision(4) << ms << setw(12) << updated << endl;
+
+    ms = UMeasure(graph, [&](int repeat)
+    {
+        graph.SetPosition(chairs[CHAIR_COUNT / 2], glm::vec3(0.0f, float(repeat), 0.0f));
+    }, updated);
+    cout << setw(22) << "one chair moved" << setw(12) << ms << setw(12) << updated << endl;
+
+    ms = UMeasure(graph, [](int) {}, updated);
+    cout << setw(22) << "nothing moved" << setw(12) << ms << setw(12) << updated << endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,106 @@
+#include <iostream>             // cout
+#include <iomanip>              // setw, setprecision
+#include <cstdlib>              // EXIT_SUCCESS
+#include <cstdio>               // remove
+#include <chrono>               // steady_clock
+#include <string>               // string
+#include <vector>               // vector
+#include <sys/stat.h>           // stat
+
+#include <cs330/scene.h>        // Scene description files
+
+using namespace std; // Standard namespace
+
+/* Load times of the text and binary scene forms for 1k to 10M objects.
+ * Each scene is written to both forms in the directory given as the first
+ * argument (default /tmp), then loaded back. The binary load is timed alone,
+ * when it is just a mapping, and again with a pass reading every object, which
+ * pays for the page faults the mapping deferred. Files are in the page cache:
+ * these are parse and fault costs, not disk reads.
+ */
+
+namespace
+{
+    const int REPEATS = 3;
+}
+
+// Scene of count cubes on a grid
+void UMakeScene(uint32_t count, vector<SceneObject>& objects)
+{
+    objects.resize(count);
+    for (uint32_t index = 0; index < count; ++index)
+    {
+        SceneObject object = MakeSceneObject(SCENE_CUBE);
+        object.Position[0] = float(index & 1023) * 10.0f;
+        object.Position[1] = float((index >> 10) & 1023) * 10.0f;
+        object.Position[2] = float(index >> 20) * 10.0f;
+        object.Scale[0] = object.Scale[1] = object.Scale[2] = 2.0f;
+        object.Color[0] = float(index % 7) / 7.0f;
+        objects[index] = object;
+    }
+}
+
+// Reads every object of a loaded scene so its memory is actually touched
+float UTouch(const Scene& scene)
+{
+    float sum = 0.0f;
+    for (uint32_t index = 0; index < scene.ObjectCount; ++index)
+        sum += scene.Objects[index].Position[0] + scene.Objects[index].Color[0];
+    return sum;
+}
+
+// Best time in milliseconds of loading path, touching the objects or not
+double UMeasure(const string& path, bool touch, float& checksum)
+{
+    double best = 1e30;
+    for (int repeat = 0; repeat < REPEATS; ++repeat)
+    {
+        Scene scene;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        if (!scene.Load(path.c_str()))
+            return -1.0;
+        if (touch)
+            checksum += UTouch(scene);
+        chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+        if (elapsed.count() < best)
+            best = elapsed.count();
+    }
+    return best;
+}
+
+int main(int argc, char* argv[])
+{
+    const string directory = argc > 1 ? argv[1] : "/tmp";
+    const string textPath = directory + "/bench_scene_load.scene";
+    const string binaryPath = directory + "/bench_scene_load.sceneb";
+
+    cout << setw(10) << "objects" << setw(14) << "text ms" << setw(14) << "binary ms" << setw(18) << "binary+read ms" << setw(12) << "text MB" << setw(12) << "binary MB" << endl;
+
+    float checksum = 0.0f;
+    for (uint32_t count = 1000; count <= 10000000; count *= 10)
+    {
+        vector<SceneObject> objects;
+        UMakeScene(count, objects);
+        if (!WriteSceneText(textPath.c_str(), &objects[0], count) || !WriteSceneBinary(binaryPath.c_str(), &objects[0], count))
+        {
+            cerr << "Cannot write the scenes to " << directory << endl;
+            return EXIT_FAILURE;
+        }
+        vector<SceneObject>().swap(objects);
+
+        double textMs = UMeasure(textPath, true, checksum);
+        double binaryMs = UMeasure(binaryPath, false, checksum);
+        double binaryReadMs = UMeasure(binaryPath, true, checksum);
+
+        struct stat textStatus, binaryStatus;
+        stat(textPath.c_str(), &textStatus);
+        stat(binaryPath.c_str(), &binaryStatus);
+        cout << setw(10) << count << fixed << setprecision(3) << setw(14) << textMs << setw(14) << binaryMs << setw(18) << binaryReadMs
+             << setprecision(1) << setw(12) << textStatus.st_size / 1.0e6 << setw(12) << binaryStatus.st_size / 1.0e6 << endl;
+    }
+
+    remove(textPath.c_str());
+    remove(binaryPath.c_str());
+    cout << "checksum " << checksum << endl;
+    return EXIT_SUCCESS;
+}
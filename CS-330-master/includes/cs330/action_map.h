@@ -0,0 +1,268 @@
+/* Key-to-action mapping fed by the GLFW key callback.
+
+Key events update a dense bitset of pressed keys and, through a key -> action
+table, a 64-bit mask of held actions. The frame loop then reads Held() and
+Pressed() instead of polling glfwGetKey once per key, and walks the set bits
+only, so per-frame input costs a few bit operations whatever the number of
+bindings.
+
+Bindings are application-defined action indices (0..63) with names, and can be
+loaded from a text file with one binding per line:
+
+    # action        key
+    MOVE_FORWARD    W
+    LIGHT_UP        PAGE_UP
+    QUIT            ESCAPE
+
+Key names are GLFW's without the GLFW_KEY_ prefix: letters, digits, F1..F25,
+arrows and the named keys in KeyNames(). A file replaces every binding of the
+actions it mentions; actions it leaves out keep their current keys.
+*/
+
+#ifndef ACTION_MAP_H
+#define ACTION_MAP_H
+
+#include <GLFW/glfw3.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+class ActionMap
+{
+public:
+    static const int MAX_ACTIONS = 64;
+    static const int NO_ACTION = -1;
+
+    // names[i] is the name of action i in bindings files
+    ActionMap(const char* const* names, int count) : names(names), actionCount(count < MAX_ACTIONS ? count : MAX_ACTIONS), held(0), pressed(0)
+    {
+        std::memset(keyBits, 0, sizeof(keyBits));
+        std::memset(downKeys, 0, sizeof(downKeys));
+        for (int i = 0; i < KEY_COUNT; ++i)
+            actionOfKey[i] = NO_ACTION;
+    }
+
+    void Bind(int key, int action)
+    {
+        if (key < 0 || key >= KEY_COUNT || action < 0 || action >= actionCount)
+            return;
+        Unbind(key);
+        actionOfKey[key] = (int8_t)action;
+        if (KeyDown(key))
+            Press(action);
+    }
+
+    void Unbind(int key)
+    {
+        if (key < 0 || key >= KEY_COUNT || actionOfKey[key] == NO_ACTION)
+            return;
+        if (KeyDown(key))
+            Release(actionOfKey[key]);
+        actionOfKey[key] = NO_ACTION;
+    }
+
+    // Feed from the key callback
+    void OnKey(int key, int action)
+    {
+        if (key < 0 || key >= KEY_COUNT || action == GLFW_REPEAT)
+            return;
+
+        const uint64_t bit = uint64_t(1) << (key & 63);
+        const bool wasDown = (keyBits[key >> 6] & bit) != 0;
+        const bool isDown = action != GLFW_RELEASE;
+        if (wasDown == isDown)
+            return;
+
+        keyBits[key >> 6] ^= bit;
+        if (actionOfKey[key] == NO_ACTION)
+            return;
+        if (isDown)
+            Press(actionOfKey[key]);
+        else
+            Release(actionOfKey[key]);
+    }
+
+    // Actions whose key is down, one bit per action
+    uint64_t Held() const { return held; }
+
+    // Actions pressed since the last call, including presses released within the same frame
+    uint64_t Pressed()
+    {
+        uint64_t result = pressed;
+        pressed = 0;
+        return result;
+    }
+
+    bool KeyDown(int key) const
+    {
+        return key >= 0 && key < KEY_COUNT && (keyBits[key >> 6] & (uint64_t(1) << (key & 63))) != 0;
+    }
+
+    // Loads bindings from a file; returns false and reports the first bad line
+    bool Load(const char* path)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            std::cerr << "ERROR::BINDINGS::cannot open " << path << std::endl;
+            return false;
+        }
+
+        // Parse everything first so a bad file leaves the current bindings alone
+        int keys[KEY_COUNT];
+        int actions[KEY_COUNT];
+        int count = 0;
+        std::string line;
+        for (int lineNumber = 1; std::getline(file, line); ++lineNumber)
+        {
+            std::string::size_type comment = line.find('#');
+            if (comment != std::string::npos)
+                line.erase(comment);
+
+            std::istringstream fields(line);
+            std::string actionName, keyName, extra;
+            if (!(fields >> actionName))
+                continue;
+
+            int action = ActionOf(actionName);
+            int key = (fields >> keyName) ? KeyOf(keyName) : GLFW_KEY_UNKNOWN;
+            if (action == NO_ACTION || key == GLFW_KEY_UNKNOWN || (fields >> extra) || count == KEY_COUNT)
+            {
+                std::cerr << "ERROR::BINDINGS::" << path << ":" << lineNumber << ": expected '<action> <key>', got '" << line << "'" << std::endl;
+                return false;
+            }
+            keys[count] = key;
+            actions[count] = action;
+            ++count;
+        }
+
+        for (int i = 0; i < count; ++i)
+            UnbindAction(actions[i]);
+        for (int i = 0; i < count; ++i)
+            Bind(keys[i], actions[i]);
+        return true;
+    }
+
+    int ActionOf(const std::string& name) const
+    {
+        for (int i = 0; i < actionCount; ++i)
+        {
+            if (name == names[i])
+                return i;
+        }
+        return NO_ACTION;
+    }
+
+    // GLFW key code of a key name, GLFW_KEY_UNKNOWN if there is none
+    static int KeyOf(const std::string& name)
+    {
+        if (name.size() == 1 && name[0] >= 'A' && name[0] <= 'Z')
+            return GLFW_KEY_A + (name[0] - 'A');
+        if (name.size() == 1 && name[0] >= '0' && name[0] <= '9')
+            return GLFW_KEY_0 + (name[0] - '0');
+        if (name.size() >= 2 && name.size() <= 3 && name[0] == 'F')
+        {
+            int number = std::atoi(name.c_str() + 1);
+            if (number >= 1 && number <= 25)
+                return GLFW_KEY_F1 + number - 1;
+        }
+        for (const KeyName* entry = KeyNames(); entry->Name != nullptr; ++entry)
+        {
+            if (name == entry->Name)
+                return entry->Key;
+        }
+        return GLFW_KEY_UNKNOWN;
+    }
+
+private:
+    static const int KEY_COUNT = GLFW_KEY_LAST + 1;
+    static const int KEY_WORDS = (KEY_COUNT + 63) / 64;
+
+    struct KeyName
+    {
+        const char* Name;
+        int Key;
+    };
+
+    const char* const* names;
+    int actionCount;
+
+    uint64_t keyBits[KEY_WORDS];
+    int8_t actionOfKey[KEY_COUNT];
+    uint8_t downKeys[MAX_ACTIONS]; // bound keys currently down, per action
+    uint64_t held;
+    uint64_t pressed;
+
+    void Press(int action)
+    {
+        if (downKeys[action]++ == 0)
+        {
+            held |= uint64_t(1) << action;
+            pressed |= uint64_t(1) << action;
+        }
+    }
+
+    void Release(int action)
+    {
+        if (downKeys[action] > 0 && --downKeys[action] == 0)
+            held &= ~(uint64_t(1) << action);
+    }
+
+    void UnbindAction(int action)
+    {
+        for (int key = 0; key < KEY_COUNT; ++key)
+        {
+            if (actionOfKey[key] == action)
+                Unbind(key);
+        }
+    }
+
+    static const KeyName* KeyNames()
+    {
+        static const KeyName table[] = {
+            { "SPACE", GLFW_KEY_SPACE }, { "ESCAPE", GLFW_KEY_ESCAPE }, { "ENTER", GLFW_KEY_ENTER },
+            { "TAB", GLFW_KEY_TAB }, { "BACKSPACE", GLFW_KEY_BACKSPACE }, { "INSERT", GLFW_KEY_INSERT },
+            { "DELETE", GLFW_KEY_DELETE }, { "RIGHT", GLFW_KEY_RIGHT }, { "LEFT", GLFW_KEY_LEFT },
+            { "DOWN", GLFW_KEY_DOWN }, { "UP", GLFW_KEY_UP }, { "PAGE_UP", GLFW_KEY_PAGE_UP },
+            { "PAGE_DOWN", GLFW_KEY_PAGE_DOWN }, { "HOME", GLFW_KEY_HOME }, { "END", GLFW_KEY_END },
+            { "LEFT_SHIFT", GLFW_KEY_LEFT_SHIFT }, { "LEFT_CONTROL", GLFW_KEY_LEFT_CONTROL },
+            { "LEFT_ALT", GLFW_KEY_LEFT_ALT }, { "RIGHT_SHIFT", GLFW_KEY_RIGHT_SHIFT },
+            { "RIGHT_CONTROL", GLFW_KEY_RIGHT_CONTROL }, { "RIGHT_ALT", GLFW_KEY_RIGHT_ALT },
+            { "MINUS", GLFW_KEY_MINUS }, { "EQUAL", GLFW_KEY_EQUAL }, { "LEFT_BRACKET", GLFW_KEY_LEFT_BRACKET },
+            { "RIGHT_BRACKET", GLFW_KEY_RIGHT_BRACKET }, { "COMMA", GLFW_KEY_COMMA }, { "PERIOD", GLFW_KEY_PERIOD },
+            { nullptr, GLFW_KEY_UNKNOWN }
+        };
+        return table;
+    }
+
+    ActionMap(const ActionMap&);
+    ActionMap& operator=(const ActionMap&);
+};
+
+// Index of the lowest set bit of a non-zero mask; with mask &= mask - 1 it walks the held actions
+inline int LowestAction(uint64_t mask)
+{
+#ifdef __GNUC__
+    return __builtin_ctzll(mask);
+#else
+    int action = 0;
+    while ((mask & 1) == 0)
+    {
+        mask >>= 1;
+        ++action;
+    }
+    return action;
+#endif
+}
+
+// Mask of the actions first..last
+inline uint64_t ActionBits(int first, int last)
+{
+    return (~uint64_t(0) >> (63 - last)) & (~uint64_t(0) << first);
+}
+#endif
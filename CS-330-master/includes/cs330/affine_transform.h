@@ -0,0 +1,142 @@
+/* Affine transforms stored as the top three rows of the matrix.
+
+The fourth row of a model matrix is always (0, 0, 0, 1), so Affine3x4 keeps
+only the other three: 48 bytes instead of 64. It is the layout instance data is
+uploaded in, one vec4 per row with the translation in w, and a shader decodes
+a point with three dot products:
+
+    vec4 p = vec4(position, 1.0f);
+    vec3 world = vec3(dot(model[0], p), dot(model[1], p), dot(model[2], p));
+
+The operations skip the work the known row would cost. Composing two
+transforms takes 36 multiplies against 64 for mat4, the inverse is the 3x3
+inverse and one transformed translation, and the normal matrix is the 3x3
+inverse of the rows taken as columns, without a transpose.
+
+The struct is an aggregate, so it brace-initializes and can sit inside other
+std430 structs. Composition uses SSE2 where the target has it, which x86-64
+always does, and portable glm code elsewhere.
+*/
+
+#ifndef AFFINE_TRANSFORM_H
+#define AFFINE_TRANSFORM_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define AFFINE_TRANSFORM_SSE
+#include <emmintrin.h>
+#endif
+
+// Top three rows of an affine matrix; the fourth is (0, 0, 0, 1)
+struct Affine3x4
+{
+    glm::vec4 Rows[3];
+
+    static Affine3x4 Identity()
+    {
+        Affine3x4 affine = { { glm::vec4(1.0f, 0.0f, 0.0f, 0.0f), glm::vec4(0.0f, 1.0f, 0.0f, 0.0f), glm::vec4(0.0f, 0.0f, 1.0f, 0.0f) } };
+        return affine;
+    }
+
+    static Affine3x4 FromMat4(const glm::mat4& matrix)
+    {
+        glm::mat4 rows = glm::transpose(matrix);
+        Affine3x4 affine = { { rows[0], rows[1], rows[2] } };
+        return affine;
+    }
+
+    // translate(position) * mat4_cast(rotation) * scale(scale), written directly as rows
+    static Affine3x4 FromTRS(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale)
+    {
+        const float xx = rotation.x * rotation.x, yy = rotation.y * rotation.y, zz = rotation.z * rotation.z;
+        const float xy = rotation.x * rotation.y, xz = rotation.x * rotation.z, yz = rotation.y * rotation.z;
+        const float wx = rotation.w * rotation.x, wy = rotation.w * rotation.y, wz = rotation.w * rotation.z;
+        Affine3x4 affine = { {
+            glm::vec4((1.0f - 2.0f * (yy + zz)) * scale.x, 2.0f * (xy - wz) * scale.y, 2.0f * (xz + wy) * scale.z, position.x),
+            glm::vec4(2.0f * (xy + wz) * scale.x, (1.0f - 2.0f * (xx + zz)) * scale.y, 2.0f * (yz - wx) * scale.z, position.y),
+            glm::vec4(2.0f * (xz - wy) * scale.x, 2.0f * (yz + wx) * scale.y, (1.0f - 2.0f * (xx + yy)) * scale.z, position.z) } };
+        return affine;
+    }
+
+    glm::mat4 ToMat4() const
+    {
+        return glm::transpose(glm::mat4(Rows[0], Rows[1], Rows[2], glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)));
+    }
+
+    glm::vec3 Translation() const
+    {
+        return glm::vec3(Rows[0].w, Rows[1].w, Rows[2].w);
+    }
+
+    glm::vec3 TransformPoint(const glm::vec3& point) const
+    {
+        const glm::vec4 p(point, 1.0f);
+        return glm::vec3(glm::dot(Rows[0], p), glm::dot(Rows[1], p), glm::dot(Rows[2], p));
+    }
+
+    glm::vec3 TransformVector(const glm::vec3& vector) const
+    {
+        return glm::vec3(glm::dot(glm::vec3(Rows[0]), vector), glm::dot(glm::vec3(Rows[1]), vector), glm::dot(glm::vec3(Rows[2]), vector));
+    }
+
+    // *this * other: each row is a combination of other's rows, plus this row's translation
+    Affine3x4 operator*(const Affine3x4& other) const
+    {
+#if defined(AFFINE_TRANSFORM_SSE)
+        // GCC does not vectorize the glm form of this well; the shuffles broadcast each element of the row
+        const __m128 b0 = _mm_loadu_ps(&other.Rows[0].x);
+        const __m128 b1 = _mm_loadu_ps(&other.Rows[1].x);
+        const __m128 b2 = _mm_loadu_ps(&other.Rows[2].x);
+        const __m128 translationMask = _mm_castsi128_ps(_mm_set_epi32(-1, 0, 0, 0));
+        Affine3x4 result;
+        for (int row = 0; row < 3; ++row)
+        {
+            const __m128 r = _mm_loadu_ps(&Rows[row].x);
+            __m128 sum = _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(r, r, 0x00), b0), _mm_mul_ps(_mm_shuffle_ps(r, r, 0x55), b1));
+            sum = _mm_add_ps(sum, _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(r, r, 0xAA), b2), _mm_and_ps(r, translationMask)));
+            _mm_storeu_ps(&result.Rows[row].x, sum);
+        }
+        return result;
+#else
+        Affine3x4 result;
+        for (int row = 0; row < 3; ++row)
+        {
+            const glm::vec4& r = Rows[row];
+            for (int column = 0; column < 4; ++column)
+                result.Rows[row][column] = r.x * other.Rows[0][column] + r.y * other.Rows[1][column] + r.z * other.Rows[2][column];
+            result.Rows[row].w += r.w;
+        }
+        return result;
+#endif
+    }
+
+    // Inverse of a transform with a nonzero determinant
+    Affine3x4 Inverse() const
+    {
+        // The columns of the 3x3 inverse are the cross products of the rows over the determinant
+        const glm::vec3 r0(Rows[0]), r1(Rows[1]), r2(Rows[2]);
+        const glm::vec3 c0 = glm::cross(r1, r2);
+        const glm::vec3 c1 = glm::cross(r2, r0);
+        const glm::vec3 c2 = glm::cross(r0, r1);
+        const float inverseDeterminant = 1.0f / glm::dot(r0, c0);
+        const glm::vec3 t = Translation();
+
+        Affine3x4 result;
+        for (int row = 0; row < 3; ++row)
+        {
+            const glm::vec3 linear = glm::vec3(c0[row], c1[row], c2[row]) * inverseDeterminant;
+            result.Rows[row] = glm::vec4(linear, -glm::dot(linear, t));
+        }
+        return result;
+    }
+
+    // transpose(inverse(mat3(ToMat4()))), the matrix normals are transformed with
+    glm::mat3 NormalMatrix() const
+    {
+        // That is also the inverse of the transpose, and the rows are the transpose's columns
+        return glm::inverse(glm::mat3(glm::vec3(Rows[0]), glm::vec3(Rows[1]), glm::vec3(Rows[2])));
+    }
+};
+#endif
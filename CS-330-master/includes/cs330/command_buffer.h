@@ -0,0 +1,372 @@
+/* Draw command buffer with sort keys.
+
+Draw calls are recorded into a per-frame linear arena instead of being issued
+immediately. Every command carries a packed 64-bit key
+
+    63      56 55         44 43                24 23                 0
+    | program | vertex array |      material     |        depth       |
+
+Submit radix-sorts the keys and walks the commands in key order, only binding a
+program, vertex array or material when it differs from the previous command.
+Depth is the view distance quantized to 24 bits, so opaque draws sharing the same
+state go front to back.
+
+Programs and vertex arrays enter the key as the order they were first drawn
+with this frame, not as their GL ids, so any id fits the 8 and 12 bits; past
+MAX_PROGRAMS or MAX_VERTEX_ARRAYS they share the last index, and Submit
+compares the real ids to decide what to bind.
+
+The first MAX_MATERIALS distinct colors of a frame get their own material id.
+Colors past them share the last id, so they do not sort by color, and a draw
+with that id sets its color whenever the color differs from the previous one.
+*/
+
+#ifndef COMMAND_BUFFER_H
+#define COMMAND_BUFFER_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <cs330/gl_state_cache.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+// Bump allocator reset every frame. Memory is only returned to the system when the arena is destroyed.
+class LinearArena
+{
+public:
+    explicit LinearArena(size_t capacity = 64 * 1024) : base(nullptr), capacity(0), used(0)
+    {
+        Reserve(capacity);
+    }
+
+    ~LinearArena()
+    {
+        std::free(base);
+    }
+
+    // Allocates size bytes and returns their offset; grows the arena when needed, so keep offsets rather than pointers
+    size_t Allocate(size_t size, size_t alignment = 16)
+    {
+        size_t offset = (used + alignment - 1) & ~(alignment - 1);
+        if (offset + size > capacity)
+            Reserve((offset + size) * 2);
+        used = offset + size;
+        return offset;
+    }
+
+    template <typename T>
+    T* At(size_t offset) { return reinterpret_cast<T*>(base + offset); }
+
+    void Reset() { used = 0; }
+
+    size_t Used() const { return used; }
+    size_t Capacity() const { return capacity; }
+
+private:
+    char* base;
+    size_t capacity;
+    size_t used;
+
+    void Reserve(size_t size)
+    {
+        if (size <= capacity)
+            return;
+        void* grown = std::realloc(base, size);
+        if (grown == nullptr)
+            std::abort();
+        base = static_cast<char*>(grown);
+        capacity = size;
+    }
+
+    LinearArena(const LinearArena&);
+    LinearArena& operator=(const LinearArena&);
+};
+
+
+// One recorded draw. Plain data so it can live in the arena.
+struct DrawCommand
+{
+    glm::mat4 Model;
+    glm::vec3 Color;
+    GLuint Program;
+    GLuint VertexArray;
+    GLint First;            // first vertex, or first index of an indexed draw
+    GLsizei Count;
+    uint32_t Material;
+    uint32_t ProgramIndex;      // order of first use this frame, for the key
+    uint32_t VertexArrayIndex;
+    bool Indexed;           // 32-bit indices from the vertex array's element buffer
+};
+
+// State changes of one frame, counted the way the old immediate path issued them and after sorting
+struct CommandStats
+{
+    unsigned Draws;
+    unsigned ImmediateProgramChanges;
+    unsigned ImmediateVertexArrayBinds;
+    unsigned ImmediateMaterialChanges;
+    unsigned SortedProgramChanges;
+    unsigned SortedVertexArrayBinds;
+    unsigned SortedMaterialChanges;
+
+    unsigned ImmediateStateChanges() const { return ImmediateProgramChanges + ImmediateVertexArrayBinds + ImmediateMaterialChanges; }
+    unsigned SortedStateChanges() const { return SortedProgramChanges + SortedVertexArrayBinds + SortedMaterialChanges; }
+};
+
+
+class CommandBuffer
+{
+public:
+    CommandBuffer() : commandsOffset(0), count(0), capacity(0), eyePosition(0.0f), maxDistance(100.0f), materialCount(0), programCount(0), vertexArrayCount(0)
+    {
+        std::memset(&Stats, 0, sizeof(Stats));
+    }
+
+    // Statistics of the last submitted frame
+    CommandStats Stats;
+
+    // Starts a new frame. Distances up to maxDistance from eye are spread over the 24 depth bits.
+    void Begin(const glm::vec3& eye, float maxDistance)
+    {
+        arena.Reset();
+        count = 0;
+        capacity = 256;
+        commandsOffset = arena.Allocate(capacity * sizeof(DrawCommand));
+        eyePosition = eye;
+        this->maxDistance = maxDistance;
+        materialCount = 0;
+        programCount = 0;
+        vertexArrayCount = 0;
+
+        std::memset(&pending, 0, sizeof(pending));
+        lastImmediateProgram = 0;
+        lastImmediateMaterial = NO_MATERIAL;
+        lastImmediateColor = glm::vec3(0.0f);
+    }
+
+    // Records a draw of count vertices starting at first, with the given program, vertex array, model matrix and color
+    void Draw(GLuint program, GLuint vertexArray, GLint first, GLsizei vertexCount, const glm::mat4& model, const glm::vec3& color)
+    {
+        if (count == capacity)
+            Grow();
+
+        DrawCommand& command = arena.At<DrawCommand>(commandsOffset)[count++];
+        command.Model = model;
+        command.Color = color;
+        command.Program = program;
+        command.VertexArray = vertexArray;
+        command.First = first;
+        command.Count = vertexCount;
+        command.Material = MaterialOf(color);
+        command.ProgramIndex = IndexOf(programs, programCount, MAX_PROGRAMS, program);
+        command.VertexArrayIndex = IndexOf(vertexArrays, vertexArrayCount, MAX_VERTEX_ARRAYS, vertexArray);
+        command.Indexed = false;
+
+        // What the immediate path did: bind and unbind the VAO for every draw
+        ++pending.Draws;
+        pending.ImmediateVertexArrayBinds += 2;
+        if (program != lastImmediateProgram)
+            ++pending.ImmediateProgramChanges;
+        if (MaterialChanged(command, lastImmediateMaterial, lastImmediateColor))
+            ++pending.ImmediateMaterialChanges;
+        lastImmediateProgram = program;
+        lastImmediateMaterial = command.Material;
+        lastImmediateColor = color;
+    }
+
+    // Records a draw of indexCount indices starting at firstIndex in the vertex array's element buffer
+    void DrawIndexed(GLuint program, GLuint vertexArray, GLint firstIndex, GLsizei indexCount, const glm::mat4& model, const glm::vec3& color)
+    {
+        Draw(program, vertexArray, firstIndex, indexCount, model, color);
+        arena.At<DrawCommand>(commandsOffset)[count - 1].Indexed = true;
+    }
+
+    // Sorts the recorded draws and issues them through the state cache.
+    // The view and projection uniforms must already be set on every program used.
+    void Submit(GLStateCache& state)
+    {
+        const size_t keysOffset = arena.Allocate(count * sizeof(uint64_t) * 2, 8);
+        const size_t indicesOffset = arena.Allocate(count * sizeof(uint32_t) * 2, 4);
+
+        uint64_t* keys = arena.At<uint64_t>(keysOffset);
+        uint32_t* indices = arena.At<uint32_t>(indicesOffset);
+        DrawCommand* commands = arena.At<DrawCommand>(commandsOffset);
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            keys[i] = KeyOf(commands[i]);
+            indices[i] = i;
+        }
+        RadixSort(keys, indices, keys + count, indices + count, count);
+
+        GLuint program = 0;
+        GLuint vertexArray = 0;
+        uint32_t material = NO_MATERIAL;
+        glm::vec3 color(0.0f);
+        GLint modelLoc = -1;
+        GLint colorLoc = -1;
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const DrawCommand& command = commands[indices[i]];
+
+            if (command.Program != program)
+            {
+                program = command.Program;
+                state.UseProgram(program);
+                modelLoc = glGetUniformLocation(program, "model");
+                colorLoc = glGetUniformLocation(program, "objectColor");
+                material = NO_MATERIAL;
+                ++pending.SortedProgramChanges;
+            }
+            if (command.VertexArray != vertexArray)
+            {
+                vertexArray = command.VertexArray;
+                state.BindVertexArray(vertexArray);
+                ++pending.SortedVertexArrayBinds;
+            }
+            if (MaterialChanged(command, material, color))
+            {
+                material = command.Material;
+                color = command.Color;
+                state.Uniform3f(colorLoc, command.Color.r, command.Color.g, command.Color.b);
+                ++pending.SortedMaterialChanges;
+            }
+
+            state.UniformMatrix4fv(modelLoc, glm::value_ptr(command.Model));
+            if (command.Indexed)
+                state.DrawElements(GL_TRIANGLES, command.Count, GL_UNSIGNED_INT, (const void*)(command.First * sizeof(GLuint)));
+            else
+                state.DrawArrays(GL_TRIANGLES, command.First, command.Count);
+        }
+
+        Stats = pending;
+        count = 0;
+    }
+
+    // Number of draws recorded since Begin
+    uint32_t Size() const { return count; }
+
+private:
+    static const uint32_t NO_MATERIAL = 0xFFFFFFFFu;
+    static const uint32_t MAX_MATERIALS = 64;
+    static const uint32_t MAX_PROGRAMS = 256;           // 8 key bits
+    static const uint32_t MAX_VERTEX_ARRAYS = 4096;     // 12 key bits
+
+    LinearArena arena;
+    size_t commandsOffset;
+    uint32_t count;
+    uint32_t capacity;
+
+    glm::vec3 eyePosition;
+    float maxDistance;
+
+    // Distinct colors seen this frame; their index is the material id
+    glm::vec3 materials[MAX_MATERIALS];
+    uint32_t materialCount;
+
+    // Distinct programs and vertex arrays seen this frame; their index goes into the key
+    GLuint programs[MAX_PROGRAMS];
+    uint32_t programCount;
+    GLuint vertexArrays[MAX_VERTEX_ARRAYS];
+    uint32_t vertexArrayCount;
+
+    CommandStats pending;
+    GLuint lastImmediateProgram;
+    uint32_t lastImmediateMaterial;
+    glm::vec3 lastImmediateColor;
+
+    uint32_t MaterialOf(const glm::vec3& color)
+    {
+        for (uint32_t i = 0; i < materialCount; ++i)
+        {
+            if (materials[i] == color)
+                return i;
+        }
+        if (materialCount == MAX_MATERIALS)
+            return MAX_MATERIALS;
+        materials[materialCount] = color;
+        return materialCount++;
+    }
+
+    // Index of id in table, added on first use; ids past capacity share the last index
+    static uint32_t IndexOf(GLuint* table, uint32_t& tableCount, uint32_t tableCapacity, GLuint id)
+    {
+        for (uint32_t i = 0; i < tableCount; ++i)
+        {
+            if (table[i] == id)
+                return i;
+        }
+        if (tableCount == tableCapacity)
+            return tableCapacity - 1;
+        table[tableCount] = id;
+        return tableCount++;
+    }
+
+    // The colors past MAX_MATERIALS share an id, so for them the color itself has to be compared
+    static bool MaterialChanged(const DrawCommand& command, uint32_t material, const glm::vec3& color)
+    {
+        return command.Material != material || (material == MAX_MATERIALS && command.Color != color);
+    }
+
+    uint64_t KeyOf(const DrawCommand& command) const
+    {
+        glm::vec3 center(command.Model[3]);
+        float distance = glm::clamp(glm::distance(center, eyePosition) / maxDistance, 0.0f, 1.0f);
+        uint64_t depth = (uint64_t)(distance * float(0xFFFFFF));
+
+        return ((uint64_t)command.ProgramIndex << 56)
+            | ((uint64_t)command.VertexArrayIndex << 44)
+            | ((uint64_t)(command.Material & 0xFFFFF) << 24)
+            | depth;
+    }
+
+    // Commands are addressed by offset, so growing moves them to a fresh block at the end of the arena
+    void Grow()
+    {
+        size_t grown = arena.Allocate(capacity * 2 * sizeof(DrawCommand));
+        std::memcpy(arena.At<DrawCommand>(grown), arena.At<DrawCommand>(commandsOffset), count * sizeof(DrawCommand));
+        commandsOffset = grown;
+        capacity *= 2;
+    }
+
+    // LSD radix sort on 8-bit digits, skipping digits that are the same for every key
+    static void RadixSort(uint64_t* keys, uint32_t* values, uint64_t* scratchKeys, uint32_t* scratchValues, uint32_t n)
+    {
+        for (unsigned shift = 0; shift < 64; shift += 8)
+        {
+            uint32_t histogram[256] = { 0 };
+            for (uint32_t i = 0; i < n; ++i)
+                ++histogram[(keys[i] >> shift) & 0xFF];
+
+            if (n == 0 || histogram[(keys[0] >> shift) & 0xFF] == n)
+                continue;
+
+            uint32_t offset = 0;
+            for (unsigned digit = 0; digit < 256; ++digit)
+            {
+                uint32_t bucket = histogram[digit];
+                histogram[digit] = offset;
+                offset += bucket;
+            }
+
+            for (uint32_t i = 0; i < n; ++i)
+            {
+                uint32_t destination = histogram[(keys[i] >> shift) & 0xFF]++;
+                scratchKeys[destination] = keys[i];
+                scratchValues[destination] = values[i];
+            }
+
+            std::memcpy(keys, scratchKeys, n * sizeof(uint64_t));
+            std::memcpy(values, scratchValues, n * sizeof(uint32_t));
+        }
+    }
+
+    CommandBuffer(const CommandBuffer&);
+    CommandBuffer& operator=(const CommandBuffer&);
+};
+#endif
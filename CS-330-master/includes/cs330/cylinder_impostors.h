@@ -0,0 +1,228 @@
+/* Capped cylinders drawn as ray-cast impostors.
+
+Each cylinder is the 14-vertex triangle strip of its bounding box, oriented
+along its axis. Only the front faces are shaded: their fragment shader
+intersects the eye ray with the exact capped cylinder, discards the misses,
+and writes the hit's normal and depth, so the silhouette stays round at any
+zoom for 14 vertices a cylinder. The cylinder lies behind the box's front
+faces, so the written depth is never nearer than the rasterized one and
+depth_greater keeps the coarse depth test before the fragment shader.
+
+A camera inside a box sees only its back faces, and the cylinder disappears;
+the legs and edges of a scene are too thin for it to matter.
+
+Like SphereImpostors, it needs a perspective projection with the default -1..1 clip depth.
+*/
+
+#ifndef CYLINDER_IMPOSTORS_H
+#define CYLINDER_IMPOSTORS_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <cs330/gl_shader.h>
+#include <cs330/gl_state_cache.h>
+
+#ifndef GLSL
+#define GLSL(Version, Source) "#version " #Version " core \n" #Source
+#endif
+
+// One cylinder, read as three per-instance attributes
+struct CylinderInstance
+{
+    glm::vec4 Bottom;       // world-space center of one cap, and the radius
+    glm::vec4 Top;          // world-space center of the other cap; w is unused
+    glm::vec4 Color;
+};
+
+class CylinderImpostors
+{
+public:
+    static const GLsizei BOX_VERTICES = 14;
+
+    CylinderImpostors() : program(0), vao(0), instanceBuffer(0), count(0) {}
+
+    bool Create()
+    {
+        program = CreateShaderProgram(VertexSource(), FragmentSource(), "CYLINDER_IMPOSTOR");
+        if (program == 0)
+            return false;
+
+        // The box corners come from gl_VertexID, so the vertex array only has the instance attributes
+        glGenBuffers(1, &instanceBuffer);
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        for (GLuint location = 0; location < 3; ++location)
+        {
+            glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(CylinderInstance), (char*)(sizeof(glm::vec4) * location));
+            glVertexAttribDivisor(location, 1);
+            glEnableVertexAttribArray(location);
+        }
+        glBindVertexArray(0);
+
+        viewLoc = glGetUniformLocation(program, "view");
+        projectionLoc = glGetUniformLocation(program, "projection");
+        lightColorLoc = glGetUniformLocation(program, "lightColor");
+        lightPosLoc = glGetUniformLocation(program, "lightPos");
+        return true;
+    }
+
+    void Release()
+    {
+        glDeleteProgram(program);
+        glDeleteVertexArrays(1, &vao);
+        glDeleteBuffers(1, &instanceBuffer);
+        program = vao = instanceBuffer = 0;
+        count = 0;
+    }
+
+    // Uploads the cylinders. Binds the buffer directly, so a GLStateCache in use has to be invalidated after it.
+    void SetCylinders(const CylinderInstance* cylinders, GLsizei cylinderCount)
+    {
+        count = cylinderCount;
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)count * sizeof(CylinderInstance), cylinders, GL_STATIC_DRAW);
+    }
+
+    // Ray-casts every cylinder in its box, in one instanced draw
+    void Draw(GLStateCache& state, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& lightPosition, const glm::vec3& lightColor)
+    {
+        if (count == 0)
+            return;
+        state.UseProgram(program);
+        state.UniformMatrix4fv(viewLoc, glm::value_ptr(view));
+        state.UniformMatrix4fv(projectionLoc, glm::value_ptr(projection));
+        state.Uniform3f(lightColorLoc, lightColor.r, lightColor.g, lightColor.b);
+        state.Uniform3f(lightPosLoc, lightPosition.x, lightPosition.y, lightPosition.z);
+        state.BindVertexArray(vao);
+        state.DrawArraysInstanced(GL_TRIANGLE_STRIP, 0, BOX_VERTICES, count);
+    }
+
+    GLsizei Count() const { return count; }
+    // Vertices a Draw runs through the vertex shader
+    unsigned Vertices() const { return (unsigned)BOX_VERTICES * (unsigned)count; }
+
+private:
+    GLuint program;
+    GLuint vao;
+    GLuint instanceBuffer;
+    GLint viewLoc, projectionLoc, lightColorLoc, lightPosLoc;
+    GLsizei count;
+
+    // Box corners in view space; the bit masks give a strip whose triangles all wind counter-clockwise seen from outside
+    static const char* VertexSource()
+    {
+        return GLSL(440,
+            layout(location = 0) in vec4 bottom;
+            layout(location = 1) in vec4 top;
+            layout(location = 2) in vec4 color;
+
+            out vec3 boxPosition;
+            flat out vec4 viewBottom;
+            flat out vec3 viewTop;
+            flat out vec3 cylinderColor;
+            flat out vec3 viewLight;
+
+            uniform mat4 view;
+            uniform mat4 projection;
+            uniform vec3 lightPos;
+
+            void main()
+            {
+                vec3 a = vec3(view * vec4(bottom.xyz, 1.0f));
+                vec3 b = vec3(view * vec4(top.xyz, 1.0f));
+                float radius = bottom.w;
+
+                // Right-handed basis along the axis, which keeps the strip's winding
+                vec3 axis = normalize(b - a);
+                vec3 helper = abs(axis.y) > 0.99f ? vec3(1.0f, 0.0f, 0.0f) : vec3(0.0f, 1.0f, 0.0f);
+                vec3 side = normalize(cross(axis, helper));
+                vec3 depth = cross(axis, side);
+
+                int bit = 1 << gl_VertexID;
+                vec3 corner = vec3((0x287a & bit) != 0, (0x02af & bit) != 0, (0x31e3 & bit) != 0) * 2.0f - 1.0f;
+                boxPosition = 0.5f * (a + b) + axis * (0.5f * corner.x * distance(a, b)) + (side * corner.y + depth * corner.z) * radius;
+                gl_Position = projection * vec4(boxPosition, 1.0f);
+
+                viewBottom = vec4(a, radius);
+                viewTop = b;
+                cylinderColor = color.rgb;
+                viewLight = vec3(view * vec4(lightPos, 1.0f));
+            }
+        );
+    }
+
+    // Ray against the side, then against the cap on the side the ray enters, in view space where the eye is the origin
+    static const char* FragmentSource()
+    {
+        return GLSL(440,
+            in vec3 boxPosition;
+            flat in vec4 viewBottom;
+            flat in vec3 viewTop;
+            flat in vec3 cylinderColor;
+            flat in vec3 viewLight;
+
+            layout(depth_greater) out float gl_FragDepth;
+            out vec4 fragmentColor;
+
+            uniform mat4 projection;
+            uniform vec3 lightColor;
+
+            void main()
+            {
+                if (!gl_FrontFacing)
+                    discard;
+
+                vec3 ray = normalize(boxPosition);
+                float radius = viewBottom.w;
+                vec3 ba = viewTop - viewBottom.xyz;
+                vec3 oc = -viewBottom.xyz;
+                float baba = dot(ba, ba);
+                float bard = dot(ba, ray);
+                float baoc = dot(ba, oc);
+
+                // Infinite cylinder: k2 t^2 + 2 k1 t + k0 = 0
+                float k2 = baba - bard * bard;
+                float k1 = baba * dot(oc, ray) - baoc * bard;
+                float k0 = baba * dot(oc, oc) - baoc * baoc - radius * radius * baba;
+                float h = k1 * k1 - k2 * k0;
+                if (h < 0.0f)
+                    discard;
+                h = sqrt(h);
+
+                float t = (-k1 - h) / k2;
+                float y = baoc + t * bard;
+                vec3 norm;
+                if (y > 0.0f && y < baba)
+                    norm = (oc + t * ray - ba * y / baba) / radius;
+                else
+                {
+                    // Past an end: the cap plane of that end, if the ray crosses it inside the radius
+                    t = ((y < 0.0f ? 0.0f : baba) - baoc) / bard;
+                    if (abs(k1 + k2 * t) >= h)
+                        discard;
+                    norm = ba * sign(y) / sqrt(baba);
+                }
+                vec3 hit = ray * t;
+
+                vec4 clip = projection * vec4(hit, 1.0f);
+                gl_FragDepth = 0.5f * (gl_DepthRange.diff * clip.z / clip.w + gl_DepthRange.near + gl_DepthRange.far);
+
+                // Phong lighting of the tut_04_04 fragment shader
+                vec3 ambient = 0.1f * lightColor;
+                vec3 lightDirection = normalize(viewLight - hit);
+                vec3 diffuse = max(dot(norm, lightDirection), 0.0) * lightColor;
+                vec3 reflectDir = reflect(-lightDirection, norm);
+                vec3 specular = 0.8f * pow(max(dot(-ray, reflectDir), 0.0), 16.0f) * lightColor;
+
+                fragmentColor = vec4((ambient + diffuse + specular) * cylinderColor, 1.0f);
+            }
+        );
+    }
+
+    CylinderImpostors(const CylinderImpostors&);
+    CylinderImpostors& operator=(const CylinderImpostors&);
+};
+#endif
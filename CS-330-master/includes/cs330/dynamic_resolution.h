@@ -0,0 +1,206 @@
+/* Renders the scene below window resolution when the GPU falls behind, and upscales it.
+
+The scene renders into a target of TargetWidth() x TargetHeight(), with
+SceneViewport() setting the viewport to the window size times Scale(); Upscale
+draws that region over the whole window with a bilinear upscale followed by a
+sharpening filter. The filter adds the
+difference between the pixel and its four neighbours, clamped to their range
+so edges do not ring, and is stronger the lower the scale.
+
+Update is the controller: the fill cost goes with the pixel count, so the
+scale that would meet the budget is scale * sqrt(budget / gpuMs). The scale
+moves a fraction of the way there each frame, and only while the GPU time is
+over budget or well under it, since the profiler's timings arrive late and
+smoothed and a tighter loop would oscillate.
+
+The target size only grows: it is the largest window size seen, rounded up
+so dragging a window edge does not change it, and with it whatever holds the
+target, every frame.
+*/
+
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <cs330/gl_shader.h>
+#include <cs330/gl_state_cache.h>
+
+#include <cmath>
+
+#ifndef GLSL
+#define GLSL(Version, Source) "#version " #Version " core \n" #Source
+#endif
+
+class DynamicResolution
+{
+public:
+    // Off renders at MaxScale
+    bool Enabled;
+    float MinScale;
+    float MaxScale;
+    // GPU milliseconds per frame the controller aims at
+    float BudgetMs;
+    // Sharpening at MinScale, scaled down to none at MaxScale
+    float Sharpness;
+    // Times the target size grew
+    unsigned Reallocations;
+
+    DynamicResolution() : Enabled(true), MinScale(0.5f), MaxScale(1.0f), BudgetMs(14.0f), Sharpness(0.6f), Reallocations(0),
+        program(0), vao(0), windowWidth(1), windowHeight(1),
+        capacityWidth(0), capacityHeight(0), renderWidth(1), renderHeight(1), scale(1.0f) {}
+
+    bool Create(int width, int height)
+    {
+        program = CreateShaderProgram(VertexSource(), FragmentSource(), "UPSCALE");
+        if (program == 0)
+            return false;
+        regionLoc = glGetUniformLocation(program, "region");
+        texelLoc = glGetUniformLocation(program, "texel");
+        sharpnessLoc = glGetUniformLocation(program, "sharpness");
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "scene"), 0);
+
+        // The full-screen triangle comes from gl_VertexID
+        glGenVertexArrays(1, &vao);
+        Resize(width, height);
+        scale = MaxScale;
+        Update(0.0);
+        return true;
+    }
+
+    void Release()
+    {
+        glDeleteProgram(program);
+        glDeleteVertexArrays(1, &vao);
+        program = vao = 0;
+        capacityWidth = capacityHeight = 0;
+    }
+
+    // Window framebuffer size; grows the target, rounded up to CAPACITY_STEP, when it no longer fits
+    void Resize(int width, int height)
+    {
+        windowWidth = width > 1 ? width : 1;
+        windowHeight = height > 1 ? height : 1;
+        if (windowWidth <= capacityWidth && windowHeight <= capacityHeight)
+            return;
+        capacityWidth = glm::max(capacityWidth, (windowWidth + CAPACITY_STEP - 1) / CAPACITY_STEP * CAPACITY_STEP);
+        capacityHeight = glm::max(capacityHeight, (windowHeight + CAPACITY_STEP - 1) / CAPACITY_STEP * CAPACITY_STEP);
+        ++Reallocations;
+    }
+
+    // Moves the scale toward the one meeting the budget, given the last GPU frame time
+    void Update(double gpuMs)
+    {
+        // Under HEADROOM x budget the scale grows back; each frame moves GAIN of the way, at most MAX_STEP
+        const float HEADROOM = 0.8f;
+        const float GAIN = 0.05f;
+        const float MAX_STEP = 0.02f;
+
+        if (!Enabled)
+            scale = MaxScale;
+        else if (gpuMs > 0.0 && (gpuMs > BudgetMs || gpuMs < BudgetMs * HEADROOM))
+        {
+            float target = scale * (float)sqrt(BudgetMs / gpuMs);
+            scale += glm::clamp((target - scale) * GAIN, -MAX_STEP, MAX_STEP);
+            scale = glm::clamp(scale, MinScale, MaxScale);
+        }
+
+        // Whole multiples of 8 pixels, so small scale changes do not move the viewport every frame
+        renderWidth = glm::clamp(((int)(windowWidth * scale) + 4) / 8 * 8, 1, windowWidth);
+        renderHeight = glm::clamp(((int)(windowHeight * scale) + 4) / 8 * 8, 1, windowHeight);
+    }
+
+    // Restricts drawing to the scaled region of the bound target; glClear still clears all of it
+    void SceneViewport() const
+    {
+        glViewport(0, 0, renderWidth, renderHeight);
+    }
+
+    // Draws the scene region of sceneTexture, a target of TargetWidth() x TargetHeight(), over the bound framebuffer
+    void Upscale(GLStateCache& state, GLuint sceneTexture)
+    {
+        float amount = MaxScale > MinScale ? Sharpness * (MaxScale - scale) / (MaxScale - MinScale) : 0.0f;
+        state.SetDepthTest(false);
+        state.UseProgram(program);
+        state.Uniform2f(regionLoc, (float)renderWidth / capacityWidth, (float)renderHeight / capacityHeight);
+        state.Uniform2f(texelLoc, 1.0f / capacityWidth, 1.0f / capacityHeight);
+        state.Uniform1f(sharpnessLoc, amount);
+        state.BindTexture(0, sceneTexture);
+        state.BindVertexArray(vao);
+        state.DrawArrays(GL_TRIANGLES, 0, 3);
+        state.SetDepthTest(true);
+    }
+
+    float Scale() const { return scale; }
+    int RenderWidth() const { return renderWidth; }
+    int RenderHeight() const { return renderHeight; }
+    int TargetWidth() const { return capacityWidth; }
+    int TargetHeight() const { return capacityHeight; }
+
+private:
+    static const int CAPACITY_STEP = 256;
+
+    GLuint program;
+    GLuint vao;
+    GLint regionLoc, texelLoc, sharpnessLoc;
+    int windowWidth, windowHeight;
+    int capacityWidth, capacityHeight;
+    int renderWidth, renderHeight;
+    float scale;
+
+    static const char* VertexSource()
+    {
+        return GLSL(440,
+            out vec2 screenUv;
+
+            void main()
+            {
+                // One triangle covering the screen: (-1, -1), (3, -1), (-1, 3)
+                vec2 corner = vec2(float((gl_VertexID & 1) << 2), float((gl_VertexID & 2) << 1)) - 1.0f;
+                screenUv = corner * 0.5f + 0.5f;
+                gl_Position = vec4(corner, 0.0f, 1.0f);
+            }
+        );
+    }
+
+    static const char* FragmentSource()
+    {
+        return GLSL(440,
+            in vec2 screenUv;
+
+            out vec4 fragmentColor;
+
+            uniform sampler2D scene;
+            uniform vec2 region;        // rendered size over the texture size
+            uniform vec2 texel;         // size of a texel in texture coordinates
+            uniform float sharpness;
+
+            // Keeps the bilinear taps inside the rendered region
+            vec3 Tap(vec2 uv)
+            {
+                return texture(scene, clamp(uv, 0.5f * texel, region - 0.5f * texel)).rgb;
+            }
+
+            void main()
+            {
+                vec2 uv = screenUv * region;
+                vec3 center = Tap(uv);
+                vec3 left = Tap(uv - vec2(texel.x, 0.0f));
+                vec3 right = Tap(uv + vec2(texel.x, 0.0f));
+                vec3 down = Tap(uv - vec2(0.0f, texel.y));
+                vec3 up = Tap(uv + vec2(0.0f, texel.y));
+
+                vec3 low = min(center, min(min(left, right), min(down, up)));
+                vec3 high = max(center, max(max(left, right), max(down, up)));
+                vec3 sharpened = center + sharpness * (4.0f * center - left - right - down - up);
+                fragmentColor = vec4(clamp(sharpened, low, high), 1.0f);
+            }
+        );
+    }
+
+    DynamicResolution(const DynamicResolution&);
+    DynamicResolution& operator=(const DynamicResolution&);
+};
+#endif
@@ -0,0 +1,227 @@
+/* Entity storage as a structure of arrays.
+
+Every component field (position x, position y, ..., bounds radius) is its own
+float array, so a loop that animates positions streams through the position
+arrays only instead of dragging whole objects through the cache. The arrays are
+64-byte aligned and padded to a multiple of ENTITY_BLOCK entries with zeros, so
+SIMD loops can use aligned loads and run to PaddedCount() with no scalar tail:
+
+    float* x = store.Array(ENTITY_POSITION_X);
+    float* z = store.Array(ENTITY_POSITION_Z);
+    for (uint32_t i = 0; i < store.PaddedCount(); i += 4)
+        ... _mm_load_ps(x + i) ...
+
+Live entities are kept dense in [0, Count()): destroying one moves the last
+entity into its place. EntityHandle stays valid across those moves; a handle
+of a destroyed entity is detected by its generation and never reaches another
+entity that reused the slot.
+*/
+
+#ifndef ENTITY_STORE_H
+#define ENTITY_STORE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+enum Entity_Component {
+    ENTITY_POSITION_X,
+    ENTITY_POSITION_Y,
+    ENTITY_POSITION_Z,
+    ENTITY_ROTATION_X,      // unit quaternion
+    ENTITY_ROTATION_Y,
+    ENTITY_ROTATION_Z,
+    ENTITY_ROTATION_W,
+    ENTITY_SCALE_X,
+    ENTITY_SCALE_Y,
+    ENTITY_SCALE_Z,
+    ENTITY_COLOR_R,
+    ENTITY_COLOR_G,
+    ENTITY_COLOR_B,
+    ENTITY_BOUNDS_RADIUS,   // bounding sphere around the position
+    ENTITY_COMPONENT_COUNT
+};
+
+// Array alignment in bytes and padding granularity in entries (one cache line of floats)
+const size_t ENTITY_ALIGNMENT = 64;
+const uint32_t ENTITY_BLOCK = ENTITY_ALIGNMENT / sizeof(float);
+
+struct EntityHandle
+{
+    uint32_t Slot;
+    uint32_t Generation;    // 0 never names a live entity
+};
+
+class EntityStore
+{
+public:
+    EntityStore() : block(nullptr), data(nullptr), count(0), capacity(0) {}
+    ~EntityStore() { std::free(block); }
+
+    EntityHandle Create(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale, const glm::vec3& color, float boundsRadius)
+    {
+        if (count == capacity)
+            Grow(capacity == 0 ? ENTITY_BLOCK : capacity * 2);
+
+        // Reuse a free slot when there is one
+        uint32_t slot;
+        if (!freeSlots.empty())
+        {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else
+        {
+            slot = (uint32_t)slots.size();
+            Slot empty = { 0, 0 };
+            slots.push_back(empty);
+        }
+        slots[slot].Index = count;
+        slots[slot].Generation += 1;
+        slotOfIndex.push_back(slot);
+
+        uint32_t index = count++;
+        SetVector(ENTITY_POSITION_X, index, position);
+        Array(ENTITY_ROTATION_X)[index] = rotation.x;
+        Array(ENTITY_ROTATION_Y)[index] = rotation.y;
+        Array(ENTITY_ROTATION_Z)[index] = rotation.z;
+        Array(ENTITY_ROTATION_W)[index] = rotation.w;
+        SetVector(ENTITY_SCALE_X, index, scale);
+        SetVector(ENTITY_COLOR_R, index, color);
+        Array(ENTITY_BOUNDS_RADIUS)[index] = boundsRadius;
+
+        EntityHandle handle = { slot, slots[slot].Generation };
+        return handle;
+    }
+
+    // Destroys the entity; the last entity moves into its index. False for a stale handle.
+    bool Destroy(EntityHandle handle)
+    {
+        if (!IsAlive(handle))
+            return false;
+
+        uint32_t index = slots[handle.Slot].Index;
+        uint32_t last = count - 1;
+        for (int component = 0; component < ENTITY_COMPONENT_COUNT; ++component)
+        {
+            float* values = Array((Entity_Component)component);
+            values[index] = values[last];
+            values[last] = 0.0f;    // padding stays zero
+        }
+        slotOfIndex[index] = slotOfIndex[last];
+        slots[slotOfIndex[index]].Index = index;
+        slotOfIndex.pop_back();
+        --count;
+
+        // Bump the generation so the handle stops resolving, and never hand out generation 0
+        slots[handle.Slot].Generation += slots[handle.Slot].Generation == UINT32_MAX ? 2 : 1;
+        freeSlots.push_back(handle.Slot);
+        return true;
+    }
+
+    bool IsAlive(EntityHandle handle) const
+    {
+        return handle.Slot < slots.size() && handle.Generation != 0 && slots[handle.Slot].Generation == handle.Generation;
+    }
+
+    // Dense index of a live entity in the component arrays; it changes when other entities are destroyed
+    uint32_t IndexOf(EntityHandle handle) const { return slots[handle.Slot].Index; }
+
+    // Live entities, at indices [0, Count())
+    uint32_t Count() const { return count; }
+
+    // Count() rounded up to ENTITY_BLOCK; entries past Count() are zero and safe to process
+    uint32_t PaddedCount() const { return (count + ENTITY_BLOCK - 1) / ENTITY_BLOCK * ENTITY_BLOCK; }
+
+    // The component array, ENTITY_ALIGNMENT aligned; valid until the next Create
+    float* Array(Entity_Component component) { return data + (size_t)component * capacity; }
+    const float* Array(Entity_Component component) const { return data + (size_t)component * capacity; }
+
+    // Per-entity access through handles
+    glm::vec3 Position(EntityHandle handle) const { return GetVector(ENTITY_POSITION_X, IndexOf(handle)); }
+    glm::vec3 Scale(EntityHandle handle) const { return GetVector(ENTITY_SCALE_X, IndexOf(handle)); }
+    glm::vec3 Color(EntityHandle handle) const { return GetVector(ENTITY_COLOR_R, IndexOf(handle)); }
+    float BoundsRadius(EntityHandle handle) const { return Array(ENTITY_BOUNDS_RADIUS)[IndexOf(handle)]; }
+    glm::quat Rotation(EntityHandle handle) const
+    {
+        uint32_t index = IndexOf(handle);
+        return glm::quat(Array(ENTITY_ROTATION_W)[index], Array(ENTITY_ROTATION_X)[index], Array(ENTITY_ROTATION_Y)[index], Array(ENTITY_ROTATION_Z)[index]);
+    }
+
+    void SetPosition(EntityHandle handle, const glm::vec3& position) { SetVector(ENTITY_POSITION_X, IndexOf(handle), position); }
+    void SetScale(EntityHandle handle, const glm::vec3& scale) { SetVector(ENTITY_SCALE_X, IndexOf(handle), scale); }
+    void SetColor(EntityHandle handle, const glm::vec3& color) { SetVector(ENTITY_COLOR_R, IndexOf(handle), color); }
+    void SetBoundsRadius(EntityHandle handle, float radius) { Array(ENTITY_BOUNDS_RADIUS)[IndexOf(handle)] = radius; }
+    void SetRotation(EntityHandle handle, const glm::quat& rotation)
+    {
+        uint32_t index = IndexOf(handle);
+        Array(ENTITY_ROTATION_X)[index] = rotation.x;
+        Array(ENTITY_ROTATION_Y)[index] = rotation.y;
+        Array(ENTITY_ROTATION_Z)[index] = rotation.z;
+        Array(ENTITY_ROTATION_W)[index] = rotation.w;
+    }
+
+    // Model matrix of an entity: translation * rotation * scale
+    glm::mat4 ModelMatrix(EntityHandle handle) const
+    {
+        glm::vec3 scale = Scale(handle);
+        glm::mat4 model = glm::mat4_cast(Rotation(handle));
+        model[0] *= scale.x;
+        model[1] *= scale.y;
+        model[2] *= scale.z;
+        model[3] = glm::vec4(Position(handle), 1.0f);
+        return model;
+    }
+
+private:
+    struct Slot
+    {
+        uint32_t Index;         // dense index while alive
+        uint32_t Generation;
+    };
+
+    void* block;                // allocation holding every array
+    float* data;                // block aligned to ENTITY_ALIGNMENT
+    uint32_t count;
+    uint32_t capacity;          // entries per array, a multiple of ENTITY_BLOCK
+    std::vector<Slot> slots;
+    std::vector<uint32_t> slotOfIndex;
+    std::vector<uint32_t> freeSlots;
+
+    glm::vec3 GetVector(Entity_Component first, uint32_t index) const
+    {
+        const float* x = Array(first);
+        return glm::vec3(x[index], x[capacity + index], x[2 * (size_t)capacity + index]);
+    }
+
+    void SetVector(Entity_Component first, uint32_t index, const glm::vec3& value)
+    {
+        float* x = Array(first);
+        x[index] = value.x;
+        x[capacity + index] = value.y;
+        x[2 * (size_t)capacity + index] = value.z;
+    }
+
+    void Grow(uint32_t newCapacity)
+    {
+        // One allocation for all arrays; each array is a whole number of cache lines
+        size_t bytes = (size_t)newCapacity * ENTITY_COMPONENT_COUNT * sizeof(float);
+        void* newBlock = std::calloc(bytes + ENTITY_ALIGNMENT, 1);
+        float* newData = reinterpret_cast<float*>((reinterpret_cast<uintptr_t>(newBlock) + ENTITY_ALIGNMENT - 1) & ~(uintptr_t)(ENTITY_ALIGNMENT - 1));
+        for (int component = 0; data != nullptr && component < ENTITY_COMPONENT_COUNT; ++component)
+            std::memcpy(newData + (size_t)component * newCapacity, data + (size_t)component * capacity, count * sizeof(float));
+
+        std::free(block);
+        block = newBlock;
+        data = newData;
+        capacity = newCapacity;
+    }
+
+    EntityStore(const EntityStore&);
+    EntityStore& operator=(const EntityStore&);
+};
+#endif
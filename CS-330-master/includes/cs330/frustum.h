@@ -0,0 +1,87 @@
+/* View frustum planes extracted from a view-projection matrix (Gribb/Hartmann),
+used to skip objects that cannot be seen before any GL call is made for them.
+*/
+
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+// Plane order in Frustum::Planes
+enum Frustum_Plane {
+    FRUSTUM_LEFT,
+    FRUSTUM_RIGHT,
+    FRUSTUM_BOTTOM,
+    FRUSTUM_TOP,
+    FRUSTUM_NEAR,
+    FRUSTUM_FAR
+};
+
+// Clip-space depth range of the matrix the planes are extracted from (see glClipControl)
+enum Frustum_Depth {
+    FRUSTUM_DEPTH_NEGATIVE_ONE_TO_ONE,
+    FRUSTUM_DEPTH_ZERO_TO_ONE
+};
+
+class Frustum
+{
+public:
+    // Planes as (normal, distance) with normals pointing inside the frustum
+    glm::vec4 Planes[6];
+
+    Frustum()
+    {
+        for (int i = 0; i < 6; ++i)
+            Planes[i] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    }
+
+    explicit Frustum(const glm::mat4& viewProjection, Frustum_Depth depth = FRUSTUM_DEPTH_NEGATIVE_ONE_TO_ONE)
+    {
+        ExtractFrom(viewProjection, depth);
+    }
+
+    // Extracts the six planes of a -w..w (the OpenGL default) or 0..w clip volume.
+    // With reversed-Z the near and far planes swap places; with an infinite far plane
+    // one of them degenerates to a plane at infinity that never rejects anything.
+    void ExtractFrom(const glm::mat4& viewProjection, Frustum_Depth depth = FRUSTUM_DEPTH_NEGATIVE_ONE_TO_ONE)
+    {
+        // glm matrices are column-major, so row(i) gathers element i of every column
+        glm::vec4 row0(viewProjection[0][0], viewProjection[1][0], viewProjection[2][0], viewProjection[3][0]);
+        glm::vec4 row1(viewProjection[0][1], viewProjection[1][1], viewProjection[2][1], viewProjection[3][1]);
+        glm::vec4 row2(viewProjection[0][2], viewProjection[1][2], viewProjection[2][2], viewProjection[3][2]);
+        glm::vec4 row3(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+
+        Planes[FRUSTUM_LEFT] = row3 + row0;
+        Planes[FRUSTUM_RIGHT] = row3 - row0;
+        Planes[FRUSTUM_BOTTOM] = row3 + row1;
+        Planes[FRUSTUM_TOP] = row3 - row1;
+        Planes[FRUSTUM_NEAR] = depth == FRUSTUM_DEPTH_ZERO_TO_ONE ? row2 : row3 + row2;
+        Planes[FRUSTUM_FAR] = row3 - row2;
+
+        for (int i = 0; i < 6; ++i)
+            Planes[i] = NormalizePlane(Planes[i]);
+    }
+
+    // true when the sphere is at least partially inside the frustum
+    bool IntersectsSphere(const glm::vec3& center, float radius) const
+    {
+        for (int i = 0; i < 6; ++i)
+        {
+            if (glm::dot(glm::vec3(Planes[i]), center) + Planes[i].w < -radius)
+                return false;
+        }
+        return true;
+    }
+
+private:
+    static glm::vec4 NormalizePlane(const glm::vec4& plane)
+    {
+        float length = glm::length(glm::vec3(plane));
+
+        // A plane at infinity never rejects anything
+        if (length < 1e-12f)
+            return glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        return plane / length;
+    }
+};
+#endif
@@ -0,0 +1,85 @@
+/* Shader program helpers for the cs330 headers that own GL programs
+(overlay, impostors, culling, ...). Errors are reported on cerr and the
+functions return 0, in the spirit of UCreateShaderProgram in the tutorials.
+*/
+
+#ifndef GL_SHADER_H
+#define GL_SHADER_H
+
+#include <GL/glew.h>
+
+#include <iostream>
+
+// Compiles one shader stage; returns 0 and prints the log on failure
+inline GLuint CompileShaderStage(GLenum stage, const char* source, const char* label)
+{
+    GLuint shaderId = glCreateShader(stage);
+    glShaderSource(shaderId, 1, &source, NULL);
+    glCompileShader(shaderId);
+
+    int success = 0;
+    glGetShaderiv(shaderId, GL_COMPILE_STATUS, &success);
+    if (!success)
+    {
+        char infoLog[1024];
+        glGetShaderInfoLog(shaderId, sizeof(infoLog), NULL, infoLog);
+        std::cerr << "ERROR::SHADER::" << label << "::COMPILATION_FAILED\n" << infoLog << std::endl;
+        glDeleteShader(shaderId);
+        return 0;
+    }
+    return shaderId;
+}
+
+// Links the given stages into a program; returns 0 and prints the log on failure
+inline GLuint LinkShaderProgram(const GLuint* shaders, int count, const char* label)
+{
+    GLuint programId = glCreateProgram();
+    for (int i = 0; i < count; ++i)
+        glAttachShader(programId, shaders[i]);
+    glLinkProgram(programId);
+
+    // The program keeps what it needs once linked
+    for (int i = 0; i < count; ++i)
+    {
+        glDetachShader(programId, shaders[i]);
+        glDeleteShader(shaders[i]);
+    }
+
+    int success = 0;
+    glGetProgramiv(programId, GL_LINK_STATUS, &success);
+    if (!success)
+    {
+        char infoLog[1024];
+        glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
+        std::cerr << "ERROR::SHADER::" << label << "::LINKING_FAILED\n" << infoLog << std::endl;
+        glDeleteProgram(programId);
+        return 0;
+    }
+    return programId;
+}
+
+// Builds a vertex + fragment program
+inline GLuint CreateShaderProgram(const char* vertexSource, const char* fragmentSource, const char* label)
+{
+    GLuint shaders[2];
+    shaders[0] = CompileShaderStage(GL_VERTEX_SHADER, vertexSource, label);
+    shaders[1] = CompileShaderStage(GL_FRAGMENT_SHADER, fragmentSource, label);
+    if (shaders[0] == 0 || shaders[1] == 0)
+    {
+        glDeleteShader(shaders[0]);
+        glDeleteShader(shaders[1]);
+        return 0;
+    }
+    return LinkShaderProgram(shaders, 2, label);
+}
+
+// Builds a compute program
+inline GLuint CreateComputeProgram(const char* computeSource, const char* label)
+{
+    GLuint shader = CompileShaderStage(GL_COMPUTE_SHADER, computeSource, label);
+    if (shader == 0)
+        return 0;
+    return LinkShaderProgram(&shader, 1, label);
+}
+
+#endif
@@ -0,0 +1,361 @@
+/* Thin state-tracking layer over the GL calls issued every frame.
+
+Program, buffer, texture, depth and blend changes go through the cache, which
+drops calls that would set the state GL already has. Vertex array binds are
+deferred until something depends on them (a draw or an element buffer bind), so
+binding several VAOs back to back with nothing drawn costs a single call at most.
+
+Draws and uniform uploads also go through the cache so the frame counters
+(draw calls, triangles, uniform uploads) cover everything the frame issued.
+
+Setup code (mesh and shader creation) may call GL directly; call Invalidate()
+afterwards so the cache stops trusting what it remembers.
+*/
+
+#ifndef GL_STATE_CACHE_H
+#define GL_STATE_CACHE_H
+
+#include <GL/glew.h>
+
+// Per-frame counters: state calls issued to GL versus dropped as redundant, and the work submitted
+struct GLStateCounters
+{
+    unsigned Issued;
+    unsigned Suppressed;
+    unsigned Draws;
+    unsigned Triangles;
+    unsigned UniformUploads;
+};
+
+class GLStateCache
+{
+public:
+    // Counters of the last finished frame
+    GLStateCounters LastFrame;
+
+    GLStateCache()
+    {
+        ResetCounters(LastFrame);
+        ResetCounters(frame);
+        pendingVertexArray = UNKNOWN;
+        Invalidate();
+    }
+
+    // Forgets every cached value; the next call for each state is always issued.
+    // A deferred vertex array bind is kept, as it has not reached GL yet.
+    void Invalidate()
+    {
+        program = UNKNOWN;
+        vertexArray = UNKNOWN;
+        for (int i = 0; i < BUFFER_TARGETS; ++i)
+            buffers[i] = UNKNOWN;
+        for (GLuint i = 0; i < INDEXED_BINDINGS; ++i)
+            uniformBlocks[i] = storageBlocks[i] = UNKNOWN;
+        activeUnit = UNKNOWN;
+        for (GLuint i = 0; i < TEXTURE_UNITS; ++i)
+            textures[i] = UNKNOWN;
+        depthTest = blend = depthMask = UNKNOWN;
+        depthFunc = blendSource = blendDestination = UNKNOWN;
+    }
+
+    // Publishes this frame's counters in LastFrame and starts counting again
+    void EndFrame()
+    {
+        LastFrame = frame;
+        ResetCounters(frame);
+    }
+
+    // Counters of the frame in progress
+    const GLStateCounters& Current() const { return frame; }
+
+    void UseProgram(GLuint id)
+    {
+        if (Changed(program, id))
+            glUseProgram(id);
+    }
+
+    // Deferred until a draw or an element buffer bind needs it
+    void BindVertexArray(GLuint id)
+    {
+        if (pendingVertexArray != UNKNOWN)
+            ++frame.Suppressed; // the previous deferred bind never reached GL
+        pendingVertexArray = id;
+    }
+
+    // Issues the deferred vertex array bind, if any
+    void CommitVertexArray()
+    {
+        if (pendingVertexArray == UNKNOWN)
+            return;
+        if (Changed(vertexArray, pendingVertexArray))
+        {
+            glBindVertexArray(vertexArray);
+            // The element buffer binding belongs to the vertex array
+            buffers[BufferSlot(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+        }
+        pendingVertexArray = UNKNOWN;
+    }
+
+    void BindBuffer(GLenum target, GLuint id)
+    {
+        if (target == GL_ELEMENT_ARRAY_BUFFER)
+            CommitVertexArray();
+
+        int slot = BufferSlot(target);
+        if (slot < 0)
+        {
+            ++frame.Issued;
+            glBindBuffer(target, id);
+        }
+        else if (Changed(buffers[slot], id))
+            glBindBuffer(target, id);
+    }
+
+    // Binds a range to an indexed uniform or storage block binding; always issued, since
+    // streamed ranges move every frame. GL also binds the buffer to the target itself.
+    void BindBufferRange(GLenum target, GLuint index, GLuint id, GLintptr offset, GLsizeiptr size)
+    {
+        ++frame.Issued;
+        glBindBufferRange(target, index, id, offset, size);
+        int slot = BufferSlot(target);
+        if (slot >= 0)
+            buffers[slot] = id;
+        if (GLuint* binding = IndexedBinding(target, index))
+            *binding = UNKNOWN; // a range is not the whole buffer BindBufferBase would compare against
+    }
+
+    // Binds a whole buffer to an indexed uniform or storage block binding. GL also binds the buffer to the target itself.
+    void BindBufferBase(GLenum target, GLuint index, GLuint id)
+    {
+        GLuint* binding = IndexedBinding(target, index);
+        if (binding == nullptr)
+            ++frame.Issued;
+        else if (!Changed(*binding, id))
+            return;
+
+        glBindBufferBase(target, index, id);
+        int slot = BufferSlot(target);
+        if (slot >= 0)
+            buffers[slot] = id;
+    }
+
+    // Binds a 2D texture to the given texture unit
+    void BindTexture(GLuint unit, GLuint id)
+    {
+        if (unit >= TEXTURE_UNITS)
+        {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            glBindTexture(GL_TEXTURE_2D, id);
+            frame.Issued += 2;
+            activeUnit = unit;
+            return;
+        }
+        if (textures[unit] == id)
+        {
+            ++frame.Suppressed;
+            return;
+        }
+        if (Changed(activeUnit, unit))
+            glActiveTexture(GL_TEXTURE0 + unit);
+        textures[unit] = id;
+        ++frame.Issued;
+        glBindTexture(GL_TEXTURE_2D, id);
+    }
+
+    void SetDepthTest(bool enabled) { Toggle(depthTest, GL_DEPTH_TEST, enabled); }
+    void SetBlend(bool enabled) { Toggle(blend, GL_BLEND, enabled); }
+
+    void SetDepthFunc(GLenum function)
+    {
+        if (Changed(depthFunc, function))
+            glDepthFunc(function);
+    }
+
+    void SetDepthMask(bool enabled)
+    {
+        if (Changed(depthMask, enabled ? 1u : 0u))
+            glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+    }
+
+    void SetBlendFunc(GLenum source, GLenum destination)
+    {
+        if (blendSource == source && blendDestination == destination)
+        {
+            ++frame.Suppressed;
+            return;
+        }
+        blendSource = source;
+        blendDestination = destination;
+        ++frame.Issued;
+        glBlendFunc(source, destination);
+    }
+
+    void DrawArrays(GLenum mode, GLint first, GLsizei count)
+    {
+        CommitVertexArray();
+        CountDraw(mode, count, 1);
+        glDrawArrays(mode, first, count);
+    }
+
+    void DrawElements(GLenum mode, GLsizei count, GLenum type, const void* indices)
+    {
+        CommitVertexArray();
+        CountDraw(mode, count, 1);
+        glDrawElements(mode, count, type, indices);
+    }
+
+    void DrawArraysInstanced(GLenum mode, GLint first, GLsizei count, GLsizei instances)
+    {
+        CommitVertexArray();
+        CountDraw(mode, count, instances);
+        glDrawArraysInstanced(mode, first, count, instances);
+    }
+
+    // Draws the commands of the bound GL_DRAW_INDIRECT_BUFFER; their triangles are not visible to the CPU, so the caller passes them
+    void MultiDrawArraysIndirect(GLenum mode, const void* offset, GLsizei drawCount, unsigned triangles)
+    {
+        CommitVertexArray();
+        ++frame.Draws;
+        frame.Triangles += triangles;
+        glMultiDrawArraysIndirect(mode, offset, drawCount, 0);
+    }
+
+    void MultiDrawElementsIndirect(GLenum mode, GLenum type, const void* offset, GLsizei drawCount, unsigned triangles)
+    {
+        CommitVertexArray();
+        ++frame.Draws;
+        frame.Triangles += triangles;
+        glMultiDrawElementsIndirect(mode, type, offset, drawCount, 0);
+    }
+
+    // Uniform uploads to the current program; only counted, as uniform values belong to each program
+    void Uniform1i(GLint location, GLint value)
+    {
+        ++frame.UniformUploads;
+        glUniform1i(location, value);
+    }
+
+    void Uniform1ui(GLint location, GLuint value)
+    {
+        ++frame.UniformUploads;
+        glUniform1ui(location, value);
+    }
+
+    void Uniform1f(GLint location, GLfloat value)
+    {
+        ++frame.UniformUploads;
+        glUniform1f(location, value);
+    }
+
+    void Uniform2f(GLint location, GLfloat x, GLfloat y)
+    {
+        ++frame.UniformUploads;
+        glUniform2f(location, x, y);
+    }
+
+    void Uniform3f(GLint location, GLfloat x, GLfloat y, GLfloat z)
+    {
+        ++frame.UniformUploads;
+        glUniform3f(location, x, y, z);
+    }
+
+    void Uniform4fv(GLint location, GLsizei count, const GLfloat* value)
+    {
+        ++frame.UniformUploads;
+        glUniform4fv(location, count, value);
+    }
+
+    void UniformMatrix4fv(GLint location, const GLfloat* value)
+    {
+        ++frame.UniformUploads;
+        glUniformMatrix4fv(location, 1, GL_FALSE, value);
+    }
+
+private:
+    static const GLuint UNKNOWN = 0xFFFFFFFFu;
+    static const int BUFFER_TARGETS = 6;
+    static const GLuint TEXTURE_UNITS = 16;
+    static const GLuint INDEXED_BINDINGS = 8;
+
+    GLStateCounters frame;
+
+    GLuint program;
+    GLuint vertexArray;
+    GLuint pendingVertexArray;
+    GLuint buffers[BUFFER_TARGETS];
+    GLuint uniformBlocks[INDEXED_BINDINGS];
+    GLuint storageBlocks[INDEXED_BINDINGS];
+    GLuint activeUnit;
+    GLuint textures[TEXTURE_UNITS];
+    GLuint depthTest;
+    GLuint blend;
+    GLuint depthMask;
+    GLuint depthFunc;
+    GLuint blendSource;
+    GLuint blendDestination;
+
+    static void ResetCounters(GLStateCounters& counters)
+    {
+        counters.Issued = counters.Suppressed = 0;
+        counters.Draws = counters.Triangles = counters.UniformUploads = 0;
+    }
+
+    void CountDraw(GLenum mode, GLsizei count, GLsizei instances)
+    {
+        ++frame.Draws;
+        if (mode == GL_TRIANGLES)
+            frame.Triangles += unsigned(count / 3) * unsigned(instances);
+        else if (mode == GL_TRIANGLE_STRIP && count > 2)
+            frame.Triangles += unsigned(count - 2) * unsigned(instances);
+    }
+
+    // Stores value and returns true when the call has to reach GL
+    bool Changed(GLuint& cached, GLuint value)
+    {
+        if (cached == value)
+        {
+            ++frame.Suppressed;
+            return false;
+        }
+        cached = value;
+        ++frame.Issued;
+        return true;
+    }
+
+    void Toggle(GLuint& cached, GLenum capability, bool enabled)
+    {
+        if (!Changed(cached, enabled ? 1u : 0u))
+            return;
+        if (enabled)
+            glEnable(capability);
+        else
+            glDisable(capability);
+    }
+
+    // Cached buffer of an indexed block binding, or nullptr for bindings that are not tracked
+    GLuint* IndexedBinding(GLenum target, GLuint index)
+    {
+        if (index >= INDEXED_BINDINGS)
+            return nullptr;
+        if (target == GL_UNIFORM_BUFFER)
+            return &uniformBlocks[index];
+        if (target == GL_SHADER_STORAGE_BUFFER)
+            return &storageBlocks[index];
+        return nullptr;
+    }
+
+    static int BufferSlot(GLenum target)
+    {
+        switch (target)
+        {
+        case GL_ARRAY_BUFFER: return 0;
+        case GL_ELEMENT_ARRAY_BUFFER: return 1;
+        case GL_UNIFORM_BUFFER: return 2;
+        case GL_SHADER_STORAGE_BUFFER: return 3;
+        case GL_DRAW_INDIRECT_BUFFER: return 4;
+        case GL_DISPATCH_INDIRECT_BUFFER: return 5;
+        default: return -1;
+        }
+    }
+};
+#endif
@@ -0,0 +1,292 @@
+/* Frustum and distance culling on the GPU, writing indirect draw commands.
+
+The instances (affine model transform, bounding sphere, mesh) stay in a shader storage
+buffer, uploaded only when they change. Each frame a compute pass tests every
+instance against the frustum planes and a maximum distance, and appends the
+survivors to the visible list of their mesh with an atomic add on the
+instanceCount of that mesh's DrawArraysIndirectCommand. One
+glMultiDrawArraysIndirect then draws them. The CPU does the same few calls per
+frame whatever the number of instances, and never reads the results back.
+
+The vertex shader of the drawing program finds its instance through the
+record attribute AttachRecordAttribute adds to its vertex array (an identity
+buffer read at baseInstance + gl_InstanceID, so no ARB_shader_draw_parameters
+is needed) and the storage blocks bound by Draw:
+
+    layout(location = 2) in uint record;
+    struct CullInstance { vec4 model[3]; vec4 bounds; uvec4 mesh; };
+    layout(std430, binding = 0) readonly buffer Instances { CullInstance instances[]; };
+    layout(std430, binding = 1) readonly buffer Visible { uint visible[]; };
+
+The model is an Affine3x4, the three top rows of the matrix, which keeps an
+instance at 80 bytes instead of 96:
+
+    CullInstance instance = instances[visible[record]];
+    vec4 p = vec4(position, 1.0f);
+    vec3 world = vec3(dot(instance.model[0], p), dot(instance.model[1], p), dot(instance.model[2], p));
+*/
+
+#ifndef GPU_CULLER_H
+#define GPU_CULLER_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <cs330/affine_transform.h>
+#include <cs330/frustum.h>
+#include <cs330/gl_shader.h>
+#include <cs330/gl_state_cache.h>
+
+#include <vector>
+
+#ifndef GLSL
+#define GLSL(Version, Source) "#version " #Version " core \n" #Source
+#endif
+
+// std430 layout of one instance
+struct CullInstance
+{
+    Affine3x4 Model;
+    glm::vec4 Bounds;       // world-space bounding sphere center and radius
+    GLuint Mesh;            // index into the meshes given to SetInstances
+    GLuint Padding[3];
+};
+
+// A mesh of the drawing vertex array
+struct CullMesh
+{
+    GLint First;
+    GLsizei VertexCount;
+};
+
+class GpuCuller
+{
+public:
+    static const GLuint INSTANCE_BINDING = 0;
+    static const GLuint VISIBLE_BINDING = 1;
+
+    GpuCuller() : program(0), instanceBuffer(0), visibleBuffer(0), idBuffer(0), commandBuffer(0), templateBuffer(0),
+        instanceCount(0), commandCount(0), capacity(0) {}
+
+    bool Create()
+    {
+        program = CreateComputeProgram(CullSource(), "CULL");
+        if (program == 0)
+            return false;
+        planesLoc = glGetUniformLocation(program, "planes");
+        cameraLoc = glGetUniformLocation(program, "cameraPosition");
+        distanceLoc = glGetUniformLocation(program, "maxDistance");
+        countLoc = glGetUniformLocation(program, "instanceCount");
+
+        GLuint buffers[5];
+        glGenBuffers(5, buffers);
+        instanceBuffer = buffers[0];
+        visibleBuffer = buffers[1];
+        idBuffer = buffers[2];
+        commandBuffer = buffers[3];
+        templateBuffer = buffers[4];
+        return true;
+    }
+
+    void Release()
+    {
+        glDeleteProgram(program);
+        GLuint buffers[] = { instanceBuffer, visibleBuffer, idBuffer, commandBuffer, templateBuffer };
+        glDeleteBuffers(5, buffers);
+        program = instanceBuffer = visibleBuffer = idBuffer = commandBuffer = templateBuffer = 0;
+        instanceCount = commandCount = 0;
+        capacity = 0;
+    }
+
+    // Feeds the record attribute of a drawing vertex array from the identity buffer
+    void AttachRecordAttribute(GLuint vao, GLuint location)
+    {
+        glBindVertexArray(vao);
+        glBindBuffer(GL_ARRAY_BUFFER, idBuffer);
+        glVertexAttribIPointer(location, 1, GL_UNSIGNED_INT, sizeof(GLuint), (char*)0);
+        glVertexAttribDivisor(location, 1);
+        glEnableVertexAttribArray(location);
+        glBindVertexArray(0);
+    }
+
+    // Uploads the instances and lays out one visible list and one command per mesh.
+    // Instances whose Mesh is not below meshCount are dropped, as the cull shader indexes the commands with it.
+    // Binds buffers directly, so a GLStateCache in use has to be invalidated after it.
+    void SetInstances(const CullInstance* instances, GLuint count, const CullMesh* meshes, int meshCount)
+    {
+        // Each mesh gets room for all of its instances, starting at its baseInstance
+        std::vector<GLuint> perMesh(meshCount, 0);
+        GLuint kept = 0;
+        for (GLuint i = 0; i < count; ++i)
+        {
+            if (instances[i].Mesh < (GLuint)meshCount)
+            {
+                ++perMesh[instances[i].Mesh];
+                ++kept;
+            }
+        }
+
+        std::vector<CullInstance> valid;
+        if (kept < count)
+        {
+            valid.reserve(kept);
+            for (GLuint i = 0; i < count; ++i)
+            {
+                if (instances[i].Mesh < (GLuint)meshCount)
+                    valid.push_back(instances[i]);
+            }
+            instances = valid.empty() ? NULL : &valid[0];
+            count = kept;
+        }
+        instanceCount = count;
+
+        std::vector<DrawArraysIndirectCommand> commands(meshCount);
+        GLuint base = 0;
+        for (int mesh = 0; mesh < meshCount; ++mesh)
+        {
+            DrawArraysIndirectCommand command = { (GLuint)meshes[mesh].VertexCount, 0, (GLuint)meshes[mesh].First, base };
+            commands[mesh] = command;
+            base += perMesh[mesh];
+        }
+        commandCount = meshCount;
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)count * sizeof(CullInstance), instances, GL_STATIC_DRAW);
+
+        // The command template has zero instances; copying it over the commands resets the counters
+        glBindBuffer(GL_COPY_WRITE_BUFFER, templateBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, commands.size() * sizeof(DrawArraysIndirectCommand), commands.empty() ? NULL : &commands[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, commandBuffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, commands.size() * sizeof(DrawArraysIndirectCommand), NULL, GL_DYNAMIC_COPY);
+
+        // Storage grows only
+        if ((GLsizeiptr)count > capacity)
+        {
+            std::vector<GLuint> ids(count);
+            for (GLuint i = 0; i < count; ++i)
+                ids[i] = i;
+            glBindBuffer(GL_ARRAY_BUFFER, idBuffer);
+            glBufferData(GL_ARRAY_BUFFER, count * sizeof(GLuint), &ids[0], GL_STATIC_DRAW);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, visibleBuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, count * sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+            capacity = count;
+        }
+    }
+
+    // Culls every instance and writes the draw commands of the visible ones
+    void Cull(GLStateCache& state, const Frustum& frustum, const glm::vec3& cameraPosition, float maxDistance)
+    {
+        if (instanceCount == 0)
+            return;
+
+        state.BindBuffer(GL_COPY_READ_BUFFER, templateBuffer);
+        state.BindBuffer(GL_COPY_WRITE_BUFFER, commandBuffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, commandCount * sizeof(DrawArraysIndirectCommand));
+
+        state.UseProgram(program);
+        state.Uniform4fv(planesLoc, 6, &frustum.Planes[0][0]);
+        state.Uniform3f(cameraLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
+        state.Uniform1f(distanceLoc, maxDistance);
+        state.Uniform1ui(countLoc, instanceCount);
+        state.BindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_BINDING, instanceBuffer);
+        state.BindBufferBase(GL_SHADER_STORAGE_BUFFER, VISIBLE_BINDING, visibleBuffer);
+        state.BindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMAND_BINDING, commandBuffer);
+        glDispatchCompute((instanceCount + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+
+        // The commands are read as indirect arguments, the visible lists through storage blocks
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    // Draws the visible instances with the current program and the given vertex array
+    void Draw(GLStateCache& state, GLuint vao)
+    {
+        if (instanceCount == 0)
+            return;
+        state.BindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_BINDING, instanceBuffer);
+        state.BindBufferBase(GL_SHADER_STORAGE_BUFFER, VISIBLE_BINDING, visibleBuffer);
+        state.BindVertexArray(vao);
+        state.BindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        // The visible triangle count stays on the GPU
+        state.MultiDrawArraysIndirect(GL_TRIANGLES, (const void*)0, commandCount, 0);
+    }
+
+    GLuint InstanceCount() const { return instanceCount; }
+
+private:
+    static const GLuint COMMAND_BINDING = 2;
+    static const GLuint GROUP_SIZE = 64;
+
+    struct DrawArraysIndirectCommand
+    {
+        GLuint Count;
+        GLuint InstanceCount;
+        GLuint First;
+        GLuint BaseInstance;
+    };
+
+    GLuint program;
+    GLuint instanceBuffer;
+    GLuint visibleBuffer;
+    GLuint idBuffer;
+    GLuint commandBuffer;
+    GLuint templateBuffer;
+    GLint planesLoc, cameraLoc, distanceLoc, countLoc;
+    GLuint instanceCount;
+    GLsizei commandCount;
+    GLsizeiptr capacity;
+
+    static const char* CullSource()
+    {
+        return GLSL(440,
+            layout(local_size_x = 64) in;
+
+            struct CullInstance
+            {
+                vec4 model[3];
+                vec4 bounds;
+                uvec4 mesh;
+            };
+            struct Command
+            {
+                uint count;
+                uint instanceCount;
+                uint first;
+                uint baseInstance;
+            };
+
+            layout(std430, binding = 0) readonly buffer Instances { CullInstance instances[]; };
+            layout(std430, binding = 1) writeonly buffer Visible { uint visible[]; };
+            layout(std430, binding = 2) buffer Commands { Command commands[]; };
+
+            uniform vec4 planes[6];
+            uniform vec3 cameraPosition;
+            uniform float maxDistance;
+            uniform uint instanceCount;
+
+            void main()
+            {
+                uint index = gl_GlobalInvocationID.x;
+                if (index >= instanceCount)
+                    return;
+
+                vec4 bounds = instances[index].bounds;
+                if (distance(bounds.xyz, cameraPosition) - bounds.w > maxDistance)
+                    return;
+                for (int i = 0; i < 6; ++i)
+                {
+                    if (dot(planes[i].xyz, bounds.xyz) + planes[i].w < -bounds.w)
+                        return;
+                }
+
+                // Append to the visible list of the mesh; the command's instance count is the list length
+                uint mesh = instances[index].mesh.x;
+                uint slot = atomicAdd(commands[mesh].instanceCount, 1u);
+                visible[commands[mesh].baseInstance + slot] = index;
+            }
+        );
+    }
+
+    GpuCuller(const GpuCuller&);
+    GpuCuller& operator=(const GpuCuller&);
+};
+#endif
@@ -0,0 +1,293 @@
+/* Input recording and deterministic replay.
+
+InputRecorder logs every GLFW input event and the delta time of every frame to
+a compact binary file. InputReplay reads such a file back and hands out the
+same frame deltas and the same events in the same frame, so a replayed run
+sees exactly the frames the recorded one did, whatever the speed of the
+machine it runs on.
+
+File layout (little-endian, as written on x86):
+
+    "CSIN" | u16 version | u16 reserved | records...
+
+Each record is a one-byte type followed by its payload:
+
+    INPUT_FRAME   f32 delta time in seconds; starts a frame, time is the running sum
+    INPUT_KEY     i16 key, u8 action, u8 mods
+    INPUT_CURSOR  f64 x, f64 y
+    INPUT_SCROLL  f64 x offset, f64 y offset
+    INPUT_BUTTON  u8 button, u8 action, u8 mods
+
+Events that follow a frame record were delivered during that frame.
+*/
+
+#ifndef INPUT_RECORDER_H
+#define INPUT_RECORDER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+enum Input_Record {
+    INPUT_FRAME = 1,
+    INPUT_KEY,
+    INPUT_CURSOR,
+    INPUT_SCROLL,
+    INPUT_BUTTON
+};
+
+// One replayed event; only the fields of its Type are meaningful
+struct InputEvent
+{
+    Input_Record Type;
+    int Code;       // key or mouse button
+    int Action;
+    int Mods;
+    double X;       // cursor position or scroll offset
+    double Y;
+};
+
+class InputRecorder
+{
+public:
+    InputRecorder() : file(nullptr) {}
+    ~InputRecorder() { Close(); }
+
+    // Starts a new recording; returns false if the file cannot be created
+    bool Open(const char* path)
+    {
+        Close();
+        file = std::fopen(path, "wb");
+        if (file == nullptr)
+            return false;
+        buffer.clear();
+        Put(Magic(), 4);
+        PutValue<uint16_t>(VERSION);
+        PutValue<uint16_t>(0);
+        return true;
+    }
+
+    bool IsRecording() const { return file != nullptr; }
+
+    // Flushes and closes the file; returns false if any write failed
+    bool Close()
+    {
+        if (file == nullptr)
+            return true;
+        bool written = Flush();
+        written = std::fclose(file) == 0 && written;
+        file = nullptr;
+        return written;
+    }
+
+    void Frame(float deltaTime)
+    {
+        if (!Begin(INPUT_FRAME))
+            return;
+        PutValue<float>(deltaTime);
+        if (buffer.size() >= FLUSH_SIZE)
+            Flush();
+    }
+
+    void Key(int key, int action, int mods)
+    {
+        if (!Begin(INPUT_KEY))
+            return;
+        PutValue<int16_t>((int16_t)key);
+        PutValue<uint8_t>((uint8_t)action);
+        PutValue<uint8_t>((uint8_t)mods);
+    }
+
+    void Cursor(double x, double y)
+    {
+        if (!Begin(INPUT_CURSOR))
+            return;
+        PutValue<double>(x);
+        PutValue<double>(y);
+    }
+
+    void Scroll(double xoffset, double yoffset)
+    {
+        if (!Begin(INPUT_SCROLL))
+            return;
+        PutValue<double>(xoffset);
+        PutValue<double>(yoffset);
+    }
+
+    void Button(int button, int action, int mods)
+    {
+        if (!Begin(INPUT_BUTTON))
+            return;
+        PutValue<uint8_t>((uint8_t)button);
+        PutValue<uint8_t>((uint8_t)action);
+        PutValue<uint8_t>((uint8_t)mods);
+    }
+
+    static const char* Magic() { return "CSIN"; }
+    static const uint16_t VERSION = 1;
+
+private:
+    static const size_t FLUSH_SIZE = 64 * 1024;
+
+    FILE* file;
+    std::vector<unsigned char> buffer;
+
+    bool Begin(Input_Record type)
+    {
+        if (file == nullptr)
+            return false;
+        PutValue<uint8_t>((uint8_t)type);
+        return true;
+    }
+
+    void Put(const void* data, size_t size)
+    {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        buffer.insert(buffer.end(), bytes, bytes + size);
+    }
+
+    template <typename T>
+    void PutValue(T value) { Put(&value, sizeof(T)); }
+
+    bool Flush()
+    {
+        bool written = buffer.empty() || std::fwrite(&buffer[0], 1, buffer.size(), file) == buffer.size();
+        buffer.clear();
+        return written;
+    }
+
+    InputRecorder(const InputRecorder&);
+    InputRecorder& operator=(const InputRecorder&);
+};
+
+
+class InputReplay
+{
+public:
+    InputReplay() : position(0), frames(0), playing(false) {}
+
+    // Loads a whole recording; returns false if it cannot be read or is not a recording
+    bool Open(const char* path)
+    {
+        playing = false;
+        data.clear();
+
+        FILE* file = std::fopen(path, "rb");
+        if (file == nullptr)
+            return false;
+        unsigned char chunk[64 * 1024];
+        size_t read;
+        while ((read = std::fread(chunk, 1, sizeof(chunk), file)) > 0)
+            data.insert(data.end(), chunk, chunk + read);
+        std::fclose(file);
+
+        uint16_t version = 0;
+        if (data.size() < HEADER_SIZE || std::memcmp(&data[0], InputRecorder::Magic(), 4) != 0)
+            return false;
+        std::memcpy(&version, &data[4], sizeof(version));
+        if (version != InputRecorder::VERSION)
+            return false;
+
+        position = HEADER_SIZE;
+        frames = 0;
+        playing = true;
+        return true;
+    }
+
+    // True from a successful Open until NextFrame finds no more frames
+    bool IsPlaying() const { return playing; }
+
+    // Frames handed out so far
+    unsigned Frames() const { return frames; }
+
+    // Moves to the next frame and returns its delta time; false once the recording is over.
+    // Events of the previous frame that were not read are dropped.
+    bool NextFrame(float& deltaTime)
+    {
+        InputEvent event;
+        while (NextEvent(event))
+        {
+        }
+        if (!playing || position + 1 + sizeof(float) > data.size() || data[position] != INPUT_FRAME)
+        {
+            playing = false;
+            return false;
+        }
+        std::memcpy(&deltaTime, &data[position + 1], sizeof(float));
+        position += 1 + sizeof(float);
+        ++frames;
+        return true;
+    }
+
+    // Hands out the next event of the current frame; false when the frame has no more events
+    bool NextEvent(InputEvent& event)
+    {
+        if (!playing || position >= data.size() || data[position] == INPUT_FRAME)
+            return false;
+
+        std::memset(&event, 0, sizeof(event));
+        event.Type = (Input_Record)data[position];
+        size_t size = PayloadSize(event.Type);
+        if (size == 0 || position + 1 + size > data.size())
+        {
+            // Unknown or truncated record: nothing after it can be trusted
+            position = data.size();
+            return false;
+        }
+        const unsigned char* payload = &data[position + 1];
+
+        switch (event.Type)
+        {
+        case INPUT_KEY:
+        {
+            int16_t key;
+            std::memcpy(&key, payload, sizeof(key));
+            event.Code = key;
+            event.Action = payload[2];
+            event.Mods = payload[3];
+            break;
+        }
+        case INPUT_CURSOR:
+        case INPUT_SCROLL:
+            std::memcpy(&event.X, payload, sizeof(double));
+            std::memcpy(&event.Y, payload + sizeof(double), sizeof(double));
+            break;
+        case INPUT_BUTTON:
+            event.Code = payload[0];
+            event.Action = payload[1];
+            event.Mods = payload[2];
+            break;
+        default:
+            break;
+        }
+
+        position += 1 + size;
+        return true;
+    }
+
+private:
+    static const size_t HEADER_SIZE = 8;
+
+    std::vector<unsigned char> data;
+    size_t position;
+    unsigned frames;
+    bool playing;
+
+    static size_t PayloadSize(Input_Record type)
+    {
+        switch (type)
+        {
+        case INPUT_FRAME: return sizeof(float);
+        case INPUT_KEY: return 4;
+        case INPUT_CURSOR: return 2 * sizeof(double);
+        case INPUT_SCROLL: return 2 * sizeof(double);
+        case INPUT_BUTTON: return 3;
+        default: return 0;
+        }
+    }
+
+    InputReplay(const InputReplay&);
+    InputReplay& operator=(const InputReplay&);
+};
+#endif
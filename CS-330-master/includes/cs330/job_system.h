@@ -0,0 +1,304 @@
+/* Work-stealing job system used to spread per-frame CPU work (matrix building,
+culling, mesh generation) across all cores.
+
+Every worker owns a deque of jobs. A worker pushes and pops at the back of its
+own deque (LIFO, cache friendly) and steals from the front of the other deques
+when it runs out of work. The thread that creates the JobSystem is worker 0 and
+only executes jobs while it waits on a counter, so a JobSystem with one thread
+runs everything inline on the calling thread.
+*/
+
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem;
+
+// Counts the jobs still pending in a group. Jobs can be chained behind a
+// counter with JobSystem::RunAfter and are released once it reaches zero.
+// A counter may only be destroyed after JobSystem::Wait on it returned.
+class JobCounter
+{
+public:
+    JobCounter() : pending(0) {}
+
+    // true when every job attached to this counter has finished
+    bool IsDone() const { return pending.load(std::memory_order_acquire) == 0; }
+
+private:
+    friend class JobSystem;
+
+    struct Continuation
+    {
+        std::function<void()> function;
+        JobCounter* counter;
+    };
+
+    std::atomic<int> pending;
+    std::mutex continuationLock;
+    std::vector<Continuation> continuations;
+
+    JobCounter(const JobCounter&);
+    JobCounter& operator=(const JobCounter&);
+};
+
+
+class JobSystem
+{
+public:
+    typedef std::function<void()> JobFunction;
+
+    // threadCount includes the calling thread; 0 uses every hardware thread
+    explicit JobSystem(unsigned threadCount = 0) : stopping(false), queuedJobs(0)
+    {
+        if (threadCount == 0)
+            threadCount = std::thread::hardware_concurrency();
+        if (threadCount == 0)
+            threadCount = 1;
+
+        queues.resize(threadCount);
+        for (unsigned i = 0; i < threadCount; ++i)
+            queues[i] = new WorkQueue();
+
+        // The creating thread is worker 0
+        CurrentOwner() = this;
+        CurrentIndex() = 0;
+
+        for (unsigned i = 1; i < threadCount; ++i)
+            workers.push_back(std::thread(&JobSystem::WorkerLoop, this, i));
+    }
+
+    ~JobSystem()
+    {
+        {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+
+        for (size_t i = 0; i < workers.size(); ++i)
+            workers[i].join();
+        for (size_t i = 0; i < queues.size(); ++i)
+            delete queues[i];
+
+        if (CurrentOwner() == this)
+            CurrentOwner() = nullptr;
+    }
+
+    // Number of threads executing jobs, including the creating thread
+    unsigned ThreadCount() const { return (unsigned)queues.size(); }
+
+    // Queues a job. When counter is given it is incremented now and decremented once the job finished.
+    void Run(JobFunction job, JobCounter* counter = nullptr)
+    {
+        if (counter)
+            counter->pending.fetch_add(1, std::memory_order_relaxed);
+        Push(Job(job, counter));
+    }
+
+    // Queues a job that only starts once dependency reached zero
+    void RunAfter(JobCounter& dependency, JobFunction job, JobCounter* counter = nullptr)
+    {
+        if (counter)
+            counter->pending.fetch_add(1, std::memory_order_relaxed);
+
+        {
+            std::lock_guard<std::mutex> guard(dependency.continuationLock);
+            if (!dependency.IsDone())
+            {
+                JobCounter::Continuation continuation = { job, counter };
+                dependency.continuations.push_back(continuation);
+                return;
+            }
+        }
+        Push(Job(job, counter));
+    }
+
+    // Executes queued jobs on the calling thread until counter reaches zero
+    void Wait(JobCounter& counter)
+    {
+        unsigned index = ThisWorkerIndex();
+        while (!counter.IsDone())
+        {
+            Job job;
+            if (Pop(index, job) || Steal(index, job))
+                Execute(job);
+            else
+                std::this_thread::yield();
+        }
+
+        // The last job drops the count while holding the lock; once it is released here,
+        // that job no longer touches the counter and the caller may destroy it
+        std::lock_guard<std::mutex> guard(counter.continuationLock);
+    }
+
+    // Calls function(first, last) over [begin, end) split into chunks of at most grain items and waits for all of them
+    template <typename Function>
+    void ParallelFor(int begin, int end, int grain, Function function)
+    {
+        if (end <= begin)
+            return;
+        if (grain < 1)
+            grain = 1;
+
+        // Small ranges are not worth the queueing overhead
+        if (ThreadCount() == 1 || end - begin <= grain)
+        {
+            function(begin, end);
+            return;
+        }
+
+        JobCounter counter;
+        for (int first = begin; first < end; first += grain)
+        {
+            int last = (end - first > grain) ? first + grain : end;
+            Run([=]() { function(first, last); }, &counter);
+        }
+        Wait(counter);
+    }
+
+private:
+    struct Job
+    {
+        Job() : counter(nullptr) {}
+        Job(const JobFunction& function, JobCounter* counter) : function(function), counter(counter) {}
+
+        JobFunction function;
+        JobCounter* counter;
+    };
+
+    // Owner works at the back, thieves take from the front
+    struct WorkQueue
+    {
+        std::mutex lock;
+        std::deque<Job> jobs;
+    };
+
+    std::vector<WorkQueue*> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex sleepLock;
+    std::condition_variable wakeUp;
+    bool stopping;
+    std::atomic<int> queuedJobs;
+
+    static JobSystem*& CurrentOwner()
+    {
+        static thread_local JobSystem* owner = nullptr;
+        return owner;
+    }
+
+    static unsigned& CurrentIndex()
+    {
+        static thread_local unsigned index = 0;
+        return index;
+    }
+
+    // Threads that do not belong to this system share queue 0 with the creating thread
+    unsigned ThisWorkerIndex() const
+    {
+        return CurrentOwner() == this ? CurrentIndex() : 0;
+    }
+
+    void Push(const Job& job)
+    {
+        WorkQueue& queue = *queues[ThisWorkerIndex()];
+        {
+            std::lock_guard<std::mutex> guard(queue.lock);
+            queue.jobs.push_back(job);
+        }
+        queuedJobs.fetch_add(1, std::memory_order_release);
+
+        if (!workers.empty())
+        {
+            std::lock_guard<std::mutex> guard(sleepLock);
+            wakeUp.notify_one();
+        }
+    }
+
+    bool Pop(unsigned index, Job& job)
+    {
+        WorkQueue& queue = *queues[index];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        if (queue.jobs.empty())
+            return false;
+
+        job = queue.jobs.back();
+        queue.jobs.pop_back();
+        queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool Steal(unsigned thief, Job& job)
+    {
+        const unsigned count = (unsigned)queues.size();
+        for (unsigned offset = 1; offset < count; ++offset)
+        {
+            WorkQueue& queue = *queues[(thief + offset) % count];
+            std::lock_guard<std::mutex> guard(queue.lock);
+            if (queue.jobs.empty())
+                continue;
+
+            job = queue.jobs.front();
+            queue.jobs.pop_front();
+            queuedJobs.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    void Execute(Job& job)
+    {
+        job.function();
+
+        JobCounter* counter = job.counter;
+        if (counter == nullptr)
+            return;
+
+        // The decrement and the hand-over of the continuations happen under the lock RunAfter and
+        // Wait take, so a continuation is never missed and Wait cannot return while the counter is in use
+        std::vector<JobCounter::Continuation> released;
+        {
+            std::lock_guard<std::mutex> guard(counter->continuationLock);
+            if (counter->pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                released.swap(counter->continuations);
+        }
+
+        // Last job of the group: release everything that was waiting on it
+        for (size_t i = 0; i < released.size(); ++i)
+            Push(Job(released[i].function, released[i].counter));
+    }
+
+    void WorkerLoop(unsigned index)
+    {
+        CurrentOwner() = this;
+        CurrentIndex() = index;
+
+        for (;;)
+        {
+            Job job;
+            if (Pop(index, job) || Steal(index, job))
+            {
+                Execute(job);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> guard(sleepLock);
+            wakeUp.wait(guard, [this]() { return stopping || queuedJobs.load(std::memory_order_acquire) > 0; });
+            if (stopping)
+                return;
+        }
+    }
+
+    JobSystem(const JobSystem&);
+    JobSystem& operator=(const JobSystem&);
+};
+
+#endif
@@ -0,0 +1,252 @@
+/* Asynchronous logging for the frame loop.
+
+LOG_* formats the message straight into a slot of a bounded lock-free ring
+(Vyukov's queue, one cache line per slot) and returns; a background thread
+drains the ring and does the console I/O, so the frame never waits on the
+terminal. When the ring is full the message is dropped and counted instead of
+blocking the caller.
+
+    LOG_INFO("lamp at %f %f %f", x, y, z);
+    LOG_INFO_EVERY(250, "background %f", r);   // at most once every 250 ms from this line
+
+Levels below CS330_LOG_LEVEL (define it before including this header, default
+LOG_LEVEL_INFO) expand to nothing: their arguments are not even evaluated.
+*/
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <thread>
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO  1
+#define LOG_LEVEL_WARN  2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_NONE  4
+
+#ifndef CS330_LOG_LEVEL
+#define CS330_LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#ifdef __GNUC__
+#define LOG_PRINTF_FORMAT(formatIndex, firstIndex) __attribute__((format(printf, formatIndex, firstIndex)))
+#else
+#define LOG_PRINTF_FORMAT(formatIndex, firstIndex)
+#endif
+
+class Logger
+{
+public:
+    static const size_t MESSAGE_SIZE = 232;
+    static const size_t RING_SIZE = 1024; // power of two
+
+    Logger() : enqueuePosition(0), dequeuePosition(0), dropped(0), running(true)
+    {
+        origin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < RING_SIZE; ++i)
+            ring[i].Sequence.store(i, std::memory_order_relaxed);
+        writer = std::thread(&Logger::WriterLoop, this);
+    }
+
+    // Stops the writer thread after it printed everything queued
+    ~Logger()
+    {
+        running.store(false, std::memory_order_release);
+        writer.join();
+    }
+
+    // Queues a message; suppressed is the number of messages a rate limit dropped since the last one
+    void Write(int level, unsigned suppressed, const char* format, ...) LOG_PRINTF_FORMAT(4, 5)
+    {
+        size_t position = enqueuePosition.load(std::memory_order_relaxed);
+        Slot* slot;
+        for (;;)
+        {
+            slot = &ring[position & (RING_SIZE - 1)];
+            size_t sequence = slot->Sequence.load(std::memory_order_acquire);
+            intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+            if (difference == 0)
+            {
+                if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (difference < 0)
+            {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            else
+                position = enqueuePosition.load(std::memory_order_relaxed);
+        }
+
+        slot->Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - origin).count();
+        slot->Level = level;
+        slot->Suppressed = suppressed;
+        va_list arguments;
+        va_start(arguments, format);
+        std::vsnprintf(slot->Text, MESSAGE_SIZE, format, arguments);
+        va_end(arguments);
+
+        slot->Sequence.store(position + 1, std::memory_order_release);
+    }
+
+    // Messages lost because the ring was full
+    unsigned Dropped() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    struct alignas(64) Slot
+    {
+        std::atomic<size_t> Sequence;
+        double Seconds;
+        int Level;
+        unsigned Suppressed;
+        char Text[MESSAGE_SIZE];
+    };
+
+    Slot ring[RING_SIZE];
+    alignas(64) std::atomic<size_t> enqueuePosition;
+    alignas(64) size_t dequeuePosition; // writer thread only
+    std::atomic<unsigned> dropped;
+    std::atomic<bool> running;
+    std::chrono::steady_clock::time_point origin;
+    std::thread writer;
+
+    void WriterLoop()
+    {
+        unsigned reportedDrops = 0;
+        for (;;)
+        {
+            // Read the flag first so nothing queued before the destructor ran is left behind
+            bool stopping = !running.load(std::memory_order_acquire);
+            bool wrote = false;
+            while (WriteNext())
+                wrote = true;
+
+            unsigned drops = dropped.load(std::memory_order_relaxed);
+            if (drops != reportedDrops)
+            {
+                std::fprintf(stderr, "[log] %u messages dropped, the ring was full\n", drops - reportedDrops);
+                reportedDrops = drops;
+                wrote = true;
+            }
+            if (wrote)
+            {
+                std::fflush(stdout);
+                std::fflush(stderr);
+            }
+            if (stopping)
+                return;
+            if (!wrote)
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    }
+
+    // Prints the oldest message; false when the ring is empty
+    bool WriteNext()
+    {
+        Slot& slot = ring[dequeuePosition & (RING_SIZE - 1)];
+        if (slot.Sequence.load(std::memory_order_acquire) != dequeuePosition + 1)
+            return false;
+
+        static const char* const names[] = { "DEBUG", "INFO", "WARN", "ERROR" };
+        const char* name = slot.Level >= LOG_LEVEL_DEBUG && slot.Level <= LOG_LEVEL_ERROR ? names[slot.Level] : "?";
+        FILE* stream = slot.Level >= LOG_LEVEL_WARN ? stderr : stdout;
+        if (slot.Suppressed > 0)
+            std::fprintf(stream, "[%9.3f] %-5s %s (%u similar suppressed)\n", slot.Seconds, name, slot.Text, slot.Suppressed);
+        else
+            std::fprintf(stream, "[%9.3f] %-5s %s\n", slot.Seconds, name, slot.Text);
+
+        slot.Sequence.store(dequeuePosition + RING_SIZE, std::memory_order_release);
+        ++dequeuePosition;
+        return true;
+    }
+
+    Logger(const Logger&);
+    Logger& operator=(const Logger&);
+};
+
+// The process-wide logger, started on first use
+inline Logger& Log()
+{
+    static Logger logger;
+    return logger;
+}
+
+
+// Lets one message through per interval; each LOG_*_EVERY line owns one
+class LogRateLimit
+{
+public:
+    explicit LogRateLimit(double intervalMs) : interval((int64_t)(intervalMs * 1.0e6)), next(0), suppressed(0) {}
+
+    // true when the message may be written; suppressed receives the count dropped since the last one
+    bool Allow(unsigned& suppressedSince)
+    {
+        int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        int64_t due = next.load(std::memory_order_relaxed);
+        if (now < due || !next.compare_exchange_strong(due, now + interval, std::memory_order_relaxed))
+        {
+            suppressed.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        suppressedSince = suppressed.exchange(0, std::memory_order_relaxed);
+        return true;
+    }
+
+private:
+    int64_t interval;
+    std::atomic<int64_t> next;
+    std::atomic<unsigned> suppressed;
+};
+
+
+#define LOG_AT(level, ...) Log().Write(level, 0, __VA_ARGS__)
+
+#define LOG_AT_EVERY(level, intervalMs, ...) \
+    do { \
+        static LogRateLimit logRateLimit_(intervalMs); \
+        unsigned logSuppressed_ = 0; \
+        if (logRateLimit_.Allow(logSuppressed_)) \
+            Log().Write(level, logSuppressed_, __VA_ARGS__); \
+    } while (0)
+
+#define LOG_DISABLED() do { } while (0)
+
+#if CS330_LOG_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_DEBUG_EVERY(intervalMs, ...) LOG_AT_EVERY(LOG_LEVEL_DEBUG, intervalMs, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) LOG_DISABLED()
+#define LOG_DEBUG_EVERY(intervalMs, ...) LOG_DISABLED()
+#endif
+
+#if CS330_LOG_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_INFO_EVERY(intervalMs, ...) LOG_AT_EVERY(LOG_LEVEL_INFO, intervalMs, __VA_ARGS__)
+#else
+#define LOG_INFO(...) LOG_DISABLED()
+#define LOG_INFO_EVERY(intervalMs, ...) LOG_DISABLED()
+#endif
+
+#if CS330_LOG_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_WARN_EVERY(intervalMs, ...) LOG_AT_EVERY(LOG_LEVEL_WARN, intervalMs, __VA_ARGS__)
+#else
+#define LOG_WARN(...) LOG_DISABLED()
+#define LOG_WARN_EVERY(intervalMs, ...) LOG_DISABLED()
+#endif
+
+#if CS330_LOG_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_ERROR_EVERY(intervalMs, ...) LOG_AT_EVERY(LOG_LEVEL_ERROR, intervalMs, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) LOG_DISABLED()
+#define LOG_ERROR_EVERY(intervalMs, ...) LOG_DISABLED()
+#endif
+
+#endif
@@ -0,0 +1,666 @@
+/* Batch matrix kernels: TRS composition, a matrix times many, and normal matrices, over arrays.
+
+glm computes one matrix at a time, with scalar code unless GLM_FORCE_INTRINSICS
+is defined, which the builds do not do. MatrixBatch takes whole arrays and picks
+the widest instruction set the CPU has when it is created: SSE4.1, AVX2 with FMA,
+or AVX-512. The kernels are compiled for each set with target attributes, so the
+program runs on any x86-64 CPU whatever flags it is built with.
+
+ComposeTRS builds translation * rotation * scale, the matrix SceneGraph and
+EntityStore compute, from positions, unit quaternions and scales. It works on
+4, 8 or 16 transforms at once, one per SIMD lane: the inputs are transposed into
+lanes, the rotation terms are computed for all lanes together, and the results
+are transposed back into columns. It writes mat4 or Affine3x4, the top three
+rows of the matrix, which is all an affine transform needs.
+
+Multiply computes left * right[i], for instance view-projection times models.
+Each column of the result is a sum of the left columns weighted by the elements
+of the right column; AVX2 computes two columns at once and AVX-512 all four.
+
+NormalMatrices computes transpose(inverse(mat3(model))), the matrix normals
+are transformed with. Its columns are the cross products of the model's columns
+divided by the determinant. SSE4.1 handles one matrix per iteration, AVX2 two
+and AVX-512 four.
+
+Counts that are not a multiple of the lane count finish with the scalar glm code.
+*/
+
+#ifndef MATRIX_BATCH_H
+#define MATRIX_BATCH_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cs330/affine_transform.h>
+
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include <cstddef>
+
+#if defined(__GNUC__)
+#define MATRIX_BATCH_TARGET(isa) __attribute__((target(isa)))
+#else
+#define MATRIX_BATCH_TARGET(isa)
+#endif
+
+class MatrixBatch
+{
+public:
+    enum Level { LEVEL_SCALAR, LEVEL_SSE4, LEVEL_AVX2, LEVEL_AVX512 };
+
+    // Uses the widest instruction set the CPU supports, up to maxLevel
+    explicit MatrixBatch(Level maxLevel = LEVEL_AVX512)
+    {
+        Level detected = Detect();
+        level = detected < maxLevel ? detected : maxLevel;
+    }
+
+    Level ActiveLevel() const { return level; }
+
+    static const char* LevelName(Level level)
+    {
+        static const char* const NAMES[] = { "scalar", "SSE4.1", "AVX2", "AVX-512" };
+        return NAMES[level];
+    }
+
+    // Widest instruction set the CPU and the OS support
+    static Level Detect()
+    {
+#if defined(__GNUC__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+            return LEVEL_AVX512;
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+            return LEVEL_AVX2;
+        if (__builtin_cpu_supports("sse4.1"))
+            return LEVEL_SSE4;
+#elif defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 1);
+        const bool sse41 = (info[2] & (1 << 19)) != 0;
+        const bool fma = (info[2] & (1 << 12)) != 0;
+        // AVX state enabled by the OS (XSAVE in use, YMM saved), and for AVX-512 the opmask and ZMM state too
+        const bool osAvx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 0x06) == 0x06;
+        const bool osAvx512 = osAvx && (_xgetbv(0) & 0xE6) == 0xE6;
+        __cpuidex(info, 7, 0);
+        if (osAvx512 && (info[1] & (1 << 16)) != 0)
+            return LEVEL_AVX512;
+        if (osAvx && fma && (info[1] & (1 << 5)) != 0)
+            return LEVEL_AVX2;
+        if (sse41)
+            return LEVEL_SSE4;
+#endif
+        return LEVEL_SCALAR;
+    }
+
+    // out[i] = translate(positions[i]) * mat4_cast(rotations[i]) * scale(scales[i])
+    void ComposeTRS(const glm::vec3* positions, const glm::quat* rotations, const glm::vec3* scales, glm::mat4* out, size_t count) const
+    {
+        if (count == 0)
+            return;
+        size_t done = 0;
+        if (level == LEVEL_AVX512)
+            done = ComposeAvx512(positions, rotations, scales, &out[0][0][0], NULL, count);
+        else if (level == LEVEL_AVX2)
+            done = ComposeAvx2(positions, rotations, scales, &out[0][0][0], NULL, count);
+        else if (level == LEVEL_SSE4)
+            done = ComposeSse4(positions, rotations, scales, &out[0][0][0], NULL, count);
+        for (size_t i = done; i < count; ++i)
+            out[i] = ComposeScalar(positions[i], rotations[i], scales[i]);
+    }
+
+    // The same matrices as affine rows
+    void ComposeTRS(const glm::vec3* positions, const glm::quat* rotations, const glm::vec3* scales, Affine3x4* out, size_t count) const
+    {
+        if (count == 0)
+            return;
+        size_t done = 0;
+        if (level == LEVEL_AVX512)
+            done = ComposeAvx512(positions, rotations, scales, NULL, &out[0].Rows[0][0], count);
+        else if (level == LEVEL_AVX2)
+            done = ComposeAvx2(positions, rotations, scales, NULL, &out[0].Rows[0][0], count);
+        else if (level == LEVEL_SSE4)
+            done = ComposeSse4(positions, rotations, scales, NULL, &out[0].Rows[0][0], count);
+        for (size_t i = done; i < count; ++i)
+            out[i] = Affine3x4::FromTRS(positions[i], rotations[i], scales[i]);
+    }
+
+    // out[i] = left * right[i]; out may be right
+    void Multiply(const glm::mat4& left, const glm::mat4* right, glm::mat4* out, size_t count) const
+    {
+        if (count == 0)
+            return;
+        if (level == LEVEL_AVX512)
+            MultiplyAvx512(&left[0][0], &right[0][0][0], &out[0][0][0], count);
+        else if (level == LEVEL_AVX2)
+            MultiplyAvx2(&left[0][0], &right[0][0][0], &out[0][0][0], count);
+        else if (level == LEVEL_SSE4)
+            MultiplySse4(&left[0][0], &right[0][0][0], &out[0][0][0], count);
+        else
+        {
+            for (size_t i = 0; i < count; ++i)
+                out[i] = left * right[i];
+        }
+    }
+
+    // out[i] = transpose(inverse(mat3(models[i])))
+    void NormalMatrices(const glm::mat4* models, glm::mat3* out, size_t count) const
+    {
+        if (count == 0)
+            return;
+        size_t done = 0;
+        if (level == LEVEL_AVX512)
+            done = NormalAvx512(&models[0][0][0], &out[0][0][0], count);
+        else if (level == LEVEL_AVX2)
+            done = NormalAvx2(&models[0][0][0], &out[0][0][0], count);
+        else if (level == LEVEL_SSE4)
+            done = NormalSse4(&models[0][0][0], &out[0][0][0], count);
+        for (size_t i = done; i < count; ++i)
+            out[i] = glm::transpose(glm::inverse(glm::mat3(models[i])));
+    }
+
+    // The glm code the kernels replace
+    static glm::mat4 ComposeScalar(const glm::vec3& position, const glm::quat& rotation, const glm::vec3& scale)
+    {
+        glm::mat4 model = glm::mat4_cast(rotation);
+        model[0] *= scale.x;
+        model[1] *= scale.y;
+        model[2] *= scale.z;
+        model[3] = glm::vec4(position, 1.0f);
+        return model;
+    }
+
+private:
+    Level level;
+
+    // SSE4.1: 4 transforms per iteration, one per lane
+
+    MATRIX_BATCH_TARGET("sse4.1")
+    static inline __m128 Load3Sse4(const float* p)
+    {
+        // Two loads, so the last vec3 of an array is not read past its end
+        return _mm_movelh_ps(_mm_castpd_ps(_mm_load_sd((const double*)p)), _mm_load_ss(p + 2));
+    }
+
+    MATRIX_BATCH_TARGET("sse4.1")
+    static inline void Transpose4Sse4(__m128& r0, __m128& r1, __m128& r2, __m128& r3)
+    {
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+    }
+
+    // Writes lane k of the four vectors as the 4 floats at out + k * stride
+    MATRIX_BATCH_TARGET("sse4.1")
+    static inline void StoreLanesSse4(float* out, size_t stride, __m128 r0, __m128 r1, __m128 r2, __m128 r3)
+    {
+        Transpose4Sse4(r0, r1, r2, r3);
+        _mm_storeu_ps(out, r0);
+        _mm_storeu_ps(out + stride, r1);
+        _mm_storeu_ps(out + 2 * stride, r2);
+        _mm_storeu_ps(out + 3 * stride, r3);
+    }
+
+    MATRIX_BATCH_TARGET("sse4.1")
+    static size_t ComposeSse4(const glm::vec3* positions, const glm::quat* rotations, const glm::vec3* scales, float* matrices, float* affines, size_t count)
+    {
+        const __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f), zero = _mm_setzero_ps();
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 x = _mm_loadu_ps(&rotations[i].x), y = _mm_loadu_ps(&rotations[i + 1].x);
+            __m128 z = _mm_loadu_ps(&rotations[i + 2].x), w = _mm_loadu_ps(&rotations[i + 3].x);
+            Transpose4Sse4(x, y, z, w);
+            __m128 px = Load3Sse4(&positions[i].x), py = Load3Sse4(&positions[i + 1].x);
+            __m128 pz = Load3Sse4(&positions[i + 2].x), pw = Load3Sse4(&positions[i + 3].x);
+            Transpose4Sse4(px, py, pz, pw);
+            __m128 sx = Load3Sse4(&scales[i].x), sy = Load3Sse4(&scales[i + 1].x);
+            __m128 sz = Load3Sse4(&scales[i + 2].x), sw = Load3Sse4(&scales[i + 3].x);
+            Transpose4Sse4(sx, sy, sz, sw);
+
+            // Doubled products, as in mat3_cast
+            __m128 x2 = _mm_mul_ps(x, two), y2 = _mm_mul_ps(y, two), z2 = _mm_mul_ps(z, two);
+            __m128 xx = _mm_mul_ps(x, x2), yy = _mm_mul_ps(y, y2), zz = _mm_mul_ps(z, z2);
+            __m128 xy = _mm_mul_ps(x, y2), xz = _mm_mul_ps(x, z2), yz = _mm_mul_ps(y, z2);
+            __m128 wx = _mm_mul_ps(w, x2), wy = _mm_mul_ps(w, y2), wz = _mm_mul_ps(w, z2);
+
+            // mCR: column C, row R
+            __m128 m00 = _mm_mul_ps(sx, _mm_sub_ps(one, _mm_add_ps(yy, zz)));
+            __m128 m01 = _mm_mul_ps(sx, _mm_add_ps(xy, wz));
+            __m128 m02 = _mm_mul_ps(sx, _mm_sub_ps(xz, wy));
+            __m128 m10 = _mm_mul_ps(sy, _mm_sub_ps(xy, wz));
+            __m128 m11 = _mm_mul_ps(sy, _mm_sub_ps(one, _mm_add_ps(xx, zz)));
+            __m128 m12 = _mm_mul_ps(sy, _mm_add_ps(yz, wx));
+            __m128 m20 = _mm_mul_ps(sz, _mm_add_ps(xz, wy));
+            __m128 m21 = _mm_mul_ps(sz, _mm_sub_ps(yz, wx));
+            __m128 m22 = _mm_mul_ps(sz, _mm_sub_ps(one, _mm_add_ps(xx, yy)));
+
+            if (matrices != NULL)
+            {
+                float* out = matrices + i * 16;
+                StoreLanesSse4(out, 16, m00, m01, m02, zero);
+                StoreLanesSse4(out + 4, 16, m10, m11, m12, zero);
+                StoreLanesSse4(out + 8, 16, m20, m21, m22, zero);
+                StoreLanesSse4(out + 12, 16, px, py, pz, one);
+            }
+            else
+            {
+                float* out = affines + i * 12;
+                StoreLanesSse4(out, 12, m00, m10, m20, px);
+                StoreLanesSse4(out + 4, 12, m01, m11, m21, py);
+                StoreLanesSse4(out + 8, 12, m02, m12, m22, pz);
+            }
+        }
+        return i;
+    }
+
+    MATRIX_BATCH_TARGET("sse4.1")
+    static void MultiplySse4(const float* left, const float* right, float* out, size_t count)
+    {
+        const __m128 l0 = _mm_loadu_ps(left), l1 = _mm_loadu_ps(left + 4), l2 = _mm_loadu_ps(left + 8), l3 = _mm_loadu_ps(left + 12);
+        for (size_t i = 0; i < count * 16; i += 16)
+        {
+            // All four columns are read before any is written, so out may alias right
+            __m128 r[4];
+            for (int column = 0; column < 4; ++column)
+                r[column] = _mm_loadu_ps(right + i + column * 4);
+            for (int column = 0; column < 4; ++column)
+            {
+                __m128 sum = _mm_mul_ps(l0, _mm_shuffle_ps(r[column], r[column], 0x00));
+                sum = _mm_add_ps(sum, _mm_mul_ps(l1, _mm_shuffle_ps(r[column], r[column], 0x55)));
+                sum = _mm_add_ps(sum, _mm_mul_ps(l2, _mm_shuffle_ps(r[column], r[column], 0xAA)));
+                sum = _mm_add_ps(sum, _mm_mul_ps(l3, _mm_shuffle_ps(r[column], r[column], 0xFF)));
+                _mm_storeu_ps(out + i + column * 4, sum);
+            }
+        }
+    }
+
+    // (u.y v.z - u.z v.y, u.z v.x - u.x v.z, u.x v.y - u.y v.x), computed from the yzx rotations of u and v
+    MATRIX_BATCH_TARGET("sse4.1")
+    static inline __m128 CrossSse4(__m128 u, __m128 v)
+    {
+        __m128 uYzx = _mm_shuffle_ps(u, u, _MM_SHUFFLE(3, 0, 2, 1));
+        __m128 vYzx = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 2, 1));
+        __m128 c = _mm_sub_ps(_mm_mul_ps(u, vYzx), _mm_mul_ps(uYzx, v));
+        return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+    }
+
+    MATRIX_BATCH_TARGET("sse4.1")
+    static size_t NormalSse4(const float* models, float* out, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            const float* model = models + i * 16;
+            __m128 a = _mm_loadu_ps(model), b = _mm_loadu_ps(model + 4), c = _mm_loadu_ps(model + 8);
+            __m128 c0 = CrossSse4(b, c), c1 = CrossSse4(c, a), c2 = CrossSse4(a, b);
+            __m128 inverse = _mm_div_ps(_mm_set1_ps(1.0f), _mm_dp_ps(a, c0, 0x7F));
+
+            // 9 floats: the first two stores spill one float into the next column, which the next store overwrites
+            float* normal = out + i * 9;
+            _mm_storeu_ps(normal, _mm_mul_ps(c0, inverse));
+            _mm_storeu_ps(normal + 3, _mm_mul_ps(c1, inverse));
+            StoreLast3(normal + 6, _mm_mul_ps(c2, inverse));
+        }
+        return count;
+    }
+
+    // AVX2: 8 transforms per iteration; the low 128 bits hold transforms i..i+3 and the high ones i+4..i+7,
+    // so the SSE transposes work within each half
+
+    MATRIX_BATCH_TARGET("avx2,fma")
+    static inline __m256 Load2Avx2(__m128 low, __m128 high)
+    {
+        return _mm256_insertf128_ps(_mm256_castps128_ps256(low), high, 1);
+    }
+
+    MATRIX_BATCH_TARGET("avx2,fma")
+    static inline void Transpose4Avx2(__m256& r0, __m256& r1, __m256& r2, __m256& r3)
+    {
+        __m256 t0 = _mm256_unpacklo_ps(r0, r1), t1 = _mm256_unpacklo_ps(r2, r3);
+        __m256 t2 = _mm256_unpackhi_ps(r0, r1), t3 = _mm256_unpackhi_ps(r2, r3);
+        r0 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+        r1 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+        r2 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+        r3 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+    }
+
+    // Loads 4 floats of transforms i..i+7 at stride floats apart into the lanes of four vectors
+    MATRIX_BATCH_TARGET("avx2,fma")
+    static inline void LoadLanesAvx2(const float* in, size_t stride, __m256& r0, __m256& r1, __m256& r2, __m256& r3)
+    {
+        r0 = Load2Avx2(_mm_loadu_ps(in), _mm_loadu_ps(in + 4 * stride));
+        r1 = Load2Avx2(_mm_loadu_ps(in + stride), _mm_loadu_ps(in + 5 * stride));
+        r2 = Load2Avx2(_mm_loadu_ps(in + 2 * stride), _mm_loadu_ps(in + 6 * stride));
+        r3 = Load2Avx2(_mm_loadu_ps(in + 3 * stride), _mm_loadu_ps(in + 7 * stride));
+        Transpose4Avx2(r0, r1, r2, r3);
+    }
+
+    MATRIX_BATCH_TARGET("avx2,fma")
+    static inline void LoadVec3LanesAvx2(const glm::vec3* in, __m256& x, __m256& y, __m256& z)
+    {
+        __m256 w;
+        x = Load2Avx2(Load3Sse4(&in[0].x), Load3Sse4(&in[4].x));
+        y = Load2Avx2(Load3Sse4(&in[1].x), Load3Sse4(&in[5].x));
+        z = Load2Avx2(Load3Sse4(&in[2].x), Load3Sse4(&in[6].x));
+        w = Load2Avx2(Load3Sse4(&in[3].x), Load3Sse4(&in[7].x));
+        Transpose4Avx2(x, y, z, w);
+    }
+
+    MATRIX_BATCH_TARGET("avx2,fma")
+    static inline void StoreLanesAvx2(float* out, size_t stride, __m256 r0, __m256 r1, __m256 r2, __m256 r3)
+    {
+        Transpose4Avx2(r0, r1, r2, r3);
+        _mm_storeu_ps(out, _mm256_castps256_ps128(r0));
+        _mm_storeu_ps(out + stride, _mm256_castps256_ps128(r1));
+        _mm_storeu_ps(out + 2 * stride, _mm256_castps256_ps128(r2));
+        _mm_storeu_ps(out + 3 * stride, _mm256_castps256_ps128(r3));
+        _mm_storeu_ps(out + 4 * stride, _mm256_extractf128_ps(r0, 1));
+        _mm_storeu_ps(out + 5 * stride, _mm256_extractf128_ps(r1, 1));
+        _mm_storeu_ps(out + 6 * stride, _mm256_extractf128_ps(r2, 1));
+        _mm_storeu_ps(out + 7 * stride, _mm256_extractf128_ps(r3, 1));
+    }
+
+    MATRIX_BATCH_TARGET("avx2,fma")
+    static size_t ComposeAvx2(const glm::vec3* positions, const glm::quat* rotations, const glm::vec3* scales, float* matrices, float* affines, size_t count)
+    {
+        const __m256 one = _mm256_set1_ps(1.0f), two = _mm256_set1_ps(2.0f), zero = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 x, y, z, w, px, py, pz, sx, sy, sz;
+            LoadLanesAvx2(&rotations[i].x, 4, x, y, z, w);
+            LoadVec3LanesAvx2(positions + i, px, py, pz);
+            LoadVec3LanesAvx2(scales + i, sx, sy, sz);
+
+            __m256 x2 = _mm256_mul_ps(x, two), y2 = _mm256_mul_ps(y, two), z2 = _mm256_mul_ps(z, two);
+            __m256 xx = _mm256_mul_ps(x, x2), yy = _mm256_mul_ps(y, y2), zz = _mm256_mul_ps(z, z2);
+            __m256 xy = _mm256_mul_ps(x, y2), xz = _mm256_mul_ps(x, z2), yz = _mm256_mul_ps(y, z2);
+            __m256 wx = _mm256_mul_ps(w, x2), wy = _mm256_mul_ps(w, y2), wz = _mm256_mul_ps(w, z2);
+
+            __m256 m00 = _mm256_mul_ps(sx, _mm256_sub_ps(one, _mm256_add_ps(yy, zz)));
+            __m256 m01 = _mm256_mul_ps(sx, _mm256_add_ps(xy, wz));
+            __m256 m02 = _mm256_mul_ps(sx, _mm256_sub_ps(xz, wy));
+            __m256 m10 = _mm256_mul_ps(sy, _mm256_sub_ps(xy, wz));
+            __m256 m11 = _mm256_mul_ps(sy, _mm256_sub_ps(one, _mm256_add_ps(xx, zz)));
+            __m256 m12 = _mm256_mul_ps(sy, _mm256_add_ps(yz, wx));
+            __m256 m20 = _mm256_mul_ps(sz, _mm256_add_ps(xz, wy));
+            __m256 m21 = _mm256_mul_ps(sz, _mm256_sub_ps(yz, wx));
+            __m256 m22 = _mm256_mul_ps(sz, _mm256_sub_ps(one, _mm256_add_ps(xx, yy)));
+
+            if (matrices != NULL)
+            {
+                float* out = matrices + i * 16;
+                StoreLanesAvx2(out, 16, m00, m01, m02, zero);
+                StoreLanesAvx2(out + 4, 16, m10, m11, m12, zero);
+                StoreLanesAvx2(out + 8, 16, m20, m21, m22, zero);
+                StoreLanesAvx2(out + 12, 16, px, py, pz, one);
+            }
+            else
+            {
+                float* out = affines + i * 12;
+                StoreLanesAvx2(out, 12, m00, m10, m20, px);
+                StoreLanesAvx2(out + 4, 12, m01, m11, m21, py);
+                StoreLanesAvx2(out + 8, 12, m02, m12, m22, pz);
+            }
+        }
+        return i;
+    }
+
+    MATRIX_BATCH_TARGET("avx2,fma")
+    static void MultiplyAvx2(const float* left, const float* right, float* out, size_t count)
+    {
+        // Each left column in both halves; a right vector holds two columns, one per half
+        const __m256 l0 = _mm256_broadcast_ps((const __m128*)left), l1 = _mm256_broadcast_ps((const __m128*)(left + 4));
+        const __m256 l2 = _mm256_broadcast_ps((const __m128*)(left + 8)), l3 = _mm256_broadcast_ps((const __m128*)(left + 12));
+        for (size_t i = 0; i < count * 16; i += 16)
+        {
+            __m256 r01 = _mm256_loadu_ps(right + i), r23 = _mm256_loadu_ps(right + i + 8);
+            __m256 o01 = _mm256_mul_ps(l0, _mm256_permute_ps(r01, 0x00));
+            __m256 o23 = _mm256_mul_ps(l0, _mm256_permute_ps(r23, 0x00));
+            o01 = _mm256_fmadd_ps(l1, _mm256_permute_ps(r01, 0x55), o01);
+            o23 = _mm256_fmadd_ps(l1, _mm256_permute_ps(r23, 0x55), o23);
+            o01 = _mm256_fmadd_ps(l2, _mm256_permute_ps(r01, 0xAA), o01);
+            o23 = _mm256_fmadd_ps(l2, _mm256_permute_ps(r23, 0xAA), o23);
+            o01 = _mm256_fmadd_ps(l3, _mm256_permute_ps(r01, 0xFF), o01);
+            o23 = _mm256_fmadd_ps(l3, _mm256_permute_ps(r23, 0xFF), o23);
+            _mm256_storeu_ps(out + i, o01);
+            _mm256_storeu_ps(out + i + 8, o23);
+        }
+    }
+
+    MATRIX_BATCH_TARGET("avx2,fma")
+    static inline __m256 CrossAvx2(__m256 u, __m256 v)
+    {
+        __m256 uYzx = _mm256_permute_ps(u, _MM_SHUFFLE(3, 0, 2, 1));
+        __m256 vYzx = _mm256_permute_ps(v, _MM_SHUFFLE(3, 0, 2, 1));
+        __m256 c = _mm256_fmsub_ps(u, vYzx, _mm256_mul_ps(uYzx, v));
+        return _mm256_permute_ps(c, _MM_SHUFFLE(3, 0, 2, 1));
+    }
+
+    // Two matrices per iteration, one per half
+    MATRIX_BATCH_TARGET("avx2,fma")
+    static size_t NormalAvx2(const float* models, float* out, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 2 <= count; i += 2)
+        {
+            const float* model = models + i * 16;
+            __m256 a = Load2Avx2(_mm_loadu_ps(model), _mm_loadu_ps(model + 16));
+            __m256 b = Load2Avx2(_mm_loadu_ps(model + 4), _mm_loadu_ps(model + 20));
+            __m256 c = Load2Avx2(_mm_loadu_ps(model + 8), _mm_loadu_ps(model + 24));
+            __m256 c0 = CrossAvx2(b, c), c1 = CrossAvx2(c, a), c2 = CrossAvx2(a, b);
+            __m256 inverse = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_dp_ps(a, c0, 0x7F));
+            c0 = _mm256_mul_ps(c0, inverse);
+            c1 = _mm256_mul_ps(c1, inverse);
+            c2 = _mm256_mul_ps(c2, inverse);
+
+            // Both matrices are written in order, so each spilled float is overwritten by the next store
+            for (int half = 0; half < 2; ++half)
+            {
+                float* normal = out + (i + half) * 9;
+                _mm_storeu_ps(normal, half == 0 ? _mm256_castps256_ps128(c0) : _mm256_extractf128_ps(c0, 1));
+                _mm_storeu_ps(normal + 3, half == 0 ? _mm256_castps256_ps128(c1) : _mm256_extractf128_ps(c1, 1));
+                StoreLast3(normal + 6, half == 0 ? _mm256_castps256_ps128(c2) : _mm256_extractf128_ps(c2, 1));
+            }
+        }
+        return i;
+    }
+
+    // AVX-512: 16 transforms per iteration, four per 128-bit lane as with AVX2.
+    // GCC 12 warns that the _mm512_undefined_ps inside its own intrinsics is uninitialized.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+    MATRIX_BATCH_TARGET("avx512f")
+    static inline __m512 Load4Avx512(__m128 r0, __m128 r1, __m128 r2, __m128 r3)
+    {
+        __m512 v = _mm512_castps128_ps512(r0);
+        v = _mm512_insertf32x4(v, r1, 1);
+        v = _mm512_insertf32x4(v, r2, 2);
+        return _mm512_insertf32x4(v, r3, 3);
+    }
+
+    MATRIX_BATCH_TARGET("avx512f")
+    static inline void Transpose4Avx512(__m512& r0, __m512& r1, __m512& r2, __m512& r3)
+    {
+        __m512 t0 = _mm512_unpacklo_ps(r0, r1), t1 = _mm512_unpacklo_ps(r2, r3);
+        __m512 t2 = _mm512_unpackhi_ps(r0, r1), t3 = _mm512_unpackhi_ps(r2, r3);
+        r0 = _mm512_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+        r1 = _mm512_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+        r2 = _mm512_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+        r3 = _mm512_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+    }
+
+    // Lane j of the 128-bit lanes holds transforms i + 4j .. i + 4j + 3
+    MATRIX_BATCH_TARGET("avx512f")
+    static inline void LoadLanesAvx512(const float* in, size_t stride, __m512& r0, __m512& r1, __m512& r2, __m512& r3)
+    {
+        r0 = Load4Avx512(_mm_loadu_ps(in), _mm_loadu_ps(in + 4 * stride), _mm_loadu_ps(in + 8 * stride), _mm_loadu_ps(in + 12 * stride));
+        r1 = Load4Avx512(_mm_loadu_ps(in + stride), _mm_loadu_ps(in + 5 * stride), _mm_loadu_ps(in + 9 * stride), _mm_loadu_ps(in + 13 * stride));
+        r2 = Load4Avx512(_mm_loadu_ps(in + 2 * stride), _mm_loadu_ps(in + 6 * stride), _mm_loadu_ps(in + 10 * stride), _mm_loadu_ps(in + 14 * stride));
+        r3 = Load4Avx512(_mm_loadu_ps(in + 3 * stride), _mm_loadu_ps(in + 7 * stride), _mm_loadu_ps(in + 11 * stride), _mm_loadu_ps(in + 15 * stride));
+        Transpose4Avx512(r0, r1, r2, r3);
+    }
+
+    MATRIX_BATCH_TARGET("avx512f")
+    static inline void LoadVec3LanesAvx512(const glm::vec3* in, __m512& x, __m512& y, __m512& z)
+    {
+        __m512 w;
+        x = Load4Avx512(Load3Sse4(&in[0].x), Load3Sse4(&in[4].x), Load3Sse4(&in[8].x), Load3Sse4(&in[12].x));
+        y = Load4Avx512(Load3Sse4(&in[1].x), Load3Sse4(&in[5].x), Load3Sse4(&in[9].x), Load3Sse4(&in[13].x));
+        z = Load4Avx512(Load3Sse4(&in[2].x), Load3Sse4(&in[6].x), Load3Sse4(&in[10].x), Load3Sse4(&in[14].x));
+        w = Load4Avx512(Load3Sse4(&in[3].x), Load3Sse4(&in[7].x), Load3Sse4(&in[11].x), Load3Sse4(&in[15].x));
+        Transpose4Avx512(x, y, z, w);
+    }
+
+    MATRIX_BATCH_TARGET("avx512f")
+    static inline void StoreLanesAvx512(float* out, size_t stride, __m512 r0, __m512 r1, __m512 r2, __m512 r3)
+    {
+        Transpose4Avx512(r0, r1, r2, r3);
+        _mm_storeu_ps(out, _mm512_castps512_ps128(r0));
+        _mm_storeu_ps(out + stride, _mm512_castps512_ps128(r1));
+        _mm_storeu_ps(out + 2 * stride, _mm512_castps512_ps128(r2));
+        _mm_storeu_ps(out + 3 * stride, _mm512_castps512_ps128(r3));
+        _mm_storeu_ps(out + 4 * stride, _mm512_extractf32x4_ps(r0, 1));
+        _mm_storeu_ps(out + 5 * stride, _mm512_extractf32x4_ps(r1, 1));
+        _mm_storeu_ps(out + 6 * stride, _mm512_extractf32x4_ps(r2, 1));
+        _mm_storeu_ps(out + 7 * stride, _mm512_extractf32x4_ps(r3, 1));
+        _mm_storeu_ps(out + 8 * stride, _mm512_extractf32x4_ps(r0, 2));
+        _mm_storeu_ps(out + 9 * stride, _mm512_extractf32x4_ps(r1, 2));
+        _mm_storeu_ps(out + 10 * stride, _mm512_extractf32x4_ps(r2, 2));
+        _mm_storeu_ps(out + 11 * stride, _mm512_extractf32x4_ps(r3, 2));
+        _mm_storeu_ps(out + 12 * stride, _mm512_extractf32x4_ps(r0, 3));
+        _mm_storeu_ps(out + 13 * stride, _mm512_extractf32x4_ps(r1, 3));
+        _mm_storeu_ps(out + 14 * stride, _mm512_extractf32x4_ps(r2, 3));
+        _mm_storeu_ps(out + 15 * stride, _mm512_extractf32x4_ps(r3, 3));
+    }
+
+    MATRIX_BATCH_TARGET("avx512f")
+    static size_t ComposeAvx512(const glm::vec3* positions, const glm::quat* rotations, const glm::vec3* scales, float* matrices, float* affines, size_t count)
+    {
+        const __m512 one = _mm512_set1_ps(1.0f), two = _mm512_set1_ps(2.0f), zero = _mm512_setzero_ps();
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+        {
+            __m512 x, y, z, w, px, py, pz, sx, sy, sz;
+            LoadLanesAvx512(&rotations[i].x, 4, x, y, z, w);
+            LoadVec3LanesAvx512(positions + i, px, py, pz);
+            LoadVec3LanesAvx512(scales + i, sx, sy, sz);
+
+            __m512 x2 = _mm512_mul_ps(x, two), y2 = _mm512_mul_ps(y, two), z2 = _mm512_mul_ps(z, two);
+            __m512 xx = _mm512_mul_ps(x, x2), yy = _mm512_mul_ps(y, y2), zz = _mm512_mul_ps(z, z2);
+            __m512 xy = _mm512_mul_ps(x, y2), xz = _mm512_mul_ps(x, z2), yz = _mm512_mul_ps(y, z2);
+            __m512 wx = _mm512_mul_ps(w, x2), wy = _mm512_mul_ps(w, y2), wz = _mm512_mul_ps(w, z2);
+
+            __m512 m00 = _mm512_mul_ps(sx, _mm512_sub_ps(one, _mm512_add_ps(yy, zz)));
+            __m512 m01 = _mm512_mul_ps(sx, _mm512_add_ps(xy, wz));
+            __m512 m02 = _mm512_mul_ps(sx, _mm512_sub_ps(xz, wy));
+            __m512 m10 = _mm512_mul_ps(sy, _mm512_sub_ps(xy, wz));
+            __m512 m11 = _mm512_mul_ps(sy, _mm512_sub_ps(one, _mm512_add_ps(xx, zz)));
+            __m512 m12 = _mm512_mul_ps(sy, _mm512_add_ps(yz, wx));
+            __m512 m20 = _mm512_mul_ps(sz, _mm512_add_ps(xz, wy));
+            __m512 m21 = _mm512_mul_ps(sz, _mm512_sub_ps(yz, wx));
+            __m512 m22 = _mm512_mul_ps(sz, _mm512_sub_ps(one, _mm512_add_ps(xx, yy)));
+
+            if (matrices != NULL)
+            {
+                float* out = matrices + i * 16;
+                StoreLanesAvx512(out, 16, m00, m01, m02, zero);
+                StoreLanesAvx512(out + 4, 16, m10, m11, m12, zero);
+                StoreLanesAvx512(out + 8, 16, m20, m21, m22, zero);
+                StoreLanesAvx512(out + 12, 16, px, py, pz, one);
+            }
+            else
+            {
+                float* out = affines + i * 12;
+                StoreLanesAvx512(out, 12, m00, m10, m20, px);
+                StoreLanesAvx512(out + 4, 12, m01, m11, m21, py);
+                StoreLanesAvx512(out + 8, 12, m02, m12, m22, pz);
+            }
+        }
+        return i;
+    }
+
+    // A whole matrix per vector, one column per 128-bit lane
+    MATRIX_BATCH_TARGET("avx512f")
+    static void MultiplyAvx512(const float* left, const float* right, float* out, size_t count)
+    {
+        const __m512 l0 = _mm512_broadcast_f32x4(_mm_loadu_ps(left)), l1 = _mm512_broadcast_f32x4(_mm_loadu_ps(left + 4));
+        const __m512 l2 = _mm512_broadcast_f32x4(_mm_loadu_ps(left + 8)), l3 = _mm512_broadcast_f32x4(_mm_loadu_ps(left + 12));
+        for (size_t i = 0; i < count * 16; i += 16)
+        {
+            __m512 r = _mm512_loadu_ps(right + i);
+            __m512 o = _mm512_mul_ps(l0, _mm512_permute_ps(r, 0x00));
+            o = _mm512_fmadd_ps(l1, _mm512_permute_ps(r, 0x55), o);
+            o = _mm512_fmadd_ps(l2, _mm512_permute_ps(r, 0xAA), o);
+            o = _mm512_fmadd_ps(l3, _mm512_permute_ps(r, 0xFF), o);
+            _mm512_storeu_ps(out + i, o);
+        }
+    }
+
+    MATRIX_BATCH_TARGET("avx512f")
+    static inline __m512 CrossAvx512(__m512 u, __m512 v)
+    {
+        __m512 uYzx = _mm512_permute_ps(u, _MM_SHUFFLE(3, 0, 2, 1));
+        __m512 vYzx = _mm512_permute_ps(v, _MM_SHUFFLE(3, 0, 2, 1));
+        __m512 c = _mm512_fmsub_ps(u, vYzx, _mm512_mul_ps(uYzx, v));
+        return _mm512_permute_ps(c, _MM_SHUFFLE(3, 0, 2, 1));
+    }
+
+    // Four matrices per iteration, one per 128-bit lane
+    MATRIX_BATCH_TARGET("avx512f")
+    static size_t NormalAvx512(const float* models, float* out, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            const float* model = models + i * 16;
+            __m512 a = Load4Avx512(_mm_loadu_ps(model), _mm_loadu_ps(model + 16), _mm_loadu_ps(model + 32), _mm_loadu_ps(model + 48));
+            __m512 b = Load4Avx512(_mm_loadu_ps(model + 4), _mm_loadu_ps(model + 20), _mm_loadu_ps(model + 36), _mm_loadu_ps(model + 52));
+            __m512 c = Load4Avx512(_mm_loadu_ps(model + 8), _mm_loadu_ps(model + 24), _mm_loadu_ps(model + 40), _mm_loadu_ps(model + 56));
+            __m512 c0 = CrossAvx512(b, c), c1 = CrossAvx512(c, a), c2 = CrossAvx512(a, b);
+
+            // The determinant in x, y and z of each lane: the products summed with their two rotations
+            __m512 products = _mm512_mul_ps(a, c0);
+            __m512 determinant = _mm512_add_ps(products, _mm512_add_ps(_mm512_permute_ps(products, _MM_SHUFFLE(3, 0, 2, 1)),
+                _mm512_permute_ps(products, _MM_SHUFFLE(3, 1, 0, 2))));
+            __m512 inverse = _mm512_div_ps(_mm512_set1_ps(1.0f), determinant);
+            c0 = _mm512_mul_ps(c0, inverse);
+            c1 = _mm512_mul_ps(c1, inverse);
+            c2 = _mm512_mul_ps(c2, inverse);
+
+            // The nine floats of each matrix in order, as in NormalSse4
+            float* normal = out + i * 9;
+            _mm_storeu_ps(normal, _mm512_castps512_ps128(c0));
+            _mm_storeu_ps(normal + 3, _mm512_castps512_ps128(c1));
+            StoreLast3(normal + 6, _mm512_castps512_ps128(c2));
+            _mm_storeu_ps(normal + 9, _mm512_extractf32x4_ps(c0, 1));
+            _mm_storeu_ps(normal + 12, _mm512_extractf32x4_ps(c1, 1));
+            StoreLast3(normal + 15, _mm512_extractf32x4_ps(c2, 1));
+            _mm_storeu_ps(normal + 18, _mm512_extractf32x4_ps(c0, 2));
+            _mm_storeu_ps(normal + 21, _mm512_extractf32x4_ps(c1, 2));
+            StoreLast3(normal + 24, _mm512_extractf32x4_ps(c2, 2));
+            _mm_storeu_ps(normal + 27, _mm512_extractf32x4_ps(c0, 3));
+            _mm_storeu_ps(normal + 30, _mm512_extractf32x4_ps(c1, 3));
+            StoreLast3(normal + 33, _mm512_extractf32x4_ps(c2, 3));
+        }
+        return i;
+    }
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+
+    // x, y and z only, for the last column of a mat3, which may end the array
+    MATRIX_BATCH_TARGET("sse4.1")
+    static inline void StoreLast3(float* out, __m128 v)
+    {
+        _mm_storel_pi((__m64*)out, v);
+        _mm_store_ss(out + 2, _mm_movehl_ps(v, v));
+    }
+};
+#endif
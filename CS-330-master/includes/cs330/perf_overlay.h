@@ -0,0 +1,364 @@
+/* On-screen performance overlay.
+
+Shows frame time, a frame-time graph, draw calls, triangles, uniform uploads
+and state calls. Text comes from a 5x7 bitmap font baked into a small atlas
+texture at startup; all glyphs and graph bars of a frame are written into one
+dynamic vertex buffer and drawn with a single call. tut_04_04 times the draw
+with an Overlay CPU and GPU profiler scope; press T to capture them. The
+numbers shown are a snapshot taken before the overlay draws, so the overlay
+itself does not show up in them.
+*/
+
+#ifndef PERF_OVERLAY_H
+#define PERF_OVERLAY_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <cs330/gl_shader.h>
+#include <cs330/gl_state_cache.h>
+
+#include <cstdio>
+#include <vector>
+
+#ifndef GLSL
+#define GLSL(Version, Source) "#version " #Version " core \n" #Source
+#endif
+
+class PerfOverlay
+{
+public:
+    // Toggles drawing without releasing anything
+    bool Visible;
+
+    PerfOverlay() : Visible(true), program(0), fontTexture(0), vao(0), vbo(0), vboCapacity(0), screenSizeLoc(-1), historyHead(0)
+    {
+        for (int i = 0; i < HISTORY; ++i)
+            history[i] = 0.0f;
+        vertices.reserve(4096);
+    }
+
+    // Creates the program, the font atlas and the dynamic vertex buffer
+    bool Create()
+    {
+        program = CreateShaderProgram(VertexSource(), FragmentSource(), "OVERLAY");
+        if (program == 0)
+            return false;
+        screenSizeLoc = glGetUniformLocation(program, "screenSize");
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "font"), 0);
+
+        CreateFontAtlas();
+
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+        glGenBuffers(1, &vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+
+        GLint stride = sizeof(OverlayVertex);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride, (char*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (char*)(sizeof(float) * 2));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, stride, (char*)(sizeof(float) * 4));
+        glEnableVertexAttribArray(2);
+        glBindVertexArray(0);
+        return true;
+    }
+
+    void Release()
+    {
+        glDeleteProgram(program);
+        glDeleteTextures(1, &fontTexture);
+        glDeleteVertexArrays(1, &vao);
+        glDeleteBuffers(1, &vbo);
+        program = fontTexture = vao = vbo = 0;
+    }
+
+    // Adds one frame to the frame-time graph
+    void AddFrameTime(float milliseconds)
+    {
+        history[historyHead] = milliseconds;
+        historyHead = (historyHead + 1) % HISTORY;
+    }
+
+    // Builds and draws the overlay for a framebuffer of width x height pixels
+    void Draw(GLStateCache& state, int width, int height, const GLStateCounters& counters, double cpuMs, double gpuMs)
+    {
+        if (!Visible || program == 0)
+            return;
+
+        vertices.clear();
+
+        const float x = 10.0f;
+        const float y = 10.0f;
+        const float line = (GLYPH_HEIGHT + 3) * SCALE;
+        const glm::vec4 panel(0.0f, 0.0f, 0.0f, 0.6f);
+        const glm::vec4 white(1.0f);
+        const glm::vec4 green(0.4f, 1.0f, 0.4f, 1.0f);
+
+        float frameMs = history[(historyHead + HISTORY - 1) % HISTORY];
+        char text[96];
+
+        AddRect(x - 6.0f, y - 6.0f, GRAPH_WIDTH + 12.0f, line * 4 + GRAPH_HEIGHT + 18.0f, panel);
+
+        std::snprintf(text, sizeof(text), "FRAME %6.2f MS  %5.0f FPS", frameMs, frameMs > 0.0f ? 1000.0f / frameMs : 0.0f);
+        AddText(x, y, text, white);
+        std::snprintf(text, sizeof(text), "CPU %5.2f MS  GPU %5.2f MS", cpuMs, gpuMs);
+        AddText(x, y + line, text, white);
+        std::snprintf(text, sizeof(text), "DRAWS %u  TRIS %u", counters.Draws, counters.Triangles);
+        AddText(x, y + line * 2, text, white);
+        std::snprintf(text, sizeof(text), "UNIFORMS %u  STATE %u/%u", counters.UniformUploads, counters.Issued, counters.Issued + counters.Suppressed);
+        AddText(x, y + line * 3, text, white);
+
+        // Frame-time graph, newest frame on the right; the top of the graph is 33.3 ms
+        const float graphTop = y + line * 4 + 6.0f;
+        const float barWidth = GRAPH_WIDTH / HISTORY;
+        for (int i = 0; i < HISTORY; ++i)
+        {
+            float ms = history[(historyHead + i) % HISTORY];
+            float barHeight = glm::min(ms / 33.3f, 1.0f) * GRAPH_HEIGHT;
+            glm::vec4 color = ms > 16.7f ? glm::vec4(1.0f, 0.3f, 0.2f, 1.0f) : green;
+            AddRect(x + i * barWidth, graphTop + GRAPH_HEIGHT - barHeight, barWidth, barHeight, color);
+        }
+        // 60 Hz budget line
+        AddRect(x, graphTop + GRAPH_HEIGHT * 0.5f, GRAPH_WIDTH, 1.0f, glm::vec4(1.0f, 1.0f, 1.0f, 0.5f));
+
+        Upload(state);
+
+        state.SetDepthTest(false);
+        state.SetBlend(true);
+        state.SetBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        state.UseProgram(program);
+        state.Uniform2f(screenSizeLoc, (float)width, (float)height);
+        state.BindTexture(0, fontTexture);
+        state.BindVertexArray(vao);
+        state.DrawArrays(GL_TRIANGLES, 0, (GLsizei)vertices.size());
+        state.SetBlend(false);
+        state.SetDepthTest(true);
+    }
+
+private:
+    static const int HISTORY = 120;
+    static const int SCALE = 2;
+    static const int GLYPH_WIDTH = 5;
+    static const int GLYPH_HEIGHT = 7;
+    static const int CELL_WIDTH = 6;
+    static const int CELL_HEIGHT = 8;
+    static const int ATLAS_COLUMNS = 16;
+    static const int FIRST_GLYPH = 32;
+    static const int GLYPH_COUNT = 64;
+    static const int ATLAS_WIDTH = ATLAS_COLUMNS * CELL_WIDTH;
+    static const int ATLAS_HEIGHT = (GLYPH_COUNT / ATLAS_COLUMNS) * CELL_HEIGHT;
+    static constexpr float GRAPH_WIDTH = 240.0f;
+    static constexpr float GRAPH_HEIGHT = 48.0f;
+
+    struct OverlayVertex
+    {
+        float x, y;
+        float u, v;
+        float r, g, b, a;
+    };
+
+    GLuint program;
+    GLuint fontTexture;
+    GLuint vao;
+    GLuint vbo;
+    size_t vboCapacity;
+    GLint screenSizeLoc;
+
+    float history[HISTORY];
+    int historyHead;
+
+    std::vector<OverlayVertex> vertices;
+
+    static const char* VertexSource()
+    {
+        return GLSL(440,
+            layout(location = 0) in vec2 position; // Pixels from the top-left corner
+            layout(location = 1) in vec2 uv;       // Atlas coordinates, negative for solid quads
+            layout(location = 2) in vec4 color;
+
+            out vec2 vertexUV;
+            out vec4 vertexColor;
+
+            uniform vec2 screenSize;
+
+            void main()
+            {
+                vec2 ndc = position / screenSize * 2.0f - 1.0f;
+                gl_Position = vec4(ndc.x, -ndc.y, 0.0f, 1.0f);
+                vertexUV = uv;
+                vertexColor = color;
+            }
+        );
+    }
+
+    static const char* FragmentSource()
+    {
+        return GLSL(440,
+            in vec2 vertexUV;
+            in vec4 vertexColor;
+
+            out vec4 fragmentColor;
+
+            uniform sampler2D font;
+
+            void main()
+            {
+                float coverage = vertexUV.x < 0.0f ? 1.0f : texture(font, vertexUV).r;
+                fragmentColor = vec4(vertexColor.rgb, vertexColor.a * coverage);
+            }
+        );
+    }
+
+    // Bakes the 5x7 glyphs for ASCII 32..95 into a 16x4 grid of 6x8 cells
+    void CreateFontAtlas()
+    {
+        static const unsigned char glyphs[GLYPH_COUNT][GLYPH_HEIGHT] = {
+        { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // 'space'
+        { 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04 }, // '!'
+        { 0x0A, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '"'
+        { 0x0A, 0x0A, 0x1F, 0x0A, 0x1F, 0x0A, 0x0A }, // '#'
+        { 0x04, 0x0F, 0x14, 0x0E, 0x05, 0x1E, 0x04 }, // '$'
+        { 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 }, // '%'
+        { 0x0C, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0D }, // '&'
+        { 0x04, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '''
+        { 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 }, // '('
+        { 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 }, // ')'
+        { 0x00, 0x04, 0x15, 0x0E, 0x15, 0x04, 0x00 }, // '*'
+        { 0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00 }, // '+'
+        { 0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08 }, // ','
+        { 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 }, // '-'
+        { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C }, // '.'
+        { 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 }, // '/'
+        { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E }, // '0'
+        { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E }, // '1'
+        { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F }, // '2'
+        { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E }, // '3'
+        { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 }, // '4'
+        { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E }, // '5'
+        { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E }, // '6'
+        { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 }, // '7'
+        { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E }, // '8'
+        { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C }, // '9'
+        { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 }, // ':'
+        { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x04, 0x08 }, // ';'
+        { 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02 }, // '<'
+        { 0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00 }, // '='
+        { 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08 }, // '>'
+        { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 }, // '?'
+        { 0x0E, 0x11, 0x01, 0x0D, 0x15, 0x15, 0x0E }, // '@'
+        { 0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 }, // 'A'
+        { 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E }, // 'B'
+        { 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E }, // 'C'
+        { 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C }, // 'D'
+        { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F }, // 'E'
+        { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 }, // 'F'
+        { 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F }, // 'G'
+        { 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 }, // 'H'
+        { 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E }, // 'I'
+        { 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C }, // 'J'
+        { 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 }, // 'K'
+        { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F }, // 'L'
+        { 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 }, // 'M'
+        { 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 }, // 'N'
+        { 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, // 'O'
+        { 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 }, // 'P'
+        { 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D }, // 'Q'
+        { 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 }, // 'R'
+        { 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E }, // 'S'
+        { 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 }, // 'T'
+        { 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, // 'U'
+        { 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 }, // 'V'
+        { 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A }, // 'W'
+        { 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 }, // 'X'
+        { 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04, 0x04 }, // 'Y'
+        { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F }, // 'Z'
+        { 0x0E, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0E }, // '['
+        { 0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00 }, // 'backslash'
+        { 0x0E, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0E }, // ']'
+        { 0x04, 0x0A, 0x11, 0x00, 0x00, 0x00, 0x00 }, // '^'
+        { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F }, // '_'
+        };
+
+        std::vector<unsigned char> pixels(ATLAS_WIDTH * ATLAS_HEIGHT, 0);
+        for (int glyph = 0; glyph < GLYPH_COUNT; ++glyph)
+        {
+            int cellX = (glyph % ATLAS_COLUMNS) * CELL_WIDTH;
+            int cellY = (glyph / ATLAS_COLUMNS) * CELL_HEIGHT;
+            for (int row = 0; row < GLYPH_HEIGHT; ++row)
+                for (int column = 0; column < GLYPH_WIDTH; ++column)
+                {
+                    if (glyphs[glyph][row] & (0x10 >> column))
+                        pixels[(cellY + row) * ATLAS_WIDTH + cellX + column] = 255;
+                }
+        }
+
+        glGenTextures(1, &fontTexture);
+        glBindTexture(GL_TEXTURE_2D, fontTexture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, ATLAS_WIDTH, ATLAS_HEIGHT, 0, GL_RED, GL_UNSIGNED_BYTE, pixels.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    void AddQuad(float x, float y, float w, float h, float u0, float v0, float u1, float v1, const glm::vec4& color)
+    {
+        OverlayVertex corners[4] = {
+            { x,     y,     u0, v0, color.r, color.g, color.b, color.a },
+            { x + w, y,     u1, v0, color.r, color.g, color.b, color.a },
+            { x + w, y + h, u1, v1, color.r, color.g, color.b, color.a },
+            { x,     y + h, u0, v1, color.r, color.g, color.b, color.a }
+        };
+        vertices.push_back(corners[0]);
+        vertices.push_back(corners[1]);
+        vertices.push_back(corners[2]);
+        vertices.push_back(corners[2]);
+        vertices.push_back(corners[3]);
+        vertices.push_back(corners[0]);
+    }
+
+    void AddRect(float x, float y, float w, float h, const glm::vec4& color)
+    {
+        AddQuad(x, y, w, h, -1.0f, -1.0f, -1.0f, -1.0f, color);
+    }
+
+    void AddText(float x, float y, const char* text, const glm::vec4& color)
+    {
+        for (; *text; ++text, x += CELL_WIDTH * SCALE)
+        {
+            int c = (unsigned char)*text;
+            if (c >= 'a' && c <= 'z')
+                c -= 'a' - 'A';
+            if (c == ' ' || c < FIRST_GLYPH || c >= FIRST_GLYPH + GLYPH_COUNT)
+                continue;
+
+            int glyph = c - FIRST_GLYPH;
+            float u0 = float((glyph % ATLAS_COLUMNS) * CELL_WIDTH) / ATLAS_WIDTH;
+            float v0 = float((glyph / ATLAS_COLUMNS) * CELL_HEIGHT) / ATLAS_HEIGHT;
+            float u1 = u0 + float(GLYPH_WIDTH) / ATLAS_WIDTH;
+            float v1 = v0 + float(GLYPH_HEIGHT) / ATLAS_HEIGHT;
+            AddQuad(x, y, GLYPH_WIDTH * SCALE, GLYPH_HEIGHT * SCALE, u0, v0, u1, v1, color);
+        }
+    }
+
+    // Orphans the buffer so the upload never waits on last frame's draw
+    void Upload(GLStateCache& state)
+    {
+        size_t bytes = vertices.size() * sizeof(OverlayVertex);
+        state.BindBuffer(GL_ARRAY_BUFFER, vbo);
+        if (bytes > vboCapacity)
+            vboCapacity = bytes * 2;
+        glBufferData(GL_ARRAY_BUFFER, vboCapacity, NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, vertices.data());
+    }
+
+    PerfOverlay(const PerfOverlay&);
+    PerfOverlay& operator=(const PerfOverlay&);
+};
+#endif
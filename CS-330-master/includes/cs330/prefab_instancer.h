@@ -0,0 +1,464 @@
+/* GPU-expanded instancing of a multi-part prefab, such as the chair.
+
+A prefab is a list of parts, each a mesh with a transform relative to the
+prefab and a color. An instance is a single transform. A compute pass expands
+instances x parts into one draw record (model transform and color) per part,
+grouped by mesh, and the whole set is drawn by one glMultiDrawElementsIndirect
+with one command per mesh, whatever the number of instances.
+
+All meshes are copied into one vertex buffer (position and normal, 6 floats
+per vertex, as UCreateMesh lays them out) and one index buffer, so a single
+vertex array serves every command. Meshes without indices get sequential ones. A per-instance attribute holds the draw record index: it is an identity
+buffer read at baseInstance + gl_InstanceID, which works without
+ARB_shader_draw_parameters.
+
+Every transform on the GPU is an Affine3x4, three vec4 rows: instances take
+48 bytes instead of 64, parts and draw records 16 bytes less each. The compute
+pass composes them row by row, and the vertex shader transforms positions with
+three dot products and normals with the cross products of the rows, instead of
+a mat4 product and a 3x3 inverse per vertex.
+
+The expansion runs only when the instances or the prefab change.
+*/
+
+#ifndef PREFAB_INSTANCER_H
+#define PREFAB_INSTANCER_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <cs330/affine_transform.h>
+#include <cs330/gl_shader.h>
+#include <cs330/gl_state_cache.h>
+
+#include <vector>
+
+#ifndef GLSL
+#define GLSL(Version, Source) "#version " #Version " core \n" #Source
+#endif
+
+// A mesh in a vertex buffer laid out as position + normal floats, optionally with 32-bit indices
+struct PrefabMesh
+{
+    GLuint Vbo;
+    GLsizei VertexCount;
+    GLuint Ebo;
+    GLsizei IndexCount;     // 0 for a mesh drawn as arrays
+};
+
+struct PrefabPart
+{
+    int Mesh;               // index into the meshes given to Create
+    Affine3x4 Local;        // transform relative to the instance
+    glm::vec3 Color;
+};
+
+class PrefabInstancer
+{
+public:
+    static const int MAX_MESHES = 8;
+
+    PrefabInstancer() : program(0), expandProgram(0), vao(0), vbo(0), ebo(0), idBuffer(0), partBuffer(0), instanceBuffer(0), drawBuffer(0), indirectBuffer(0),
+        meshCount(0), instanceCount(0), commandCount(0), triangles(0), expanded(true), idCapacity(0), drawCapacity(0) {}
+
+    // Copies the meshes into one vertex and one index buffer and builds the programs
+    bool Create(const PrefabMesh* meshes, int count)
+    {
+        program = CreateShaderProgram(VertexSource(), FragmentSource(), "PREFAB");
+        expandProgram = CreateComputeProgram(ExpandSource(), "PREFAB_EXPAND");
+        if (program == 0 || expandProgram == 0)
+            return false;
+
+        meshCount = count < MAX_MESHES ? count : MAX_MESHES;
+        GLsizei totalVertices = 0;
+        GLsizei totalIndices = 0;
+        for (int i = 0; i < meshCount; ++i)
+        {
+            meshFirst[i] = totalVertices;
+            meshFirstIndex[i] = totalIndices;
+            meshIndices[i] = meshes[i].IndexCount > 0 ? meshes[i].IndexCount : meshes[i].VertexCount;
+            totalVertices += meshes[i].VertexCount;
+            totalIndices += meshIndices[i];
+        }
+
+        glGenVertexArrays(1, &vao);
+        glBindVertexArray(vao);
+        glGenBuffers(1, &vbo);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)totalVertices * VERTEX_SIZE, NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+        for (int i = 0; i < meshCount; ++i)
+        {
+            glBindBuffer(GL_COPY_READ_BUFFER, meshes[i].Vbo);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, (GLintptr)meshFirst[i] * VERTEX_SIZE, (GLsizeiptr)meshes[i].VertexCount * VERTEX_SIZE);
+        }
+
+        // Indices stay relative to their mesh; the commands' base vertex offsets them
+        glGenBuffers(1, &ebo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)totalIndices * sizeof(GLuint), NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+        for (int i = 0; i < meshCount; ++i)
+        {
+            const GLintptr offset = (GLintptr)meshFirstIndex[i] * sizeof(GLuint);
+            if (meshes[i].IndexCount > 0)
+            {
+                glBindBuffer(GL_COPY_READ_BUFFER, meshes[i].Ebo);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, offset, (GLsizeiptr)meshIndices[i] * sizeof(GLuint));
+            }
+            else
+            {
+                std::vector<GLuint> sequential(meshIndices[i]);
+                for (GLsizei index = 0; index < meshIndices[i]; ++index)
+                    sequential[index] = index;
+                glBufferSubData(GL_COPY_WRITE_BUFFER, offset, (GLsizeiptr)meshIndices[i] * sizeof(GLuint), sequential.data());
+            }
+        }
+
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, VERTEX_SIZE, (char*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, VERTEX_SIZE, (char*)(sizeof(float) * 3));
+        glEnableVertexAttribArray(1);
+
+        // Draw record index, one per instance of the indirect commands
+        glGenBuffers(1, &idBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, idBuffer);
+        glVertexAttribIPointer(2, 1, GL_UNSIGNED_INT, sizeof(GLuint), (char*)0);
+        glVertexAttribDivisor(2, 1);
+        glEnableVertexAttribArray(2);
+        glBindVertexArray(0);
+
+        glGenBuffers(1, &partBuffer);
+        glGenBuffers(1, &instanceBuffer);
+        glGenBuffers(1, &drawBuffer);
+        glGenBuffers(1, &indirectBuffer);
+
+        viewLoc = glGetUniformLocation(program, "view");
+        projectionLoc = glGetUniformLocation(program, "projection");
+        lightColorLoc = glGetUniformLocation(program, "lightColor");
+        lightPosLoc = glGetUniformLocation(program, "lightPos");
+        viewPositionLoc = glGetUniformLocation(program, "viewPosition");
+        partCountLoc = glGetUniformLocation(expandProgram, "partCount");
+        invocationsLoc = glGetUniformLocation(expandProgram, "invocations");
+        return true;
+    }
+
+    void Release()
+    {
+        glDeleteProgram(program);
+        glDeleteProgram(expandProgram);
+        glDeleteVertexArrays(1, &vao);
+        GLuint buffers[] = { vbo, ebo, idBuffer, partBuffer, instanceBuffer, drawBuffer, indirectBuffer };
+        glDeleteBuffers(7, buffers);
+        program = expandProgram = vao = vbo = ebo = idBuffer = partBuffer = instanceBuffer = drawBuffer = indirectBuffer = 0;
+        idCapacity = drawCapacity = 0;
+    }
+
+    // Sets the parts every instance is made of. SetPrefab and SetInstances bind buffers
+    // directly, so a GLStateCache in use has to be invalidated after them.
+    void SetPrefab(const PrefabPart* newParts, int count)
+    {
+        parts.clear();
+        for (int i = 0; i < count; ++i)
+        {
+            if (newParts[i].Mesh >= 0 && newParts[i].Mesh < meshCount)
+                parts.push_back(newParts[i]);
+        }
+        Layout();
+    }
+
+    // Uploads the instance transforms
+    void SetInstances(const Affine3x4* transforms, int count)
+    {
+        instanceCount = count;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, (GLsizeiptr)count * sizeof(Affine3x4), transforms, GL_STATIC_DRAW);
+        Layout();
+    }
+
+    // Draws every part of every instance with one multi-draw call
+    void Draw(GLStateCache& state, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& lightPosition, const glm::vec3& lightColor, const glm::vec3& viewPosition)
+    {
+        if (commandCount == 0)
+            return;
+        if (!expanded)
+            Expand(state);
+
+        state.UseProgram(program);
+        state.UniformMatrix4fv(viewLoc, glm::value_ptr(view));
+        state.UniformMatrix4fv(projectionLoc, glm::value_ptr(projection));
+        state.Uniform3f(lightColorLoc, lightColor.r, lightColor.g, lightColor.b);
+        state.Uniform3f(lightPosLoc, lightPosition.x, lightPosition.y, lightPosition.z);
+        state.Uniform3f(viewPositionLoc, viewPosition.x, viewPosition.y, viewPosition.z);
+
+        state.BindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_BINDING, drawBuffer);
+        state.BindVertexArray(vao);
+        state.BindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+        state.MultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*)0, commandCount, triangles);
+    }
+
+    // Indirect commands of a Draw, one per mesh used by the prefab
+    int CommandCount() const { return commandCount; }
+    // Part draws of a Draw, instances x parts
+    unsigned PartCount() const { return (unsigned)parts.size() * (unsigned)instanceCount; }
+
+private:
+    static const GLsizei VERTEX_SIZE = sizeof(float) * 6;
+    static const GLuint PART_BINDING = 0;
+    static const GLuint INSTANCE_BINDING = 1;
+    static const GLuint DRAW_BINDING = 2;
+    static const GLuint EXPAND_GROUP_SIZE = 64;
+
+    // std430 layouts of the shader storage blocks
+    struct GpuPart
+    {
+        Affine3x4 Local;
+        glm::vec4 Color;
+        GLuint GroupBase;       // first draw record of the part's mesh group
+        GLuint GroupParts;      // parts of the prefab using that mesh
+        GLuint Slot;            // index of the part among them
+        GLuint Padding;
+    };
+
+    struct GpuDraw
+    {
+        Affine3x4 Model;
+        glm::vec4 Color;
+    };
+
+    struct DrawElementsIndirectCommand
+    {
+        GLuint Count;
+        GLuint InstanceCount;
+        GLuint FirstIndex;
+        GLint BaseVertex;
+        GLuint BaseInstance;
+    };
+
+    GLuint program;
+    GLuint expandProgram;
+    GLuint vao;
+    GLuint vbo;
+    GLuint ebo;
+    GLuint idBuffer;
+    GLuint partBuffer;
+    GLuint instanceBuffer;
+    GLuint drawBuffer;
+    GLuint indirectBuffer;
+    GLint viewLoc, projectionLoc, lightColorLoc, lightPosLoc, viewPositionLoc;
+    GLint partCountLoc, invocationsLoc;
+
+    GLsizei meshFirst[MAX_MESHES];
+    GLsizei meshFirstIndex[MAX_MESHES];
+    GLsizei meshIndices[MAX_MESHES];
+    int meshCount;
+    std::vector<PrefabPart> parts;
+    int instanceCount;
+    GLsizei commandCount;
+    unsigned triangles;
+    bool expanded;
+    GLsizeiptr idCapacity;
+    GLsizeiptr drawCapacity;
+
+    // Groups the parts by mesh, writes the indirect commands and the part table
+    void Layout()
+    {
+        expanded = false;
+        commandCount = 0;
+        triangles = 0;
+        if (parts.empty() || instanceCount == 0)
+            return;
+
+        int groupParts[MAX_MESHES] = { 0 };
+        for (size_t i = 0; i < parts.size(); ++i)
+            ++groupParts[parts[i].Mesh];
+
+        GLuint groupBase[MAX_MESHES];
+        std::vector<DrawElementsIndirectCommand> commands;
+        GLuint records = 0;
+        for (int mesh = 0; mesh < meshCount; ++mesh)
+        {
+            groupBase[mesh] = records;
+            if (groupParts[mesh] == 0)
+                continue;
+            DrawElementsIndirectCommand command = { (GLuint)meshIndices[mesh], (GLuint)(groupParts[mesh] * instanceCount), (GLuint)meshFirstIndex[mesh], meshFirst[mesh], records };
+            commands.push_back(command);
+            records += command.InstanceCount;
+            triangles += command.Count / 3 * command.InstanceCount;
+        }
+
+        int slots[MAX_MESHES] = { 0 };
+        std::vector<GpuPart> gpuParts;
+        for (size_t i = 0; i < parts.size(); ++i)
+        {
+            int mesh = parts[i].Mesh;
+            GpuPart part = { parts[i].Local, glm::vec4(parts[i].Color, 1.0f), groupBase[mesh], (GLuint)groupParts[mesh], (GLuint)slots[mesh]++, 0 };
+            gpuParts.push_back(part);
+        }
+        commandCount = (GLsizei)commands.size();
+
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), &commands[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, partBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, gpuParts.size() * sizeof(GpuPart), &gpuParts[0], GL_STATIC_DRAW);
+
+        // Storage grows only; the identity ids cover every record
+        if ((GLsizeiptr)records > idCapacity)
+        {
+            std::vector<GLuint> ids(records);
+            for (GLuint i = 0; i < records; ++i)
+                ids[i] = i;
+            glBindBuffer(GL_ARRAY_BUFFER, idBuffer);
+            glBufferData(GL_ARRAY_BUFFER, records * sizeof(GLuint), &ids[0], GL_STATIC_DRAW);
+            idCapacity = records;
+        }
+        if ((GLsizeiptr)records > drawCapacity)
+        {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, drawBuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, records * sizeof(GpuDraw), NULL, GL_DYNAMIC_COPY);
+            drawCapacity = records;
+        }
+    }
+
+    // Runs the compute pass writing one draw record per instance x part
+    void Expand(GLStateCache& state)
+    {
+        const GLuint invocations = (GLuint)PartCount();
+        state.UseProgram(expandProgram);
+        state.Uniform1ui(partCountLoc, (GLuint)parts.size());
+        state.Uniform1ui(invocationsLoc, invocations);
+        state.BindBufferBase(GL_SHADER_STORAGE_BUFFER, PART_BINDING, partBuffer);
+        state.BindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_BINDING, instanceBuffer);
+        state.BindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_BINDING, drawBuffer);
+        glDispatchCompute((invocations + EXPAND_GROUP_SIZE - 1) / EXPAND_GROUP_SIZE, 1, 1);
+
+        // The vertex shader reads the records through the same storage block
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        expanded = true;
+    }
+
+    static const char* ExpandSource()
+    {
+        return GLSL(440,
+            layout(local_size_x = 64) in;
+
+            // Affine transforms are their top three rows
+            struct Affine
+            {
+                vec4 rows[3];
+            };
+            struct Part
+            {
+                Affine local;
+                vec4 color;
+                uvec4 placement;    // group base, parts in the group, slot in the group
+            };
+            struct Draw
+            {
+                Affine model;
+                vec4 color;
+            };
+
+            layout(std430, binding = 0) readonly buffer Parts { Part parts[]; };
+            layout(std430, binding = 1) readonly buffer Instances { Affine instances[]; };
+            layout(std430, binding = 2) writeonly buffer Draws { Draw draws[]; };
+
+            uniform uint partCount;
+            uniform uint invocations;
+
+            void main()
+            {
+                uint index = gl_GlobalInvocationID.x;
+                if (index >= invocations)
+                    return;
+                uint instance = index / partCount;
+                Part part = parts[index % partCount];
+
+                // Records of a mesh group are instance-major, so a command's instances are contiguous
+                uint record = part.placement.x + instance * part.placement.y + part.placement.z;
+                Affine parent = instances[instance];
+                for (int row = 0; row < 3; ++row)
+                {
+                    vec4 r = parent.rows[row];
+                    draws[record].model.rows[row] = r.x * part.local.rows[0] + r.y * part.local.rows[1] + r.z * part.local.rows[2] + vec4(0.0f, 0.0f, 0.0f, r.w);
+                }
+                draws[record].color = part.color;
+            }
+        );
+    }
+
+    static const char* VertexSource()
+    {
+        return GLSL(440,
+            layout(location = 0) in vec3 position;
+            layout(location = 1) in vec3 normal;
+            layout(location = 2) in uint record;    // baseInstance + gl_InstanceID through the identity id buffer
+
+            struct Draw
+            {
+                vec4 model[3];      // rows of the affine transform
+                vec4 color;
+            };
+            layout(std430, binding = 2) readonly buffer Draws { Draw draws[]; };
+
+            out vec3 vertexNormal;
+            out vec3 vertexFragmentPos;
+            out vec3 vertexColor;
+
+            uniform mat4 view;
+            uniform mat4 projection;
+
+            void main()
+            {
+                vec3 r0 = draws[record].model[0].xyz;
+                vec3 r1 = draws[record].model[1].xyz;
+                vec3 r2 = draws[record].model[2].xyz;
+                vec4 p = vec4(position, 1.0f);
+                vec3 worldPosition = vec3(dot(draws[record].model[0], p), dot(draws[record].model[1], p), dot(draws[record].model[2], p));
+                gl_Position = projection * view * vec4(worldPosition, 1.0f);
+                vertexFragmentPos = worldPosition;
+
+                // The rows of transpose(inverse(mat3(model))) are the cross products of the model's rows
+                vec3 c0 = cross(r1, r2);
+                vertexNormal = vec3(dot(c0, normal), dot(cross(r2, r0), normal), dot(cross(r0, r1), normal)) / dot(r0, c0);
+                vertexColor = draws[record].color.rgb;
+            }
+        );
+    }
+
+    // Phong lighting of the tut_04_04 fragment shader, with the color of the draw record
+    static const char* FragmentSource()
+    {
+        return GLSL(440,
+            in vec3 vertexNormal;
+            in vec3 vertexFragmentPos;
+            in vec3 vertexColor;
+
+            out vec4 fragmentColor;
+
+            uniform vec3 lightColor;
+            uniform vec3 lightPos;
+            uniform vec3 viewPosition;
+
+            void main()
+            {
+                vec3 ambient = 0.1f * lightColor;
+
+                vec3 norm = normalize(vertexNormal);
+                vec3 lightDirection = normalize(lightPos - vertexFragmentPos);
+                vec3 diffuse = max(dot(norm, lightDirection), 0.0) * lightColor;
+
+                vec3 viewDir = normalize(viewPosition - vertexFragmentPos);
+                vec3 reflectDir = reflect(-lightDirection, norm);
+                vec3 specular = 0.8f * pow(max(dot(viewDir, reflectDir), 0.0), 16.0f) * lightColor;
+
+                fragmentColor = vec4((ambient + diffuse + specular) * vertexColor, 1.0f);
+            }
+        );
+    }
+
+    PrefabInstancer(const PrefabInstancer&);
+    PrefabInstancer& operator=(const PrefabInstancer&);
+};
+#endif
@@ -0,0 +1,504 @@
+/* Procedural primitive meshes: sphere, cylinder, capsule, torus, plane grid, box and rounded box.
+
+Every primitive is a non-indexed triangle list of PrimitiveVertex (position and
+normal, the layout of the tutorials' meshes), wound counter-clockwise seen from
+outside, written into memory the caller preallocates from the matching count:
+
+    PrimitiveGenerator generator;
+    std::vector<PrimitiveVertex> vertices(PrimitiveGenerator::SphereVertexCount(64, 32));
+    generator.Sphere(&vertices[0], 64, 32, 1.0f);
+
+No trigonometry runs per vertex. The sines and cosines of the angles around
+the axis and along the profile are tabulated once per tessellation and kept
+until it changes, so building the same primitive again reuses them. Each row
+of distinct vertices is computed four at a time with SSE and transposed into
+8-float records; triangles are then emitted by copying records, one 16-byte
+and one 8-byte store per vertex. Targets without SSE compute the rows one
+vertex at a time into the same records.
+
+RoundedBox is the exception: it writes an indexed mesh, vertices and indices
+sized from RoundedBoxVertexCount and RoundedBoxIndexCount.
+
+Surfaces of revolution (sphere, cylinder, capsule, torus) wrap around the Y
+axis starting at +X. Generators return the number of vertices written, or 0
+for a tessellation below the minimum (3 segments around, 2 sphere rings, 1
+for everything else).
+*/
+
+#ifndef PRIMITIVES_H
+#define PRIMITIVES_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define PRIMITIVES_SSE
+#include <xmmintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+struct PrimitiveVertex
+{
+    float Position[3];
+    float Normal[3];
+};
+
+class PrimitiveGenerator
+{
+public:
+    // Vertices written by each generator
+    static size_t SphereVertexCount(int segments, int rings) { return segments < 3 || rings < 2 ? 0 : (size_t)segments * (rings - 1) * 6; }
+    static size_t CylinderVertexCount(int segments, int stacks, bool caps) { return segments < 3 || stacks < 1 ? 0 : (size_t)segments * (stacks + (caps ? 1 : 0)) * 6; }
+    static size_t CapsuleVertexCount(int segments, int rings) { return segments < 3 || rings < 1 ? 0 : (size_t)segments * rings * 12; }
+    static size_t TorusVertexCount(int segments, int sides) { return segments < 3 || sides < 3 ? 0 : (size_t)segments * sides * 6; }
+    static size_t GridVertexCount(int columns, int rows) { return columns < 1 || rows < 1 ? 0 : (size_t)columns * rows * 6; }
+    static size_t BoxVertexCount(int divisions) { return divisions < 1 ? 0 : (size_t)divisions * divisions * 36; }
+
+    // Vertices and indices written by RoundedBox
+    static size_t RoundedBoxVertexCount(const glm::vec3& size, float radius, int segments)
+    {
+        int n[3];
+        if (!RoundedBoxLattice(size, radius, segments, n))
+            return 0;
+        return (size_t)n[0] * n[1] * n[2] - (size_t)(n[0] - 2) * (n[1] - 2) * (n[2] - 2);
+    }
+    static size_t RoundedBoxIndexCount(const glm::vec3& size, float radius, int segments)
+    {
+        int n[3];
+        if (!RoundedBoxLattice(size, radius, segments, n))
+            return 0;
+        return 12 * ((size_t)(n[0] - 1) * (n[1] - 1) + (size_t)(n[1] - 1) * (n[2] - 1) + (size_t)(n[2] - 1) * (n[0] - 1));
+    }
+
+    // Sphere centered on the origin; rings bands from pole to pole
+    size_t Sphere(PrimitiveVertex* out, int segments, int rings, float radius)
+    {
+        if (SphereVertexCount(segments, rings) == 0)
+            return 0;
+        around.Build(segments, 0.0f, glm::two_pi<float>());
+        profile.Build(rings, -glm::half_pi<float>(), glm::pi<float>());
+
+        PrimitiveVertex* start = out;
+        RevolutionRow(lower, segments, 0.0f, -radius, 0.0f, -1.0f);
+        for (int ring = 1; ring <= rings; ++ring)
+        {
+            float c = ring == rings ? 0.0f : profile.Cos[ring];
+            float s = profile.Sin[ring];
+            RevolutionRow(upper, segments, radius * c, radius * s, c, s);
+            out = EmitBand(out, segments, ring == 1 ? BAND_LOWER_POLE : ring == rings ? BAND_UPPER_POLE : BAND_QUADS);
+            lower.swap(upper);
+        }
+        return out - start;
+    }
+
+    // Cylinder of the given height centered on the origin, with optional end caps
+    size_t Cylinder(PrimitiveVertex* out, int segments, int stacks, float radius, float height, bool caps)
+    {
+        if (CylinderVertexCount(segments, stacks, caps) == 0)
+            return 0;
+        around.Build(segments, 0.0f, glm::two_pi<float>());
+
+        PrimitiveVertex* start = out;
+        const float bottom = -0.5f * height;
+        const float top = 0.5f * height;
+        RevolutionRow(lower, segments, radius, bottom, 1.0f, 0.0f);
+        for (int stack = 1; stack <= stacks; ++stack)
+        {
+            RevolutionRow(upper, segments, radius, bottom + height * stack / stacks, 1.0f, 0.0f);
+            out = EmitBand(out, segments, BAND_QUADS);
+            lower.swap(upper);
+        }
+
+        if (caps)
+        {
+            RevolutionRow(lower, segments, 0.0f, bottom, 0.0f, -1.0f);
+            RevolutionRow(upper, segments, radius, bottom, 0.0f, -1.0f);
+            out = EmitBand(out, segments, BAND_LOWER_POLE);
+            RevolutionRow(lower, segments, radius, top, 0.0f, 1.0f);
+            RevolutionRow(upper, segments, 0.0f, top, 0.0f, 1.0f);
+            out = EmitBand(out, segments, BAND_UPPER_POLE);
+        }
+        return out - start;
+    }
+
+    // Cylinder of the given height between two hemispheres of rings bands each
+    size_t Capsule(PrimitiveVertex* out, int segments, int rings, float radius, float height)
+    {
+        if (CapsuleVertexCount(segments, rings) == 0)
+            return 0;
+        around.Build(segments, 0.0f, glm::two_pi<float>());
+        profile.Build(2 * rings, -glm::half_pi<float>(), glm::pi<float>());
+
+        // Profile angles below the equator belong to the lower hemisphere, from the equator up to the upper one
+        PrimitiveVertex* start = out;
+        const float offset = 0.5f * height;
+        RevolutionRow(lower, segments, 0.0f, -radius - offset, 0.0f, -1.0f);
+        for (int ring = 1; ring <= 2 * rings + 1; ++ring)
+        {
+            int angle = ring <= rings ? ring : ring - 1;
+            float c = angle == 2 * rings ? 0.0f : profile.Cos[angle];
+            float s = profile.Sin[angle];
+            float y = radius * s + (ring <= rings ? -offset : offset);
+            RevolutionRow(upper, segments, radius * c, y, c, s);
+            out = EmitBand(out, segments, ring == 1 ? BAND_LOWER_POLE : ring == 2 * rings + 1 ? BAND_UPPER_POLE : BAND_QUADS);
+            lower.swap(upper);
+        }
+        return out - start;
+    }
+
+    // Torus around the Y axis; majorRadius to the center of the tube, minorRadius of the tube
+    size_t Torus(PrimitiveVertex* out, int segments, int sides, float majorRadius, float minorRadius)
+    {
+        if (TorusVertexCount(segments, sides) == 0)
+            return 0;
+        around.Build(segments, 0.0f, glm::two_pi<float>());
+        profile.Build(sides, 0.0f, glm::two_pi<float>());
+
+        PrimitiveVertex* start = out;
+        RevolutionRow(lower, segments, majorRadius + minorRadius, 0.0f, 1.0f, 0.0f);
+        for (int side = 1; side <= sides; ++side)
+        {
+            float c = profile.Cos[side];
+            float s = profile.Sin[side];
+            RevolutionRow(upper, segments, majorRadius + minorRadius * c, minorRadius * s, c, s);
+            out = EmitBand(out, segments, BAND_QUADS);
+            lower.swap(upper);
+        }
+        return out - start;
+    }
+
+    // Plane grid on Y = 0 centered on the origin, facing +Y
+    size_t Grid(PrimitiveVertex* out, int columns, int rows, float width, float depth)
+    {
+        if (GridVertexCount(columns, rows) == 0)
+            return 0;
+        return Face(out, columns, rows, glm::vec3(-0.5f * width, 0.0f, 0.5f * depth), glm::vec3(width, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -depth)) - out;
+    }
+
+    // Axis-aligned box centered on the origin, every face divided into divisions * divisions tiles
+    size_t Box(PrimitiveVertex* out, int divisions, const glm::vec3& size)
+    {
+        if (BoxVertexCount(divisions) == 0)
+            return 0;
+
+        // Each face spans u and v with u x v along its outward normal
+        const glm::vec3 h = 0.5f * size;
+        PrimitiveVertex* start = out;
+        out = Face(out, divisions, divisions, glm::vec3(h.x, -h.y, h.z), glm::vec3(0.0f, 0.0f, -size.z), glm::vec3(0.0f, size.y, 0.0f));
+        out = Face(out, divisions, divisions, glm::vec3(-h.x, -h.y, -h.z), glm::vec3(0.0f, 0.0f, size.z), glm::vec3(0.0f, size.y, 0.0f));
+        out = Face(out, divisions, divisions, glm::vec3(-h.x, h.y, h.z), glm::vec3(size.x, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, -size.z));
+        out = Face(out, divisions, divisions, glm::vec3(-h.x, -h.y, -h.z), glm::vec3(size.x, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, size.z));
+        out = Face(out, divisions, divisions, glm::vec3(-h.x, -h.y, h.z), glm::vec3(size.x, 0.0f, 0.0f), glm::vec3(0.0f, size.y, 0.0f));
+        out = Face(out, divisions, divisions, glm::vec3(h.x, -h.y, -h.z), glm::vec3(-size.x, 0.0f, 0.0f), glm::vec3(0.0f, size.y, 0.0f));
+        return out - start;
+    }
+
+    // Box of the given outer size centered on the origin with edges and corners rounded to radius:
+    // the box shrunk by radius, grown back by a sphere of radius, so the edges are quarter cylinders
+    // and the corners sphere octants. segments per quarter circle, rounded up to even. An indexed
+    // mesh: every vertex is shared by all the faces around it, so it is closed and smoothly lit.
+    // Returns the number of vertices written.
+    size_t RoundedBox(PrimitiveVertex* vertices, uint32_t* indices, const glm::vec3& size, float radius, int segments)
+    {
+        int n[3];
+        if (!RoundedBoxLattice(size, radius, segments, n))
+            return 0;
+        const float r = glm::min(radius, 0.5f * glm::min(size.x, glm::min(size.y, size.z)));
+        const glm::vec3 inner = glm::max(0.5f * size - glm::vec3(r), glm::vec3(0.0f));
+
+        // The tangents of evenly spaced angles place the lattice so every rounded step turns by the same
+        // angle; the last one is exactly 1 so neighbouring faces meet on the same points
+        const int half = (segments + 1) / 2;
+        std::vector<float> tangents(half + 1);
+        for (int k = 0; k <= half; ++k)
+            tangents[k] = k == half ? 1.0f : (float)std::tan(glm::quarter_pi<double>() * k / half);
+
+        // Lattice coordinates along each axis, from -(inner + r) to inner + r; a flat axis (inner 0) has one middle point
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            std::vector<float>& values = lattice[axis];
+            values.clear();
+            for (int k = half; k >= (inner[axis] > 0.0f ? 0 : 1); --k)
+                values.push_back(-(inner[axis] + r * tangents[k]));
+            if (inner[axis] == 0.0f)
+                values.push_back(0.0f);
+            for (int k = inner[axis] > 0.0f ? 0 : 1; k <= half; ++k)
+                values.push_back(inner[axis] + r * tangents[k]);
+        }
+
+        // Points on the surface of the lattice are the vertices: projected from the inner box onto the sphere of radius r
+        vertexOf.assign((size_t)n[0] * n[1] * n[2], 0);
+        uint32_t count = 0;
+        for (int k = 0; k < n[2]; ++k)
+            for (int j = 0; j < n[1]; ++j)
+                for (int i = 0; i < n[0]; ++i)
+                {
+                    if (i != 0 && i != n[0] - 1 && j != 0 && j != n[1] - 1 && k != 0 && k != n[2] - 1)
+                        continue;
+                    glm::vec3 point(lattice[0][i], lattice[1][j], lattice[2][k]);
+                    glm::vec3 center = glm::clamp(point, -inner, inner);
+                    glm::vec3 normal = glm::normalize(point - center);
+                    glm::vec3 position = center + r * normal;
+                    PrimitiveVertex& vertex = vertices[count];
+                    vertex.Position[0] = position.x;
+                    vertex.Position[1] = position.y;
+                    vertex.Position[2] = position.z;
+                    vertex.Normal[0] = normal.x;
+                    vertex.Normal[1] = normal.y;
+                    vertex.Normal[2] = normal.z;
+                    vertexOf[((size_t)k * n[1] + j) * n[0] + i] = count++;
+                }
+
+        // Two triangles per lattice square of each face; u x v is the axis of the face, so the + faces keep that order
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            const int u = (axis + 1) % 3;
+            const int v = (axis + 2) % 3;
+            for (int side = 0; side < 2; ++side)
+            {
+                int cell[3];
+                cell[axis] = side == 0 ? 0 : n[axis] - 1;
+                for (int iv = 0; iv < n[v] - 1; ++iv)
+                    for (int iu = 0; iu < n[u] - 1; ++iu)
+                    {
+                        cell[u] = iu;
+                        cell[v] = iv;
+                        uint32_t a = VertexAt(cell, n);
+                        cell[u] = iu + 1;
+                        uint32_t b = VertexAt(cell, n);
+                        cell[v] = iv + 1;
+                        uint32_t c = VertexAt(cell, n);
+                        cell[u] = iu;
+                        uint32_t d = VertexAt(cell, n);
+                        if (side == 0)
+                            std::swap(b, d);
+                        indices[0] = a;
+                        indices[1] = b;
+                        indices[2] = c;
+                        indices[3] = a;
+                        indices[4] = c;
+                        indices[5] = d;
+                        indices += 6;
+                    }
+            }
+        }
+        return count;
+    }
+
+private:
+    // Sines and cosines of count + 1 evenly spaced angles, padded so rows can be read four at a time
+    struct SinCosTable
+    {
+        std::vector<float> Sin;
+        std::vector<float> Cos;
+        int count;
+        float start;
+        float range;
+
+        SinCosTable() : count(0), start(0.0f), range(0.0f) {}
+
+        void Build(int newCount, float newStart, float newRange)
+        {
+            if (newCount == count && newStart == start && newRange == range)
+                return;
+            count = newCount;
+            start = newStart;
+            range = newRange;
+
+            size_t padded = (size_t)(count + 4) & ~(size_t)3;
+            Sin.assign(padded, 0.0f);
+            Cos.assign(padded, 0.0f);
+            for (int i = 0; i <= count; ++i)
+            {
+                double angle = start + (double)range * i / count;
+                Sin[i] = (float)std::sin(angle);
+                Cos[i] = (float)std::cos(angle);
+            }
+
+            // A full turn ends exactly where it started, so the seam has no crack
+            if (range == glm::two_pi<float>())
+            {
+                Sin[count] = Sin[0];
+                Cos[count] = Cos[0];
+            }
+        }
+    };
+
+    enum Band_Kind {
+        BAND_QUADS,         // two triangles per segment
+        BAND_LOWER_POLE,    // the lower row is a single point: one triangle per segment
+        BAND_UPPER_POLE     // the upper row is a single point
+    };
+
+    // A row vertex as (px, py, pz, nx, ny, nz, 0, 0). Plain floats, as std::vector does not align to 16 bytes everywhere.
+    struct RowVertex
+    {
+        float Data[8];
+    };
+    typedef std::vector<RowVertex> Row;
+
+    SinCosTable around;
+    SinCosTable profile;
+    Row lower;
+    Row upper;
+    std::vector<float> lattice[3];      // RoundedBox coordinates along each axis
+    std::vector<uint32_t> vertexOf;     // RoundedBox vertex of each lattice point
+
+    // Lattice points along each axis of a rounded box; false for an invalid box
+    static bool RoundedBoxLattice(const glm::vec3& size, float radius, int segments, int* n)
+    {
+        if (segments < 1 || !(radius > 0.0f) || !(size.x > 0.0f && size.y > 0.0f && size.z > 0.0f))
+            return false;
+        const int half = (segments + 1) / 2;
+        const float r = glm::min(radius, 0.5f * glm::min(size.x, glm::min(size.y, size.z)));
+        for (int axis = 0; axis < 3; ++axis)
+            n[axis] = 0.5f * size[axis] - r > 0.0f ? 2 * half + 2 : 2 * half + 1;
+        return true;
+    }
+
+    uint32_t VertexAt(const int* cell, const int* n) const
+    {
+        return vertexOf[((size_t)cell[2] * n[1] + cell[1]) * n[0] + cell[0]];
+    }
+
+    static void SetRecord(RowVertex& record, float px, float py, float pz, float nx, float ny, float nz)
+    {
+        const float data[8] = { px, py, pz, nx, ny, nz, 0.0f, 0.0f };
+        std::memcpy(record.Data, data, sizeof(data));
+    }
+
+#if defined(PRIMITIVES_SSE)
+    // Stores four vertices given as one register per component
+    static void StoreRecords(RowVertex* records, __m128 px, __m128 py, __m128 pz, __m128 nx, __m128 ny, __m128 nz)
+    {
+        __m128 padding2 = _mm_setzero_ps();
+        __m128 padding3 = _mm_setzero_ps();
+        _MM_TRANSPOSE4_PS(px, py, pz, nx);
+        _MM_TRANSPOSE4_PS(ny, nz, padding2, padding3);
+        _mm_storeu_ps(records[0].Data, px);
+        _mm_storeu_ps(records[0].Data + 4, ny);
+        _mm_storeu_ps(records[1].Data, py);
+        _mm_storeu_ps(records[1].Data + 4, nz);
+        _mm_storeu_ps(records[2].Data, pz);
+        _mm_storeu_ps(records[2].Data + 4, padding2);
+        _mm_storeu_ps(records[3].Data, nx);
+        _mm_storeu_ps(records[3].Data + 4, padding3);
+    }
+#endif
+
+    // Vertices j = 0..segments of the circle of the given radius at height y: (radius cos, y, -radius sin)
+    void RevolutionRow(Row& row, int segments, float radius, float y, float normalRadius, float normalY)
+    {
+        row.resize(((size_t)segments + 4) & ~(size_t)3);
+#if defined(PRIMITIVES_SSE)
+        const __m128 r = _mm_set1_ps(radius);
+        const __m128 nr = _mm_set1_ps(normalRadius);
+        const __m128 py = _mm_set1_ps(y);
+        const __m128 ny = _mm_set1_ps(normalY);
+        const __m128 negative = _mm_set1_ps(-0.0f);
+        for (int j = 0; j <= segments; j += 4)
+        {
+            __m128 c = _mm_loadu_ps(&around.Cos[j]);
+            __m128 s = _mm_xor_ps(_mm_loadu_ps(&around.Sin[j]), negative);
+            StoreRecords(&row[j], _mm_mul_ps(r, c), py, _mm_mul_ps(r, s), _mm_mul_ps(nr, c), ny, _mm_mul_ps(nr, s));
+        }
+#else
+        for (int j = 0; j <= segments; ++j)
+        {
+            const float c = around.Cos[j];
+            const float s = -around.Sin[j];
+            SetRecord(row[j], radius * c, y, radius * s, normalRadius * c, normalY, normalRadius * s);
+        }
+#endif
+    }
+
+    // Vertices origin + u * j / columns for j = 0..columns, all with the given normal
+    void LinearRow(Row& row, int columns, const glm::vec3& origin, const glm::vec3& u, const glm::vec3& normal)
+    {
+        row.resize(((size_t)columns + 4) & ~(size_t)3);
+        const glm::vec3 step = u / (float)columns;
+#if defined(PRIMITIVES_SSE)
+        const __m128 nx = _mm_set1_ps(normal.x);
+        const __m128 ny = _mm_set1_ps(normal.y);
+        const __m128 nz = _mm_set1_ps(normal.z);
+        const __m128 four = _mm_set1_ps(4.0f);
+        __m128 index = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+        for (int j = 0; j <= columns; j += 4)
+        {
+            __m128 px = _mm_add_ps(_mm_set1_ps(origin.x), _mm_mul_ps(index, _mm_set1_ps(step.x)));
+            __m128 py = _mm_add_ps(_mm_set1_ps(origin.y), _mm_mul_ps(index, _mm_set1_ps(step.y)));
+            __m128 pz = _mm_add_ps(_mm_set1_ps(origin.z), _mm_mul_ps(index, _mm_set1_ps(step.z)));
+            StoreRecords(&row[j], px, py, pz, nx, ny, nz);
+            index = _mm_add_ps(index, four);
+        }
+#else
+        for (int j = 0; j < columns; ++j)
+        {
+            const float index = (float)j;
+            SetRecord(row[j], origin.x + index * step.x, origin.y + index * step.y, origin.z + index * step.z, normal.x, normal.y, normal.z);
+        }
+#endif
+
+        // The last vertex lands exactly on the edge, shared with the neighbouring face
+        const glm::vec3 end = origin + u;
+        SetRecord(row[columns], end.x, end.y, end.z, normal.x, normal.y, normal.z);
+    }
+
+    static PrimitiveVertex* Emit(PrimitiveVertex* out, const RowVertex* vertex)
+    {
+        float* destination = out->Position;
+#if defined(PRIMITIVES_SSE)
+        _mm_storeu_ps(destination, _mm_loadu_ps(vertex->Data));
+        _mm_storel_pi((__m64*)(destination + 4), _mm_loadu_ps(vertex->Data + 4));
+#else
+        std::memcpy(destination, vertex->Data, 6 * sizeof(float));
+#endif
+        return out + 1;
+    }
+
+    // Triangles between the lower and the upper row; a, b on the lower row and c, d above them
+    PrimitiveVertex* EmitBand(PrimitiveVertex* out, int segments, Band_Kind kind) const
+    {
+        for (int j = 0; j < segments; ++j)
+        {
+            const RowVertex* a = &lower[j];
+            const RowVertex* b = a + 1;
+            const RowVertex* d = &upper[j];
+            const RowVertex* c = d + 1;
+            if (kind != BAND_LOWER_POLE)
+            {
+                out = Emit(out, a);
+                out = Emit(out, b);
+                out = Emit(out, c);
+            }
+            if (kind != BAND_UPPER_POLE)
+            {
+                out = Emit(out, a);
+                out = Emit(out, c);
+                out = Emit(out, d);
+            }
+        }
+        return out;
+    }
+
+    // Grid of columns * rows tiles spanning origin + u * s + v * t, facing along u x v
+    PrimitiveVertex* Face(PrimitiveVertex* out, int columns, int rows, const glm::vec3& origin, const glm::vec3& u, const glm::vec3& v)
+    {
+        const glm::vec3 normal = glm::normalize(glm::cross(u, v));
+        LinearRow(lower, columns, origin, u, normal);
+        for (int row = 1; row <= rows; ++row)
+        {
+            LinearRow(upper, columns, row == rows ? origin + v : origin + v * ((float)row / rows), u, normal);
+            out = EmitBand(out, columns, BAND_QUADS);
+            lower.swap(upper);
+        }
+        return out;
+    }
+};
+#endif
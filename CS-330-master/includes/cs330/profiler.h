@@ -0,0 +1,260 @@
+/* Frame profiler: scoped CPU timers, GPU GL_TIME_ELAPSED queries and Chrome trace export.
+
+CPU scopes are timed with std::chrono. GPU scopes use GL_TIME_ELAPSED queries
+kept in a ring of QUERY_FRAMES frames; results are only read once GL reports
+them available, so the profiler never stalls the pipeline waiting on the GPU.
+
+While a capture is running every scope is also kept as a trace event, and
+StopCapture writes them as Chrome/Perfetto trace JSON (chrome://tracing or
+ui.perfetto.dev). GPU scopes have no shared clock with the CPU and are drawn at
+the CPU time they were issued, with their measured GPU duration.
+*/
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <GL/glew.h>
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+class Profiler
+{
+public:
+    // Trace tracks
+    enum Track { TRACK_CPU = 1, TRACK_GPU = 2 };
+
+    // Exponential moving averages of the last frames, in milliseconds
+    double CpuFrameMs;
+    double GpuFrameMs;
+
+    Profiler() : CpuFrameMs(0.0), GpuFrameMs(0.0), capturing(false), frameIndex(0), frameStart(0.0), queriesCreated(false)
+    {
+        origin = std::chrono::steady_clock::now();
+    }
+
+    // Deletes the GPU queries; call it while the GL context is still current
+    void Release()
+    {
+        if (queriesCreated)
+        {
+            for (int i = 0; i < QUERY_FRAMES; ++i)
+                glDeleteQueries(MAX_GPU_SCOPES, frames[i].queries);
+            queriesCreated = false;
+        }
+    }
+
+    // Microseconds since the profiler was created
+    double NowUs() const
+    {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin).count();
+    }
+
+    void BeginFrame()
+    {
+        if (!queriesCreated)
+        {
+            for (int i = 0; i < QUERY_FRAMES; ++i)
+            {
+                glGenQueries(MAX_GPU_SCOPES, frames[i].queries);
+                frames[i].count = 0;
+                frames[i].pending = false;
+            }
+            queriesCreated = true;
+        }
+
+        CollectGpuResults();
+
+        GpuFrame& frame = frames[frameIndex % QUERY_FRAMES];
+        frame.count = 0;
+        frame.pending = false;
+        frameStart = NowUs();
+    }
+
+    // Ends the CPU part of the frame; call it before swapping buffers so vsync waits are not counted
+    void EndFrame()
+    {
+        double cpuMs = (NowUs() - frameStart) / 1000.0;
+        CpuFrameMs = CpuFrameMs * 0.9 + cpuMs * 0.1;
+
+        GpuFrame& frame = frames[frameIndex % QUERY_FRAMES];
+        frame.pending = frame.count > 0;
+        ++frameIndex;
+    }
+
+    void AddCpuEvent(const char* name, double startUs, double durationUs)
+    {
+        if (capturing)
+            AddEvent(name, startUs, durationUs, TRACK_CPU);
+    }
+
+    // GL_TIME_ELAPSED scopes cannot nest. Scopes past MAX_GPU_SCOPES in one frame are not timed.
+    int BeginGpuScope(const char* name)
+    {
+        GpuFrame& frame = frames[frameIndex % QUERY_FRAMES];
+        if (!queriesCreated || frame.count == MAX_GPU_SCOPES)
+            return -1;
+
+        int slot = frame.count++;
+        frame.names[slot] = name;
+        frame.issuedUs[slot] = NowUs();
+        glBeginQuery(GL_TIME_ELAPSED, frame.queries[slot]);
+        return slot;
+    }
+
+    void EndGpuScope(int slot)
+    {
+        if (slot >= 0)
+            glEndQuery(GL_TIME_ELAPSED);
+    }
+
+    bool IsCapturing() const { return capturing; }
+
+    void StartCapture()
+    {
+        events.clear();
+        capturing = true;
+    }
+
+    // Writes the captured events as Chrome trace JSON; returns false if the file could not be written
+    bool StopCapture(const char* path)
+    {
+        capturing = false;
+
+        FILE* file = std::fopen(path, "w");
+        if (file == nullptr)
+            return false;
+
+        std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        std::fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"CPU main\"}},\n", TRACK_CPU);
+        std::fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"GPU\"}}", TRACK_GPU);
+        for (size_t i = 0; i < events.size(); ++i)
+        {
+            const Event& event = events[i];
+            std::fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d}",
+                event.name.c_str(), event.track == TRACK_GPU ? "gpu" : "cpu", event.startUs, event.durationUs, event.track);
+        }
+        std::fprintf(file, "\n]}\n");
+        return std::fclose(file) == 0;
+    }
+
+    // Which side limits the frame according to the averaged timings
+    const char* Bound() const
+    {
+        if (GpuFrameMs <= 0.0)
+            return "unknown (no GPU timings yet)";
+        return CpuFrameMs > GpuFrameMs ? "CPU-submission-bound" : "GPU/fill-bound";
+    }
+
+    // Number of events captured so far
+    size_t EventCount() const { return events.size(); }
+
+private:
+    static const int QUERY_FRAMES = 4;
+    static const int MAX_GPU_SCOPES = 8;
+
+    struct Event
+    {
+        std::string name;
+        double startUs;
+        double durationUs;
+        int track;
+    };
+
+    struct GpuFrame
+    {
+        GLuint queries[MAX_GPU_SCOPES];
+        const char* names[MAX_GPU_SCOPES];
+        double issuedUs[MAX_GPU_SCOPES];
+        int count;
+        bool pending;
+    };
+
+    std::chrono::steady_clock::time_point origin;
+    std::vector<Event> events;
+    bool capturing;
+
+    GpuFrame frames[QUERY_FRAMES];
+    unsigned frameIndex;
+    double frameStart;
+    bool queriesCreated;
+
+    void AddEvent(const char* name, double startUs, double durationUs, int track)
+    {
+        Event event;
+        event.name = name;
+        event.startUs = startUs;
+        event.durationUs = durationUs;
+        event.track = track;
+        events.push_back(event);
+    }
+
+    // Reads every finished frame in the ring, oldest first, without waiting
+    void CollectGpuResults()
+    {
+        for (unsigned age = QUERY_FRAMES - 1; age > 0; --age)
+        {
+            if (frameIndex < age)
+                continue;
+
+            GpuFrame& frame = frames[(frameIndex - age) % QUERY_FRAMES];
+            if (!frame.pending)
+                continue;
+
+            GLint available = 0;
+            glGetQueryObjectiv(frame.queries[frame.count - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                return; // later frames cannot be ready either
+
+            double gpuMs = 0.0;
+            for (int slot = 0; slot < frame.count; ++slot)
+            {
+                GLuint64 elapsedNs = 0;
+                glGetQueryObjectui64v(frame.queries[slot], GL_QUERY_RESULT, &elapsedNs);
+                gpuMs += elapsedNs / 1.0e6;
+                if (capturing)
+                    AddEvent(frame.names[slot], frame.issuedUs[slot], elapsedNs / 1.0e3, TRACK_GPU);
+            }
+            GpuFrameMs = GpuFrameMs * 0.9 + gpuMs * 0.1;
+            frame.pending = false;
+        }
+    }
+
+    Profiler(const Profiler&);
+    Profiler& operator=(const Profiler&);
+};
+
+
+// Times the enclosing scope on the CPU
+class CpuScope
+{
+public:
+    CpuScope(Profiler& profiler, const char* name) : profiler(profiler), name(name), start(profiler.NowUs()) {}
+    ~CpuScope() { profiler.AddCpuEvent(name, start, profiler.NowUs() - start); }
+
+private:
+    Profiler& profiler;
+    const char* name;
+    double start;
+
+    CpuScope(const CpuScope&);
+    CpuScope& operator=(const CpuScope&);
+};
+
+// Times the enclosing scope on the GPU
+class GpuScope
+{
+public:
+    GpuScope(Profiler& profiler, const char* name) : profiler(profiler), slot(profiler.BeginGpuScope(name)) {}
+    ~GpuScope() { profiler.EndGpuScope(slot); }
+
+private:
+    Profiler& profiler;
+    int slot;
+
+    GpuScope(const GpuScope&);
+    GpuScope& operator=(const GpuScope&);
+};
+#endif
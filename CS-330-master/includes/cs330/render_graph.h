@@ -0,0 +1,531 @@
+/* Declarative frame graph: passes declare the textures they read and write, the graph does the rest.
+
+Each frame the graph is rebuilt: Reset, CreateTexture for the transient
+targets, ImportTexture for the ones owned elsewhere (texture 0 is the window),
+AddPass for each pass with its reads, writes and the function drawing it,
+then Compile and Execute.
+
+Compile
+- culls the passes whose writes nobody reads. Imported textures are the
+  outputs; reference counts propagate from them, so a pass feeding only a
+  culled pass is culled too.
+- orders the live passes: a texture's writers run in declaration order, and
+  its readers after all of them. Among the passes that are ready, the one
+  declared first goes first. It fails on a cycle.
+- gives each transient texture the lifetime between its first and last use
+  in that order, and maps the textures onto physical ones. Two textures of
+  the same size and format share one physical texture when their lifetimes
+  do not overlap. GL has no memory aliasing between differently typed
+  textures, so this is the sharing it can do.
+- reports the memory of the physical textures against one texture per
+  declared one, which is what allocating each target up front would take.
+
+Compile makes no GL calls. Execute takes the physical textures from a pool
+that persists across frames. It frees pool textures unused for POOL_FRAMES
+frames and creates missing ones with glTexStorage2D. Before each pass it
+binds a cached framebuffer with the pass's writes attached and sets the
+viewport to their size. A pass writing the window writes nothing else.
+*/
+
+#ifndef RENDER_GRAPH_H
+#define RENDER_GRAPH_H
+
+#include <GL/glew.h>
+
+#include <cs330/gl_state_cache.h>
+
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <vector>
+
+class RenderGraph
+{
+public:
+    typedef std::function<void()> PassFunction;
+
+    static const int MAX_COLOR_TARGETS = 4;
+    static const unsigned POOL_FRAMES = 3;
+
+    // Report of the last Compile
+    int LivePasses;
+    int CulledPasses;
+    int TransientTextures;      // transient textures used by the live passes
+    int PhysicalTextures;       // textures they were mapped onto
+    size_t GraphBytes;          // memory of the physical textures
+    size_t NaiveBytes;          // memory with one texture per declared texture, culled or not
+    // Textures the pool created since the start
+    unsigned Allocations;
+
+    RenderGraph() : LivePasses(0), CulledPasses(0), TransientTextures(0), PhysicalTextures(0), GraphBytes(0), NaiveBytes(0), Allocations(0), frame(0) {}
+
+    // Deletes the pooled textures and the cached framebuffers
+    void Release()
+    {
+        for (size_t i = 0; i < pool.size(); ++i)
+            glDeleteTextures(1, &pool[i].Texture);
+        for (size_t i = 0; i < framebuffers.size(); ++i)
+            glDeleteFramebuffers(1, &framebuffers[i].Id);
+        pool.clear();
+        framebuffers.clear();
+    }
+
+    // Forgets the passes and textures of the last frame; the pool stays
+    void Reset()
+    {
+        passes.clear();
+        resources.clear();
+        physicals.clear();
+        order.clear();
+    }
+
+    int CreateTexture(const char* name, int width, int height, GLenum format)
+    {
+        Resource resource = { name, width, height, format, false, 0, NO_PHYSICAL, 0, -1, -1 };
+        resources.push_back(resource);
+        return (int)resources.size() - 1;
+    }
+
+    // A texture owned elsewhere, kept alive by the graph; 0 is the window's framebuffer
+    int ImportTexture(const char* name, GLuint texture, int width, int height, GLenum format)
+    {
+        Resource resource = { name, width, height, format, true, texture, NO_PHYSICAL, 0, -1, -1 };
+        resources.push_back(resource);
+        return (int)resources.size() - 1;
+    }
+
+    int AddPass(const char* name, std::initializer_list<int> reads, std::initializer_list<int> writes, PassFunction execute)
+    {
+        Pass pass;
+        pass.Name = name;
+        pass.Reads.assign(reads.begin(), reads.end());
+        pass.Writes.assign(writes.begin(), writes.end());
+        pass.Execute = execute;
+        pass.RefCount = 0;
+        pass.Culled = false;
+        passes.push_back(pass);
+        return (int)passes.size() - 1;
+    }
+
+    // Culls, orders and maps the transient textures; false on a dependency cycle
+    bool Compile()
+    {
+        order.clear();
+        physicals.clear();
+        Cull();
+        if (!Order())
+            return false;
+        Alias();
+        return true;
+    }
+
+    // Runs the live passes in order, each on a framebuffer with its writes attached
+    void Execute(GLStateCache& state)
+    {
+        ++frame;
+        for (size_t i = 0; i < pool.size(); ++i)
+            pool[i].Claimed = false;
+        for (size_t i = 0; i < physicals.size(); ++i)
+            physicals[i].Texture = Acquire(state, physicals[i].Width, physicals[i].Height, physicals[i].Format);
+        for (size_t i = 0; i < resources.size(); ++i)
+        {
+            if (resources[i].Physical != NO_PHYSICAL)
+                resources[i].Texture = physicals[resources[i].Physical].Texture;
+        }
+
+        for (size_t i = 0; i < order.size(); ++i)
+        {
+            Pass& pass = passes[order[i]];
+            BindTargets(pass);
+            if (pass.Execute)
+                pass.Execute();
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        Trim();
+    }
+
+    // The GL texture of a resource, valid during Execute
+    GLuint Texture(int resource) const { return resources[resource].Texture; }
+
+    // Live passes in execution order
+    const std::vector<int>& ExecutionOrder() const { return order; }
+    const char* PassName(int pass) const { return passes[pass].Name; }
+
+    static size_t TextureBytes(int width, int height, GLenum format)
+    {
+        size_t texelBytes = 4;
+        switch (format)
+        {
+        case GL_R8: texelBytes = 1; break;
+        case GL_RG8: case GL_R16F: case GL_DEPTH_COMPONENT16: texelBytes = 2; break;
+        case GL_RG16F: case GL_R32F: case GL_RGBA8: case GL_RGB10_A2: case GL_R11F_G11F_B10F:
+        case GL_DEPTH_COMPONENT24: case GL_DEPTH_COMPONENT32F: case GL_DEPTH24_STENCIL8: texelBytes = 4; break;
+        case GL_RGBA16F: case GL_RG32F: case GL_DEPTH32F_STENCIL8: texelBytes = 8; break;
+        case GL_RGBA32F: texelBytes = 16; break;
+        default: break;
+        }
+        return (size_t)width * (size_t)height * texelBytes;
+    }
+
+private:
+    enum { NO_PHYSICAL = -1 };
+
+    struct Resource
+    {
+        const char* Name;
+        int Width;
+        int Height;
+        GLenum Format;
+        bool Imported;
+        GLuint Texture;
+        int Physical;           // index into physicals, NO_PHYSICAL for imported or unused textures
+        int RefCount;
+        int FirstUse;           // positions in order
+        int LastUse;
+    };
+
+    struct Pass
+    {
+        const char* Name;
+        std::vector<int> Reads;
+        std::vector<int> Writes;
+        PassFunction Execute;
+        int RefCount;
+        bool Culled;
+    };
+
+    struct Physical
+    {
+        int Width;
+        int Height;
+        GLenum Format;
+        int LastUse;
+        GLuint Texture;
+    };
+
+    struct PooledTexture
+    {
+        int Width;
+        int Height;
+        GLenum Format;
+        GLuint Texture;
+        unsigned LastFrame;
+        bool Claimed;
+    };
+
+    struct CachedFramebuffer
+    {
+        GLuint Id;
+        GLuint Colors[MAX_COLOR_TARGETS];
+        int ColorCount;
+        GLuint Depth;
+    };
+
+    std::vector<Pass> passes;
+    std::vector<Resource> resources;
+    std::vector<Physical> physicals;
+    std::vector<int> order;
+    std::vector<PooledTexture> pool;
+    std::vector<CachedFramebuffer> framebuffers;
+    unsigned frame;
+
+    static bool IsDepthFormat(GLenum format)
+    {
+        return format == GL_DEPTH_COMPONENT16 || format == GL_DEPTH_COMPONENT24 || format == GL_DEPTH_COMPONENT32F
+            || format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8;
+    }
+
+    // Reference counting from the outputs: a pass counts its writes, a texture its readers
+    void Cull()
+    {
+        for (size_t i = 0; i < resources.size(); ++i)
+            resources[i].RefCount = resources[i].Imported ? 1 : 0;
+        for (size_t i = 0; i < passes.size(); ++i)
+        {
+            passes[i].RefCount = (int)passes[i].Writes.size();
+            passes[i].Culled = false;
+            for (size_t j = 0; j < passes[i].Reads.size(); ++j)
+                ++resources[passes[i].Reads[j]].RefCount;
+        }
+
+        std::vector<int> unread;
+        for (size_t i = 0; i < resources.size(); ++i)
+        {
+            if (resources[i].RefCount == 0)
+                unread.push_back((int)i);
+        }
+        while (!unread.empty())
+        {
+            int resource = unread.back();
+            unread.pop_back();
+            for (size_t i = 0; i < passes.size(); ++i)
+            {
+                Pass& pass = passes[i];
+                if (pass.Culled || !Contains(pass.Writes, resource) || --pass.RefCount > 0)
+                    continue;
+                pass.Culled = true;
+                for (size_t j = 0; j < pass.Reads.size(); ++j)
+                {
+                    if (--resources[pass.Reads[j]].RefCount == 0)
+                        unread.push_back(pass.Reads[j]);
+                }
+            }
+        }
+
+        LivePasses = CulledPasses = 0;
+        for (size_t i = 0; i < passes.size(); ++i)
+            ++(passes[i].Culled ? CulledPasses : LivePasses);
+    }
+
+    // Kahn's algorithm over the live passes, taking the first declared of the ready ones
+    bool Order()
+    {
+        const int count = (int)passes.size();
+        std::vector<std::vector<int> > next(count);
+        std::vector<int> pending(count, 0);
+        for (int i = 0; i < count; ++i)
+        {
+            if (passes[i].Culled)
+                continue;
+            for (int j = i + 1; j < count; ++j)
+            {
+                if (passes[j].Culled)
+                    continue;
+                // Writers of a texture in declaration order, its readers after every writer
+                bool before = false, after = false;
+                for (size_t w = 0; w < passes[i].Writes.size(); ++w)
+                {
+                    int resource = passes[i].Writes[w];
+                    before = before || Contains(passes[j].Writes, resource) || Contains(passes[j].Reads, resource);
+                }
+                for (size_t w = 0; w < passes[j].Writes.size(); ++w)
+                    after = after || Contains(passes[i].Reads, passes[j].Writes[w]);
+                // Both ways is a cycle, which the ordering below reports
+                if (after)
+                {
+                    next[j].push_back(i);
+                    ++pending[i];
+                }
+                if (before)
+                {
+                    next[i].push_back(j);
+                    ++pending[j];
+                }
+            }
+        }
+
+        std::vector<bool> done(count, false);
+        for (int placed = 0; placed < LivePasses; ++placed)
+        {
+            int ready = 0;
+            while (ready < count && (passes[ready].Culled || done[ready] || pending[ready] > 0))
+                ++ready;
+            if (ready == count)
+            {
+                order.clear();
+                return false;
+            }
+            done[ready] = true;
+            order.push_back(ready);
+            for (size_t k = 0; k < next[ready].size(); ++k)
+                --pending[next[ready][k]];
+        }
+        return true;
+    }
+
+    // Lifetimes in execution order, then each transient texture on the first free physical texture of its size and format
+    void Alias()
+    {
+        for (size_t i = 0; i < resources.size(); ++i)
+        {
+            resources[i].FirstUse = resources[i].LastUse = -1;
+            resources[i].Physical = NO_PHYSICAL;
+        }
+        for (int position = 0; position < (int)order.size(); ++position)
+        {
+            const Pass& pass = passes[order[position]];
+            for (int list = 0; list < 2; ++list)
+            {
+                const std::vector<int>& used = list == 0 ? pass.Reads : pass.Writes;
+                for (size_t i = 0; i < used.size(); ++i)
+                {
+                    Resource& resource = resources[used[i]];
+                    if (resource.FirstUse < 0)
+                        resource.FirstUse = position;
+                    resource.LastUse = position > resource.LastUse ? position : resource.LastUse;
+                }
+            }
+        }
+
+        TransientTextures = 0;
+        NaiveBytes = GraphBytes = 0;
+        for (size_t i = 0; i < resources.size(); ++i)
+        {
+            if (!resources[i].Imported)
+                NaiveBytes += TextureBytes(resources[i].Width, resources[i].Height, resources[i].Format);
+        }
+        for (int position = 0; position < (int)order.size(); ++position)
+        {
+            for (size_t i = 0; i < resources.size(); ++i)
+            {
+                Resource& resource = resources[i];
+                if (resource.Imported || resource.FirstUse != position)
+                    continue;
+                ++TransientTextures;
+
+                for (size_t p = 0; p < physicals.size() && resource.Physical == NO_PHYSICAL; ++p)
+                {
+                    Physical& physical = physicals[p];
+                    if (physical.LastUse < position && physical.Width == resource.Width && physical.Height == resource.Height && physical.Format == resource.Format)
+                        resource.Physical = (int)p;
+                }
+                if (resource.Physical == NO_PHYSICAL)
+                {
+                    Physical physical = { resource.Width, resource.Height, resource.Format, -1, 0 };
+                    physicals.push_back(physical);
+                    resource.Physical = (int)physicals.size() - 1;
+                    GraphBytes += TextureBytes(resource.Width, resource.Height, resource.Format);
+                }
+                physicals[resource.Physical].LastUse = resource.LastUse;
+            }
+        }
+        PhysicalTextures = (int)physicals.size();
+    }
+
+    // An unclaimed pool texture of that size and format, created if there is none
+    GLuint Acquire(GLStateCache& state, int width, int height, GLenum format)
+    {
+        for (size_t i = 0; i < pool.size(); ++i)
+        {
+            PooledTexture& pooled = pool[i];
+            if (!pooled.Claimed && pooled.Width == width && pooled.Height == height && pooled.Format == format)
+            {
+                pooled.Claimed = true;
+                pooled.LastFrame = frame;
+                return pooled.Texture;
+            }
+        }
+
+        PooledTexture pooled = { width, height, format, 0, frame, true };
+        glGenTextures(1, &pooled.Texture);
+        state.BindTexture(0, pooled.Texture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, format, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        pool.push_back(pooled);
+        ++Allocations;
+        return pooled.Texture;
+    }
+
+    // Deletes the pool textures unused for POOL_FRAMES frames, and the framebuffers they were attached to
+    void Trim()
+    {
+        for (size_t i = 0; i < pool.size(); )
+        {
+            if (frame - pool[i].LastFrame <= POOL_FRAMES)
+            {
+                ++i;
+                continue;
+            }
+            GLuint texture = pool[i].Texture;
+            for (size_t f = 0; f < framebuffers.size(); )
+            {
+                CachedFramebuffer& cached = framebuffers[f];
+                bool attached = cached.Depth == texture;
+                for (int c = 0; c < cached.ColorCount; ++c)
+                    attached = attached || cached.Colors[c] == texture;
+                if (attached)
+                {
+                    glDeleteFramebuffers(1, &cached.Id);
+                    framebuffers[f] = framebuffers.back();
+                    framebuffers.pop_back();
+                }
+                else
+                    ++f;
+            }
+            glDeleteTextures(1, &texture);
+            pool[i] = pool.back();
+            pool.pop_back();
+        }
+    }
+
+    // Binds the window or a framebuffer with the pass's writes attached, with a viewport covering them
+    void BindTargets(const Pass& pass)
+    {
+        if (pass.Writes.empty())
+            return;
+
+        CachedFramebuffer key = { 0, { 0 }, 0, 0 };
+        GLenum depthFormat = GL_NONE;
+        for (size_t i = 0; i < pass.Writes.size(); ++i)
+        {
+            const Resource& resource = resources[pass.Writes[i]];
+            if (resource.Imported && resource.Texture == 0)
+            {
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                glViewport(0, 0, resource.Width, resource.Height);
+                return;
+            }
+            if (IsDepthFormat(resource.Format))
+            {
+                key.Depth = resource.Texture;
+                depthFormat = resource.Format;
+            }
+            else if (key.ColorCount < MAX_COLOR_TARGETS)
+                key.Colors[key.ColorCount++] = resource.Texture;
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, FindFramebuffer(key, depthFormat));
+        const Resource& first = resources[pass.Writes[0]];
+        glViewport(0, 0, first.Width, first.Height);
+    }
+
+    GLuint FindFramebuffer(CachedFramebuffer& key, GLenum depthFormat)
+    {
+        for (size_t i = 0; i < framebuffers.size(); ++i)
+        {
+            const CachedFramebuffer& cached = framebuffers[i];
+            bool same = cached.Depth == key.Depth && cached.ColorCount == key.ColorCount;
+            for (int c = 0; same && c < key.ColorCount; ++c)
+                same = cached.Colors[c] == key.Colors[c];
+            if (same)
+                return cached.Id;
+        }
+
+        glGenFramebuffers(1, &key.Id);
+        glBindFramebuffer(GL_FRAMEBUFFER, key.Id);
+        GLenum drawBuffers[MAX_COLOR_TARGETS];
+        for (int c = 0; c < key.ColorCount; ++c)
+        {
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + c, GL_TEXTURE_2D, key.Colors[c], 0);
+            drawBuffers[c] = GL_COLOR_ATTACHMENT0 + c;
+        }
+        if (key.Depth != 0)
+        {
+            GLenum attachment = depthFormat == GL_DEPTH24_STENCIL8 || depthFormat == GL_DEPTH32F_STENCIL8 ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+            glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, key.Depth, 0);
+        }
+        if (key.ColorCount > 0)
+            glDrawBuffers(key.ColorCount, drawBuffers);
+        else
+            glDrawBuffer(GL_NONE);
+        framebuffers.push_back(key);
+        return key.Id;
+    }
+
+    static bool Contains(const std::vector<int>& list, int value)
+    {
+        for (size_t i = 0; i < list.size(); ++i)
+        {
+            if (list[i] == value)
+                return true;
+        }
+        return false;
+    }
+
+    RenderGraph(const RenderGraph&);
+    RenderGraph& operator=(const RenderGraph&);
+};
+#endif
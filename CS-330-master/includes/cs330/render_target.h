@@ -0,0 +1,111 @@
+/* Offscreen framebuffer with a color texture and a depth texture of a chosen format.
+
+The window's default framebuffer comes with whatever depth buffer the window
+system picked, usually 24-bit fixed point. Rendering the scene into a
+RenderTarget lets it use GL_DEPTH_COMPONENT32F, which reversed-Z needs to keep
+its precision far from the camera; the color is blitted to the window at the
+end of the frame.
+*/
+
+#ifndef RENDER_TARGET_H
+#define RENDER_TARGET_H
+
+#include <GL/glew.h>
+
+#include <iostream>
+
+class RenderTarget
+{
+public:
+    GLuint Framebuffer;
+    GLuint ColorTexture;
+    GLuint DepthTexture;
+    int Width;
+    int Height;
+
+    RenderTarget() : Framebuffer(0), ColorTexture(0), DepthTexture(0), Width(0), Height(0), depthFormat(GL_DEPTH_COMPONENT32F) {}
+
+    // Creates the framebuffer; returns false and prints the status if it is incomplete
+    bool Create(int width, int height, GLenum depthFormat = GL_DEPTH_COMPONENT32F)
+    {
+        Release();
+        this->depthFormat = depthFormat;
+        Width = width > 0 ? width : 1;
+        Height = height > 0 ? height : 1;
+
+        glGenTextures(1, &ColorTexture);
+        glBindTexture(GL_TEXTURE_2D, ColorTexture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, Width, Height);
+        SetSampling();
+
+        glGenTextures(1, &DepthTexture);
+        glBindTexture(GL_TEXTURE_2D, DepthTexture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, depthFormat, Width, Height);
+        SetSampling();
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenFramebuffers(1, &Framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, Framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, ColorTexture, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, DepthTexture, 0);
+
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (status != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cerr << "ERROR::FRAMEBUFFER::INCOMPLETE status 0x" << std::hex << status << std::dec << std::endl;
+            Release();
+            return false;
+        }
+        return true;
+    }
+
+    // Recreates the attachments when the size changed; texture storage is immutable
+    bool Resize(int width, int height)
+    {
+        if (width == Width && height == Height && Framebuffer != 0)
+            return true;
+        return Create(width, height, depthFormat);
+    }
+
+    // Deletes the GL objects; call it while the GL context is still current
+    void Release()
+    {
+        glDeleteFramebuffers(1, &Framebuffer);
+        glDeleteTextures(1, &ColorTexture);
+        glDeleteTextures(1, &DepthTexture);
+        Framebuffer = ColorTexture = DepthTexture = 0;
+    }
+
+    // Makes the target the draw and read framebuffer and covers it with the viewport
+    void Bind() const
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, Framebuffer);
+        glViewport(0, 0, Width, Height);
+    }
+
+    // Copies the color to the window's framebuffer and binds it back
+    void BlitToDefault(int width, int height) const
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, Framebuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, Width, Height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, width, height);
+    }
+
+private:
+    GLenum depthFormat;
+
+    static void SetSampling()
+    {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+
+    RenderTarget(const RenderTarget&);
+    RenderTarget& operator=(const RenderTarget&);
+};
+#endif
@@ -0,0 +1,463 @@
+/* Scene description: a list of primitives with transform and color.
+
+Scenes come in two forms holding the same records:
+
+Text (.scene), for editing by hand. One statement per line, # starts a comment:
+
+    <primitive> [position x y z] [rotation ax ay az degrees] [orientation x y z w]
+                [scale x y z] [size s] [radius r] [from x y z to x y z]
+                [color r g b] [angle degrees]
+
+    primitive: plane, cube, cylinder, sphere, rounded_cube
+    size       uniform scale
+    radius     sphere scale, or cylinder x/z scale
+    from, to   cylinder end points; sets its position, orientation and length
+    angle      rounded cube edge angle (see UDrawRoundedCube); rounded cubes ignore rotation
+
+The renderer lights every object the same way, so a scene carries no
+materials; the color is all an object has.
+
+Binary (.sceneb), for loading. A SceneHeader followed by the SceneObject array
+at a 64-byte aligned offset, little-endian. The file is mapped read-only and
+the array is used in place: loading is a header check and a pointer cast,
+whatever the number of objects.
+*/
+
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cs330/affine_transform.h>
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+enum Scene_Primitive {
+    SCENE_PLANE,
+    SCENE_CUBE,
+    SCENE_CYLINDER,
+    SCENE_SPHERE,
+    SCENE_ROUNDED_CUBE,
+    SCENE_PRIMITIVE_COUNT
+};
+
+// One object; 64 bytes, a cache line
+struct SceneObject
+{
+    float Position[3];
+    uint32_t Primitive;     // Scene_Primitive
+    float Rotation[4];      // unit quaternion x, y, z, w
+    float Scale[3];
+    uint32_t Reserved;      // 0
+    float Color[3];
+    float Parameter;        // rounded cube edge angle in radians
+};
+
+struct SceneHeader
+{
+    char Magic[4];          // "CSSC"
+    uint32_t Version;
+    uint32_t ObjectCount;
+    uint32_t Reserved;      // 0
+    uint64_t ObjectsOffset;
+};
+
+static_assert(sizeof(SceneObject) == 64, "SceneObject is part of the binary scene format");
+static_assert(sizeof(SceneHeader) == 24, "SceneHeader is part of the binary scene format");
+
+// Version 1 also carried a material table
+const uint32_t SCENE_BINARY_VERSION = 2;
+
+// Model matrix of an object: translation * rotation * scale
+inline glm::mat4 SceneModelMatrix(const SceneObject& object)
+{
+    glm::quat rotation(object.Rotation[3], object.Rotation[0], object.Rotation[1], object.Rotation[2]);
+    glm::mat4 model = glm::mat4_cast(rotation);
+    model[0] *= object.Scale[0];
+    model[1] *= object.Scale[1];
+    model[2] *= object.Scale[2];
+    model[3] = glm::vec4(object.Position[0], object.Position[1], object.Position[2], 1.0f);
+    return model;
+}
+
+// The same transform as affine rows, built without the matrix
+inline Affine3x4 SceneAffine(const SceneObject& object)
+{
+    glm::quat rotation(object.Rotation[3], object.Rotation[0], object.Rotation[1], object.Rotation[2]);
+    return Affine3x4::FromTRS(glm::vec3(object.Position[0], object.Position[1], object.Position[2]), rotation,
+        glm::vec3(object.Scale[0], object.Scale[1], object.Scale[2]));
+}
+
+inline const char* ScenePrimitiveName(uint32_t primitive)
+{
+    static const char* const names[SCENE_PRIMITIVE_COUNT] = { "plane", "cube", "cylinder", "sphere", "rounded_cube" };
+    return primitive < SCENE_PRIMITIVE_COUNT ? names[primitive] : "?";
+}
+
+// An object at the origin with no rotation, unit scale and white color
+inline SceneObject MakeSceneObject(Scene_Primitive primitive)
+{
+    SceneObject object;
+    std::memset(&object, 0, sizeof(object));
+    object.Primitive = primitive;
+    object.Rotation[3] = 1.0f;
+    object.Scale[0] = object.Scale[1] = object.Scale[2] = 1.0f;
+    object.Color[0] = object.Color[1] = object.Color[2] = 1.0f;
+    return object;
+}
+
+
+// Writes the text form; returns false if the file could not be written
+inline bool WriteSceneText(const char* path, const SceneObject* objects, size_t objectCount)
+{
+    FILE* file = std::fopen(path, "w");
+    if (file == nullptr)
+        return false;
+
+    for (size_t i = 0; i < objectCount; ++i)
+    {
+        const SceneObject& o = objects[i];
+        std::fprintf(file, "%s position %g %g %g orientation %g %g %g %g scale %g %g %g color %g %g %g",
+            ScenePrimitiveName(o.Primitive), o.Position[0], o.Position[1], o.Position[2],
+            o.Rotation[0], o.Rotation[1], o.Rotation[2], o.Rotation[3], o.Scale[0], o.Scale[1], o.Scale[2],
+            o.Color[0], o.Color[1], o.Color[2]);
+        if (o.Parameter != 0.0f)
+            std::fprintf(file, " angle %g", glm::degrees(o.Parameter));
+        std::fputc('\n', file);
+    }
+    return std::fclose(file) == 0;
+}
+
+// Writes the binary form; returns false if the file could not be written
+inline bool WriteSceneBinary(const char* path, const SceneObject* objects, size_t objectCount)
+{
+    SceneHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.Magic, "CSSC", 4);
+    header.Version = SCENE_BINARY_VERSION;
+    header.ObjectCount = (uint32_t)objectCount;
+    header.ObjectsOffset = 64;
+
+    FILE* file = std::fopen(path, "wb");
+    if (file == nullptr)
+        return false;
+
+    static const char padding[64] = { 0 };
+    bool written = std::fwrite(&header, sizeof(header), 1, file) == 1
+        && std::fwrite(padding, 1, header.ObjectsOffset - sizeof(header), file) == header.ObjectsOffset - sizeof(header)
+        && (objectCount == 0 || std::fwrite(objects, sizeof(SceneObject), objectCount, file) == objectCount);
+    return std::fclose(file) == 0 && written;
+}
+
+
+class Scene
+{
+public:
+    // Views of the loaded scene, valid until Release or the next Load
+    const SceneObject* Objects;
+    uint32_t ObjectCount;
+
+    Scene() : Objects(nullptr), ObjectCount(0), mapping(nullptr), mappingSize(0) {}
+    ~Scene() { Release(); }
+
+    // Loads either form, told apart by the binary magic
+    bool Load(const char* path)
+    {
+        char magic[4] = { 0 };
+        FILE* file = std::fopen(path, "rb");
+        if (file == nullptr)
+        {
+            std::cerr << "ERROR::SCENE::cannot open " << path << std::endl;
+            return false;
+        }
+        size_t read = std::fread(magic, 1, 4, file);
+        std::fclose(file);
+        return read == 4 && std::memcmp(magic, "CSSC", 4) == 0 ? LoadBinary(path) : LoadText(path);
+    }
+
+    // Maps a binary scene; the objects are used straight from the mapping
+    bool LoadBinary(const char* path)
+    {
+        Release();
+#ifndef _WIN32
+        int descriptor = open(path, O_RDONLY);
+        struct stat status;
+        if (descriptor < 0 || fstat(descriptor, &status) != 0)
+        {
+            if (descriptor >= 0)
+                close(descriptor);
+            std::cerr << "ERROR::SCENE::cannot open " << path << std::endl;
+            return false;
+        }
+        mappingSize = (size_t)status.st_size;
+        void* view = mappingSize > 0 ? mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, descriptor, 0) : MAP_FAILED;
+        close(descriptor);
+        if (view == MAP_FAILED)
+        {
+            mappingSize = 0;
+            std::cerr << "ERROR::SCENE::cannot map " << path << std::endl;
+            return false;
+        }
+        mapping = view;
+#else
+        // No mmap here: read the file into 64-byte aligned memory instead
+        FILE* file = std::fopen(path, "rb");
+        if (file == nullptr)
+        {
+            std::cerr << "ERROR::SCENE::cannot open " << path << std::endl;
+            return false;
+        }
+        std::fseek(file, 0, SEEK_END);
+        mappingSize = (size_t)std::ftell(file);
+        std::fseek(file, 0, SEEK_SET);
+        owned.resize((mappingSize + 63) / 64);
+        mapping = owned.empty() ? nullptr : &owned[0];
+        bool read = mapping != nullptr && std::fread(mapping, 1, mappingSize, file) == mappingSize;
+        std::fclose(file);
+        if (!read)
+        {
+            Release();
+            std::cerr << "ERROR::SCENE::cannot read " << path << std::endl;
+            return false;
+        }
+#endif
+        const char* base = static_cast<const char*>(mapping);
+        const SceneHeader* header = reinterpret_cast<const SceneHeader*>(base);
+        if (mappingSize < sizeof(SceneHeader) || std::memcmp(header->Magic, "CSSC", 4) != 0 || header->Version != SCENE_BINARY_VERSION
+            || header->ObjectsOffset % 64 != 0
+            || header->ObjectsOffset + uint64_t(header->ObjectCount) * sizeof(SceneObject) > mappingSize)
+        {
+            Release();
+            std::cerr << "ERROR::SCENE::" << path << " is not a version " << SCENE_BINARY_VERSION << " binary scene" << std::endl;
+            return false;
+        }
+
+        Objects = reinterpret_cast<const SceneObject*>(base + header->ObjectsOffset);
+        ObjectCount = header->ObjectCount;
+        return true;
+    }
+
+    // Parses a text scene into memory owned by the scene
+    bool LoadText(const char* path)
+    {
+        Release();
+        std::vector<char> text;
+        if (!ReadFile(path, text))
+        {
+            std::cerr << "ERROR::SCENE::cannot read " << path << std::endl;
+            return false;
+        }
+
+        int lineNumber = 0;
+        for (char* line = &text[0]; *line != '\0'; )
+        {
+            char* end = std::strchr(line, '\n');
+            if (end != nullptr)
+                *end = '\0';
+            ++lineNumber;
+            if (!ParseLine(line))
+            {
+                std::cerr << "ERROR::SCENE::" << path << ":" << lineNumber << ": " << error << std::endl;
+                Release();
+                return false;
+            }
+            if (end == nullptr)
+                break;
+            line = end + 1;
+        }
+
+        Objects = textObjects.empty() ? nullptr : &textObjects[0];
+        ObjectCount = (uint32_t)textObjects.size();
+        return true;
+    }
+
+    void Release()
+    {
+#ifndef _WIN32
+        if (mapping != nullptr)
+            munmap(mapping, mappingSize);
+#else
+        owned.clear();
+#endif
+        mapping = nullptr;
+        mappingSize = 0;
+        textObjects.clear();
+        Objects = nullptr;
+        ObjectCount = 0;
+    }
+
+private:
+    struct alignas(64) Block { char bytes[64]; };
+
+    void* mapping;
+    size_t mappingSize;
+#ifdef _WIN32
+    std::vector<Block> owned;
+#endif
+    std::vector<SceneObject> textObjects;
+    const char* error;
+
+    static bool ReadFile(const char* path, std::vector<char>& text)
+    {
+        FILE* file = std::fopen(path, "rb");
+        if (file == nullptr)
+            return false;
+        std::fseek(file, 0, SEEK_END);
+        long size = std::ftell(file);
+        std::fseek(file, 0, SEEK_SET);
+        text.resize(size > 0 ? size + 1 : 1);
+        bool read = size <= 0 || std::fread(&text[0], 1, (size_t)size, file) == (size_t)size;
+        std::fclose(file);
+        text.back() = '\0';
+        return read;
+    }
+
+    // Splits off the next whitespace-separated token; null at the end of the line
+    static char* NextToken(char*& cursor)
+    {
+        while (*cursor == ' ' || *cursor == '\t' || *cursor == '\r')
+            ++cursor;
+        if (*cursor == '\0' || *cursor == '#')
+            return nullptr;
+        char* token = cursor;
+        while (*cursor != '\0' && *cursor != ' ' && *cursor != '\t' && *cursor != '\r')
+            ++cursor;
+        if (*cursor != '\0')
+            *cursor++ = '\0';
+        return token;
+    }
+
+    bool Floats(char*& cursor, float* values, int count)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            char* token = NextToken(cursor);
+            char* end = nullptr;
+            values[i] = token != nullptr ? std::strtof(token, &end) : 0.0f;
+            if (token == nullptr || *end != '\0')
+            {
+                error = "expected a number";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool ParseLine(char* cursor)
+    {
+        char* keyword = NextToken(cursor);
+        if (keyword == nullptr)
+            return true;
+
+        int primitive = 0;
+        while (primitive < SCENE_PRIMITIVE_COUNT && std::strcmp(keyword, ScenePrimitiveName(primitive)) != 0)
+            ++primitive;
+        if (primitive == SCENE_PRIMITIVE_COUNT)
+        {
+            error = "unknown primitive or statement";
+            return false;
+        }
+
+        SceneObject object = MakeSceneObject((Scene_Primitive)primitive);
+        bool hasFrom = false, hasTo = false;
+        float from[3], to[3], radius = -1.0f;
+        for (char* field = NextToken(cursor); field != nullptr; field = NextToken(cursor))
+        {
+            bool parsed = true;
+            if (std::strcmp(field, "position") == 0)
+                parsed = Floats(cursor, object.Position, 3);
+            else if (std::strcmp(field, "orientation") == 0)
+                parsed = Floats(cursor, object.Rotation, 4);
+            else if (std::strcmp(field, "rotation") == 0)
+            {
+                float axisAngle[4];
+                parsed = Floats(cursor, axisAngle, 4);
+                glm::vec3 axis(axisAngle[0], axisAngle[1], axisAngle[2]);
+                if (parsed && glm::length(axis) > 0.0f)
+                {
+                    glm::quat rotation = glm::angleAxis(glm::radians(axisAngle[3]), glm::normalize(axis));
+                    object.Rotation[0] = rotation.x;
+                    object.Rotation[1] = rotation.y;
+                    object.Rotation[2] = rotation.z;
+                    object.Rotation[3] = rotation.w;
+                }
+            }
+            else if (std::strcmp(field, "scale") == 0)
+                parsed = Floats(cursor, object.Scale, 3);
+            else if (std::strcmp(field, "size") == 0)
+            {
+                parsed = Floats(cursor, object.Scale, 1);
+                object.Scale[1] = object.Scale[2] = object.Scale[0];
+            }
+            else if (std::strcmp(field, "radius") == 0)
+                parsed = Floats(cursor, &radius, 1);
+            else if (std::strcmp(field, "from") == 0)
+                parsed = hasFrom = Floats(cursor, from, 3);
+            else if (std::strcmp(field, "to") == 0)
+                parsed = hasTo = Floats(cursor, to, 3);
+            else if (std::strcmp(field, "color") == 0)
+                parsed = Floats(cursor, object.Color, 3);
+            else if (std::strcmp(field, "angle") == 0)
+            {
+                parsed = Floats(cursor, &object.Parameter, 1);
+                object.Parameter = glm::radians(object.Parameter);
+            }
+            else
+            {
+                error = "unknown field";
+                return false;
+            }
+            if (!parsed)
+                return false;
+        }
+
+        if (radius >= 0.0f)
+        {
+            object.Scale[0] = object.Scale[2] = radius;
+            if (primitive != SCENE_CYLINDER)
+                object.Scale[1] = radius;
+        }
+        if (hasFrom != hasTo || (hasFrom && primitive != SCENE_CYLINDER))
+        {
+            error = "from and to go together, on cylinders only";
+            return false;
+        }
+        if (hasFrom)
+        {
+            // The cylinder mesh is a unit-high cylinder along Y centered on the origin
+            glm::vec3 start(from[0], from[1], from[2]);
+            glm::vec3 end(to[0], to[1], to[2]);
+            float length = glm::distance(start, end);
+            glm::vec3 center = (start + end) * 0.5f;
+            glm::quat rotation = length > 0.0f ? glm::quat(glm::vec3(0.0f, 1.0f, 0.0f), (end - start) / length) : glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+            object.Position[0] = center.x;
+            object.Position[1] = center.y;
+            object.Position[2] = center.z;
+            object.Rotation[0] = rotation.x;
+            object.Rotation[1] = rotation.y;
+            object.Rotation[2] = rotation.z;
+            object.Rotation[3] = rotation.w;
+            object.Scale[1] = length;
+        }
+        textObjects.push_back(object);
+        return true;
+    }
+
+    Scene(const Scene&);
+    Scene& operator=(const Scene&);
+};
+#endif
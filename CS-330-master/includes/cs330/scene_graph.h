@@ -0,0 +1,163 @@
+/* Transform hierarchy with cached world matrices.
+
+Each node has a local position, rotation and scale relative to its parent and
+a world matrix cached from the last Update. Changing a local transform marks
+the node dirty; Update recomputes the world matrices of the dirty nodes and of
+their descendants only, so moving one object among thousands costs the matrices
+of its own subtree, and a frame where nothing moved costs no matrix math at all.
+
+Nodes are stored as parallel arrays indexed by node; the hierarchy is kept as
+parent / first child / next sibling links.
+
+    int chair = graph.AddNode(SceneGraph::NO_NODE, position);
+    int seat = graph.AddNode(chair, glm::vec3(0.0f), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), seatSizes);
+    graph.SetPosition(chair, newPosition);  // marks the chair dirty
+    graph.Update();                         // recomputes the chair and the seat only
+    draw(graph.World(seat));
+*/
+
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+
+class SceneGraph
+{
+public:
+    enum { NO_NODE = -1 };
+
+    SceneGraph() : lastUpdated(0) {}
+
+    // Adds a node under parent (NO_NODE for a root); it is dirty until the next Update
+    int AddNode(int parent, const glm::vec3& position, const glm::quat& rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f), const glm::vec3& scale = glm::vec3(1.0f))
+    {
+        int node = (int)parents.size();
+        parents.push_back(parent);
+        firstChildren.push_back(NO_NODE);
+        nextSiblings.push_back(NO_NODE);
+        if (parent != NO_NODE)
+        {
+            nextSiblings[node] = firstChildren[parent];
+            firstChildren[parent] = node;
+        }
+        positions.push_back(position);
+        rotations.push_back(rotation);
+        scales.push_back(scale);
+        worlds.push_back(glm::mat4(1.0f));
+        dirty.push_back(0);
+        MarkDirty(node);
+        return node;
+    }
+
+    // Local transform setters; setting the current value leaves the node clean
+    void SetPosition(int node, const glm::vec3& position)
+    {
+        if (positions[node] == position)
+            return;
+        positions[node] = position;
+        MarkDirty(node);
+    }
+
+    void SetRotation(int node, const glm::quat& rotation)
+    {
+        if (rotations[node] == rotation)
+            return;
+        rotations[node] = rotation;
+        MarkDirty(node);
+    }
+
+    void SetScale(int node, const glm::vec3& scale)
+    {
+        if (scales[node] == scale)
+            return;
+        scales[node] = scale;
+        MarkDirty(node);
+    }
+
+    const glm::vec3& Position(int node) const { return positions[node]; }
+    const glm::quat& Rotation(int node) const { return rotations[node]; }
+    const glm::vec3& Scale(int node) const { return scales[node]; }
+    int Parent(int node) const { return parents[node]; }
+    int NodeCount() const { return (int)parents.size(); }
+
+    // World matrix as of the last Update
+    const glm::mat4& World(int node) const { return worlds[node]; }
+
+    // Recomputes the world matrices of the dirty subtrees; returns how many were recomputed
+    unsigned Update()
+    {
+        unsigned updated = 0;
+        for (size_t i = 0; i < dirtyNodes.size(); ++i)
+        {
+            int node = dirtyNodes[i];
+            if (!dirty[node])
+                continue;   // already updated with a dirty ancestor
+
+            // Start from the topmost dirty ancestor so every matrix is computed once
+            int top = node;
+            for (int parent = parents[node]; parent != NO_NODE; parent = parents[parent])
+            {
+                if (dirty[parent])
+                    top = parent;
+            }
+
+            stack.push_back(top);
+            while (!stack.empty())
+            {
+                int current = stack.back();
+                stack.pop_back();
+                int parent = parents[current];
+                worlds[current] = parent == NO_NODE ? Local(current) : worlds[parent] * Local(current);
+                dirty[current] = 0;
+                ++updated;
+                for (int child = firstChildren[current]; child != NO_NODE; child = nextSiblings[child])
+                    stack.push_back(child);
+            }
+        }
+        dirtyNodes.clear();
+        lastUpdated = updated;
+        return updated;
+    }
+
+    // World matrices recomputed by the last Update
+    unsigned LastUpdated() const { return lastUpdated; }
+
+private:
+    std::vector<int> parents;
+    std::vector<int> firstChildren;
+    std::vector<int> nextSiblings;
+    std::vector<glm::vec3> positions;
+    std::vector<glm::quat> rotations;
+    std::vector<glm::vec3> scales;
+    std::vector<glm::mat4> worlds;
+    std::vector<unsigned char> dirty;
+    std::vector<int> dirtyNodes;    // nodes marked since the last Update
+    std::vector<int> stack;         // Update traversal, kept to avoid reallocating
+    unsigned lastUpdated;
+
+    void MarkDirty(int node)
+    {
+        if (dirty[node])
+            return;
+        dirty[node] = 1;
+        dirtyNodes.push_back(node);
+    }
+
+    // translation * rotation * scale
+    glm::mat4 Local(int node) const
+    {
+        glm::mat4 local = glm::mat4_cast(rotations[node]);
+        local[0] *= scales[node].x;
+        local[1] *= scales[node].y;
+        local[2] *= scales[node].z;
+        local[3] = glm::vec4(positions[node], 1.0f);
+        return local;
+    }
+
+    SceneGraph(const SceneGraph&);
+    SceneGraph& operator=(const SceneGraph&);
+};
+#endif
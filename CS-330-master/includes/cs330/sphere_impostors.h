@@ -0,0 +1,316 @@
+/* Spheres drawn as ray-cast impostors, with an instanced mesh path to compare against.
+
+Each sphere is four vertices: a quad facing the eye, placed on the plane
+tangent to the sphere at its point nearest the eye and one radius wide in
+every direction, which contains the sphere's silhouette. The fragment shader
+intersects the eye ray with the exact sphere, discards the misses, and writes
+the hit's normal and depth, so the spheres are round at any distance and
+intersect the rest of the scene correctly. The whole sphere lies behind the
+quad, so the written depth is never nearer than the quad's; declaring
+depth_greater keeps the coarse depth test before the fragment shader.
+
+The mesh path draws a unit sphere mesh (position + normal, 6 floats per vertex,
+as UCreateMesh lays them out) once per sphere with the same instance data. The
+mesh is attached separately, so it only has to exist once that path is drawn.
+
+Both paths use a perspective projection with the default -1..1 clip depth.
+*/
+
+#ifndef SPHERE_IMPOSTORS_H
+#define SPHERE_IMPOSTORS_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <cs330/gl_shader.h>
+#include <cs330/gl_state_cache.h>
+
+#ifndef GLSL
+#define GLSL(Version, Source) "#version " #Version " core \n" #Source
+#endif
+
+// One sphere, read as two per-instance attributes
+struct SphereInstance
+{
+    glm::vec4 Sphere;       // world-space center and radius
+    glm::vec4 Color;
+};
+
+class SphereImpostors
+{
+public:
+    SphereImpostors() : impostorProgram(0), meshProgram(0), impostorVao(0), meshVao(0), instanceBuffer(0), meshVertexCount(0), count(0) {}
+
+    // Builds both programs; the mesh path needs AttachMesh before its first draw
+    bool Create()
+    {
+        impostorProgram = CreateShaderProgram(ImpostorVertexSource(), ImpostorFragmentSource(), "SPHERE_IMPOSTOR");
+        meshProgram = CreateShaderProgram(MeshVertexSource(), MeshFragmentSource(), "SPHERE_MESH");
+        if (impostorProgram == 0 || meshProgram == 0)
+            return false;
+        glGenBuffers(1, &instanceBuffer);
+
+        // The impostor corners come from gl_VertexID, so its vertex array only has the instance attributes
+        glGenVertexArrays(1, &impostorVao);
+        glBindVertexArray(impostorVao);
+        AttachInstanceAttributes(0);
+
+        glGenVertexArrays(1, &meshVao);
+        glBindVertexArray(meshVao);
+        AttachInstanceAttributes(2);
+        glBindVertexArray(0);
+
+        Locate(impostorProgram, impostorLocs);
+        Locate(meshProgram, meshLocs);
+        return true;
+    }
+
+    // Gives the mesh path its unit sphere mesh, so the mesh need not exist before it is drawn.
+    // Binds a vertex array directly, so a GLStateCache in use has to be invalidated after it.
+    void AttachMesh(GLuint meshVbo, GLsizei meshVertices)
+    {
+        meshVertexCount = meshVertices;
+        glBindVertexArray(meshVao);
+        glBindBuffer(GL_ARRAY_BUFFER, meshVbo);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, VERTEX_SIZE, (char*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, VERTEX_SIZE, (char*)(sizeof(float) * 3));
+        glEnableVertexAttribArray(1);
+        glBindVertexArray(0);
+    }
+
+    bool HasMesh() const { return meshVertexCount > 0; }
+
+    void Release()
+    {
+        glDeleteProgram(impostorProgram);
+        glDeleteProgram(meshProgram);
+        GLuint vaos[] = { impostorVao, meshVao };
+        glDeleteVertexArrays(2, vaos);
+        glDeleteBuffers(1, &instanceBuffer);
+        impostorProgram = meshProgram = impostorVao = meshVao = instanceBuffer = 0;
+        meshVertexCount = count = 0;
+    }
+
+    // Uploads the spheres. Binds the buffer directly, so a GLStateCache in use has to be invalidated after it.
+    void SetSpheres(const SphereInstance* spheres, GLsizei sphereCount)
+    {
+        count = sphereCount;
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)count * sizeof(SphereInstance), spheres, GL_STATIC_DRAW);
+    }
+
+    // Ray-casts every sphere on its own quad, in one instanced draw
+    void Draw(GLStateCache& state, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& lightPosition, const glm::vec3& lightColor, const glm::vec3& viewPosition)
+    {
+        if (count == 0)
+            return;
+        Bind(state, impostorProgram, impostorLocs, view, projection, lightPosition, lightColor, viewPosition);
+        state.BindVertexArray(impostorVao);
+        state.DrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+    }
+
+    // Draws the attached sphere mesh once per sphere, in one instanced draw
+    void DrawMeshes(GLStateCache& state, const glm::mat4& view, const glm::mat4& projection, const glm::vec3& lightPosition, const glm::vec3& lightColor, const glm::vec3& viewPosition)
+    {
+        if (count == 0)
+            return;
+        Bind(state, meshProgram, meshLocs, view, projection, lightPosition, lightColor, viewPosition);
+        state.BindVertexArray(meshVao);
+        state.DrawArraysInstanced(GL_TRIANGLES, 0, meshVertexCount, count);
+    }
+
+    GLsizei Count() const { return count; }
+    // Vertices a Draw or a DrawMeshes call runs through the vertex shader
+    unsigned ImpostorVertices() const { return 4u * (unsigned)count; }
+    unsigned MeshVertices() const { return (unsigned)meshVertexCount * (unsigned)count; }
+
+private:
+    static const GLsizei VERTEX_SIZE = sizeof(float) * 6;
+
+    struct UniformLocations
+    {
+        GLint View, Projection, LightColor, LightPos, ViewPosition;
+    };
+
+    GLuint impostorProgram;
+    GLuint meshProgram;
+    GLuint impostorVao;
+    GLuint meshVao;
+    GLuint instanceBuffer;
+    UniformLocations impostorLocs;
+    UniformLocations meshLocs;
+    GLsizei meshVertexCount;
+    GLsizei count;
+
+    // Sphere and color of the bound vertex array's instance, at location and location + 1
+    void AttachInstanceAttributes(GLuint location)
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(SphereInstance), (char*)0);
+        glVertexAttribDivisor(location, 1);
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location + 1, 4, GL_FLOAT, GL_FALSE, sizeof(SphereInstance), (char*)sizeof(glm::vec4));
+        glVertexAttribDivisor(location + 1, 1);
+        glEnableVertexAttribArray(location + 1);
+    }
+
+    static void Locate(GLuint program, UniformLocations& locations)
+    {
+        locations.View = glGetUniformLocation(program, "view");
+        locations.Projection = glGetUniformLocation(program, "projection");
+        locations.LightColor = glGetUniformLocation(program, "lightColor");
+        locations.LightPos = glGetUniformLocation(program, "lightPos");
+        locations.ViewPosition = glGetUniformLocation(program, "viewPosition");
+    }
+
+    static void Bind(GLStateCache& state, GLuint program, const UniformLocations& locations, const glm::mat4& view, const glm::mat4& projection,
+        const glm::vec3& lightPosition, const glm::vec3& lightColor, const glm::vec3& viewPosition)
+    {
+        state.UseProgram(program);
+        state.UniformMatrix4fv(locations.View, glm::value_ptr(view));
+        state.UniformMatrix4fv(locations.Projection, glm::value_ptr(projection));
+        state.Uniform3f(locations.LightColor, lightColor.r, lightColor.g, lightColor.b);
+        state.Uniform3f(locations.LightPos, lightPosition.x, lightPosition.y, lightPosition.z);
+        state.Uniform3f(locations.ViewPosition, viewPosition.x, viewPosition.y, viewPosition.z);
+    }
+
+    // Quad corners of a triangle strip, in view space
+    static const char* ImpostorVertexSource()
+    {
+        return GLSL(440,
+            layout(location = 0) in vec4 sphere;
+            layout(location = 1) in vec4 color;
+
+            out vec3 quadPosition;
+            flat out vec4 viewSphere;
+            flat out vec3 sphereColor;
+            flat out vec3 viewLight;
+
+            uniform mat4 view;
+            uniform mat4 projection;
+            uniform vec3 lightPos;
+
+            void main()
+            {
+                vec3 center = vec3(view * vec4(sphere.xyz, 1.0f));
+                float radius = sphere.w;
+
+                // Basis facing the eye along the direction of the center
+                vec3 forward = normalize(center);
+                vec3 worldUp = abs(forward.y) > 0.99f ? vec3(1.0f, 0.0f, 0.0f) : vec3(0.0f, 1.0f, 0.0f);
+                vec3 right = normalize(cross(forward, worldUp));
+                vec3 up = cross(right, forward);
+
+                // Strip order (-1, -1), (1, -1), (-1, 1), (1, 1) on the plane tangent to the near side
+                vec2 corner = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1)) * 2.0f - 1.0f;
+                quadPosition = center - forward * radius + (right * corner.x + up * corner.y) * radius;
+                gl_Position = projection * vec4(quadPosition, 1.0f);
+
+                viewSphere = vec4(center, radius);
+                sphereColor = color.rgb;
+                viewLight = vec3(view * vec4(lightPos, 1.0f));
+            }
+        );
+    }
+
+    // Ray-sphere intersection in view space, where the eye is the origin
+    static const char* ImpostorFragmentSource()
+    {
+        return GLSL(440,
+            in vec3 quadPosition;
+            flat in vec4 viewSphere;
+            flat in vec3 sphereColor;
+            flat in vec3 viewLight;
+
+            layout(depth_greater) out float gl_FragDepth;
+            out vec4 fragmentColor;
+
+            uniform mat4 projection;
+            uniform vec3 lightColor;
+
+            void main()
+            {
+                vec3 ray = normalize(quadPosition);
+                float b = dot(ray, viewSphere.xyz);
+                float h = b * b - dot(viewSphere.xyz, viewSphere.xyz) + viewSphere.w * viewSphere.w;
+                if (h < 0.0f)
+                    discard;
+                vec3 hit = ray * (b - sqrt(h));
+                vec3 norm = (hit - viewSphere.xyz) / viewSphere.w;
+
+                vec4 clip = projection * vec4(hit, 1.0f);
+                gl_FragDepth = 0.5f * (gl_DepthRange.diff * clip.z / clip.w + gl_DepthRange.near + gl_DepthRange.far);
+
+                // Phong lighting of the tut_04_04 fragment shader
+                vec3 ambient = 0.1f * lightColor;
+                vec3 lightDirection = normalize(viewLight - hit);
+                vec3 diffuse = max(dot(norm, lightDirection), 0.0) * lightColor;
+                vec3 reflectDir = reflect(-lightDirection, norm);
+                vec3 specular = 0.8f * pow(max(dot(-ray, reflectDir), 0.0), 16.0f) * lightColor;
+
+                fragmentColor = vec4((ambient + diffuse + specular) * sphereColor, 1.0f);
+            }
+        );
+    }
+
+    static const char* MeshVertexSource()
+    {
+        return GLSL(440,
+            layout(location = 0) in vec3 position;
+            layout(location = 1) in vec3 normal;
+            layout(location = 2) in vec4 sphere;
+            layout(location = 3) in vec4 color;
+
+            out vec3 vertexNormal;
+            out vec3 vertexFragmentPos;
+            out vec3 vertexColor;
+
+            uniform mat4 view;
+            uniform mat4 projection;
+
+            void main()
+            {
+                vertexFragmentPos = sphere.xyz + position * sphere.w;
+                gl_Position = projection * view * vec4(vertexFragmentPos, 1.0f);
+                vertexNormal = normal;
+                vertexColor = color.rgb;
+            }
+        );
+    }
+
+    static const char* MeshFragmentSource()
+    {
+        return GLSL(440,
+            in vec3 vertexNormal;
+            in vec3 vertexFragmentPos;
+            in vec3 vertexColor;
+
+            out vec4 fragmentColor;
+
+            uniform vec3 lightColor;
+            uniform vec3 lightPos;
+            uniform vec3 viewPosition;
+
+            void main()
+            {
+                vec3 ambient = 0.1f * lightColor;
+
+                vec3 norm = normalize(vertexNormal);
+                vec3 lightDirection = normalize(lightPos - vertexFragmentPos);
+                vec3 diffuse = max(dot(norm, lightDirection), 0.0) * lightColor;
+
+                vec3 viewDir = normalize(viewPosition - vertexFragmentPos);
+                vec3 reflectDir = reflect(-lightDirection, norm);
+                vec3 specular = 0.8f * pow(max(dot(viewDir, reflectDir), 0.0), 16.0f) * lightColor;
+
+                fragmentColor = vec4((ambient + diffuse + specular) * vertexColor, 1.0f);
+            }
+        );
+    }
+
+    SphereImpostors(const SphereImpostors&);
+    SphereImpostors& operator=(const SphereImpostors&);
+};
+#endif
@@ -0,0 +1,67 @@
+/* Startup timeline: the time each initialization phase took, up to the first frame on screen.
+
+Phases are marked as they end: Mark(name) closes the phase that began at the
+previous mark, or when the profiler was created. Finish(name) closes the last
+one and stops recording, so marks placed in code that runs every frame only
+count once. Declared as a global, the profiler starts during static
+initialization, before main.
+*/
+
+#ifndef STARTUP_PROFILER_H
+#define STARTUP_PROFILER_H
+
+#include <chrono>
+#include <cstddef>
+#include <vector>
+
+class StartupProfiler
+{
+public:
+    StartupProfiler() : finished(false)
+    {
+        origin = last = std::chrono::steady_clock::now();
+    }
+
+    // Closes the phase running since the previous mark
+    void Mark(const char* name)
+    {
+        if (finished)
+            return;
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        Phase phase = { name, std::chrono::duration<double, std::milli>(now - last).count() };
+        phases.push_back(phase);
+        last = now;
+    }
+
+    // Closes the last phase; later marks are ignored
+    void Finish(const char* name)
+    {
+        Mark(name);
+        finished = true;
+    }
+
+    bool IsFinished() const { return finished; }
+
+    size_t PhaseCount() const { return phases.size(); }
+    const char* PhaseName(size_t phase) const { return phases[phase].Name; }
+    double PhaseMs(size_t phase) const { return phases[phase].Ms; }
+
+    // Milliseconds from the start to the last mark
+    double TotalMs() const { return std::chrono::duration<double, std::milli>(last - origin).count(); }
+
+private:
+    struct Phase
+    {
+        const char* Name;
+        double Ms;
+    };
+
+    std::chrono::steady_clock::time_point origin;
+    std::chrono::steady_clock::time_point last;
+    std::vector<Phase> phases;
+    bool finished;
+
+    StartupProfiler(const StartupProfiler&);
+    StartupProfiler& operator=(const StartupProfiler&);
+};
+#endif
@@ -0,0 +1,148 @@
+/* Ring buffer for data written by the CPU every frame: matrices, instance data, uniform blocks.
+
+One buffer is allocated with glBufferStorage and mapped once, persistent and
+coherent, for its whole life. It is split in FRAMES regions; each frame writes
+into the next region through the mapped pointer, so nothing goes through
+glBufferData/glBufferSubData and the driver makes no copy. A fence placed at
+EndFrame marks when the GPU is done with a region, and BeginFrame waits on it
+before the region is written again. With three regions the CPU can run two
+frames ahead before it has to wait; each wait is counted as a stall.
+
+Allocations are aligned for uniform and storage block binding offsets, so any
+of them can be bound with glBindBufferRange. Coherent mapping makes the writes
+visible to every GL command issued after them.
+*/
+
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include <GL/glew.h>
+
+#include <chrono>
+
+class StreamBuffer
+{
+public:
+    static const int FRAMES = 3;
+
+    // Waits for the GPU at BeginFrame, and the milliseconds spent in them
+    unsigned Stalls;
+    double StallMs;
+    // Allocations refused because the frame's region was full
+    unsigned Overflows;
+    // Bytes allocated during the last finished frame
+    GLsizeiptr LastFrameBytes;
+
+    StreamBuffer() : Stalls(0), StallMs(0.0), Overflows(0), LastFrameBytes(0), buffer(0), mapped(NULL), regionSize(0), alignment(1), region(0), offset(0)
+    {
+        for (int i = 0; i < FRAMES; ++i)
+            fences[i] = 0;
+    }
+
+    // Allocates and maps FRAMES regions of at least bytesPerFrame each
+    bool Create(GLsizeiptr bytesPerFrame)
+    {
+        GLint uniformAlignment = 1, storageAlignment = 1;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlignment);
+        alignment = uniformAlignment > storageAlignment ? uniformAlignment : storageAlignment;
+        regionSize = Align(bytesPerFrame);
+
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferStorage(GL_COPY_WRITE_BUFFER, regionSize * FRAMES, NULL, flags);
+        mapped = (char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, regionSize * FRAMES, flags);
+        return mapped != NULL;
+    }
+
+    void Release()
+    {
+        for (int i = 0; i < FRAMES; ++i)
+        {
+            if (fences[i] != 0)
+                glDeleteSync(fences[i]);
+            fences[i] = 0;
+        }
+        if (mapped != NULL)
+        {
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        }
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+        mapped = NULL;
+    }
+
+    // Waits until the GPU is done with the next region; returns true when it had to wait
+    bool BeginFrame()
+    {
+        offset = 0;
+        GLsync fence = fences[region];
+        if (fence == 0)
+            return false;
+        fences[region] = 0;
+
+        bool stalled = false;
+        GLenum result = glClientWaitSync(fence, 0, 0);
+        if (result == GL_TIMEOUT_EXPIRED)
+        {
+            stalled = true;
+            ++Stalls;
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            // The first wait flushes, in case the fence is still in the command queue
+            GLbitfield waitFlags = GL_SYNC_FLUSH_COMMANDS_BIT;
+            do
+            {
+                result = glClientWaitSync(fence, waitFlags, WAIT_TIMEOUT_NS);
+                waitFlags = 0;
+            } while (result == GL_TIMEOUT_EXPIRED);
+            StallMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+        glDeleteSync(fence);
+        return stalled;
+    }
+
+    // Space for size bytes in this frame's region, or NULL when it is full.
+    // bufferOffset gets the offset of the space in Buffer(), for glBindBufferRange or an attribute pointer.
+    void* Allocate(GLsizeiptr size, GLintptr& bufferOffset)
+    {
+        GLsizeiptr start = Align(offset);
+        if (start + size > regionSize)
+        {
+            ++Overflows;
+            return NULL;
+        }
+        offset = start + size;
+        bufferOffset = (GLintptr)(region * regionSize + start);
+        return mapped + bufferOffset;
+    }
+
+    // Fences the commands that read this frame's region and moves to the next one
+    void EndFrame()
+    {
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        LastFrameBytes = offset;
+        region = (region + 1) % FRAMES;
+    }
+
+    GLuint Buffer() const { return buffer; }
+    GLsizeiptr BytesPerFrame() const { return regionSize; }
+
+private:
+    static const GLuint64 WAIT_TIMEOUT_NS = 1000000000;
+
+    GLuint buffer;
+    char* mapped;
+    GLsizeiptr regionSize;
+    GLsizeiptr alignment;
+    int region;
+    GLsizeiptr offset;
+    GLsync fences[FRAMES];
+
+    GLsizeiptr Align(GLsizeiptr size) const { return (size + alignment - 1) / alignment * alignment; }
+
+    StreamBuffer(const StreamBuffer&);
+    StreamBuffer& operator=(const StreamBuffer&);
+};
+#endif
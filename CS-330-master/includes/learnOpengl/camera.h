@@ -18,6 +18,9 @@ https://creativecommons.org/licenses/by-nc/4.0/legalcode
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <cs330/frustum.h>
 
 #include <vector>
 
@@ -31,6 +34,12 @@ enum Camera_Movement {
     DOWN
 };
 
+// Projections GetProjectionMatrix can build
+enum Camera_Projection {
+    PERSPECTIVE,        // OpenGL default: depth -1..1 from the near to the far plane
+    REVERSED_INFINITE   // depth 1 at the near plane down to 0 at infinity; needs glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE), a GL_GREATER depth test and a depth clear of 0
+};
+
 // Default camera values
 const float YAW         = -90.0f;
 const float PITCH       =  0.0f;
@@ -40,14 +49,16 @@ const float ZOOM        =  45.0f;
 
 
 // An abstract camera class that processes input and calculates the corresponding Euler Angles, Vectors and Matrices for use in OpenGL
+//
+// Orientation is kept as a quaternion built from Yaw and Pitch. The vectors, the view,
+// projection and view-projection matrices and the frustum planes are
+// cached and only rebuilt when something they depend on changed since the last query;
+// every rebuild bumps Version(), so consumers can cache their own derived data too.
 class Camera
 {
 public:
     // camera Attributes
     glm::vec3 Position;
-    glm::vec3 Front;
-    glm::vec3 Up;
-    glm::vec3 Right;
     glm::vec3 WorldUp;
     // euler Angles
     float Yaw;
@@ -58,50 +69,77 @@ public:
     float Zoom;
 
     // constructor with vectors
-    Camera(glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f), float yaw = YAW, float pitch = PITCH) : Front(glm::vec3(0.0f, 0.0f, -1.0f)), MovementSpeed(SPEED), MouseSensitivity(SENSITIVITY), Zoom(ZOOM)
+    Camera(glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f), float yaw = YAW, float pitch = PITCH) : MovementSpeed(SPEED), MouseSensitivity(SENSITIVITY), Zoom(ZOOM)
     {
         Position = position;
         WorldUp = up;
         Yaw = yaw;
         Pitch = pitch;
-        updateCameraVectors();
+        initCache();
     }
     // constructor with scalar values
-    Camera(float posX, float posY, float posZ, float upX, float upY, float upZ, float yaw, float pitch) : Front(glm::vec3(0.0f, 0.0f, -1.0f)), MovementSpeed(SPEED), MouseSensitivity(SENSITIVITY), Zoom(ZOOM)
+    Camera(float posX, float posY, float posZ, float upX, float upY, float upZ, float yaw, float pitch) : MovementSpeed(SPEED), MouseSensitivity(SENSITIVITY), Zoom(ZOOM)
     {
         Position = glm::vec3(posX, posY, posZ);
         WorldUp = glm::vec3(upX, upY, upZ);
         Yaw = yaw;
         Pitch = pitch;
-        updateCameraVectors();
+        initCache();
+    }
+
+    // sets the perspective parameters; the field of view is Zoom
+    void SetPerspective(float aspect, float nearPlane, float farPlane)
+    {
+        Projection = PERSPECTIVE;
+        Aspect = aspect;
+        NearPlane = nearPlane;
+        FarPlane = farPlane;
     }
 
-    // returns the view matrix calculated using Euler Angles and the LookAt Matrix
-    glm::mat4 GetViewMatrix() const
+    // sets a reversed-Z perspective without a far plane. With a floating-point depth buffer the
+    // precision is spread evenly over distance, so scenes of any size render without z-fighting.
+    void SetReversedInfinitePerspective(float aspect, float nearPlane)
     {
-        return glm::lookAt(Position, Position + Front, Up);
+        Projection = REVERSED_INFINITE;
+        Aspect = aspect;
+        NearPlane = nearPlane;
     }
 
+    // incremented every time the cached vectors and matrices had to be rebuilt
+    unsigned Version() const { refresh(); return version; }
+
+    glm::vec3 GetFront() const { refresh(); return front; }
+    glm::vec3 GetRight() const { refresh(); return right; }
+    glm::vec3 GetUp() const { refresh(); return up; }
+
+    // returns the view matrix calculated from the orientation quaternion and the position
+    glm::mat4 GetViewMatrix() const { refresh(); return view; }
+    glm::mat4 GetProjectionMatrix() const { refresh(); return projection; }
+    glm::mat4 GetViewProjectionMatrix() const { refresh(); return viewProjection; }
+    const Frustum& GetFrustum() const { refresh(); return frustum; }
+
     // processes input received from any keyboard-like input system. Accepts input parameter in the form of camera defined ENUM (to abstract it from windowing systems)
     void ProcessKeyboard(Camera_Movement direction, float deltaTime)
     {
+        refresh();
         float velocity = MovementSpeed * deltaTime;
         if (direction == FORWARD)
-            Position += Front * velocity;
+            Position += front * velocity;
         if (direction == BACKWARD)
-            Position -= Front * velocity;
+            Position -= front * velocity;
         if (direction == LEFT)
-            Position -= Right * velocity;
+            Position -= right * velocity;
         if (direction == RIGHT)
-            Position += Right * velocity;
+            Position += right * velocity;
         if (direction == UP)
-			Position += Up * velocity;
-		if (direction == DOWN)
-			Position -= Up * velocity;
+            Position += up * velocity;
+        if (direction == DOWN)
+            Position -= up * velocity;
     }
 
     // processes input received from a mouse input system. Expects the offset value in both the x and y direction.
-    void ProcessMouseMovement(float xoffset, float yoffset, GLboolean constrainPitch = true)
+    // Only the angles change here; the orientation is rebuilt once, the next time it is needed.
+    void ProcessMouseMovement(float xoffset, float yoffset, bool constrainPitch = true)
     {
         xoffset *= MouseSensitivity;
         yoffset *= MouseSensitivity;
@@ -117,9 +155,6 @@ public:
             if (Pitch < -89.0f)
                 Pitch = -89.0f;
         }
-
-        // update Front, Right and Up Vectors using the updated Euler angles
-        updateCameraVectors();
     }
 
     // processes input received from a mouse scroll-wheel event. Only requires input on the vertical wheel-axis
@@ -132,19 +167,111 @@ public:
             Zoom = 45.0f; 
     }
 
+    // projection parameters, see SetPerspective and SetReversedInfinitePerspective; FarPlane is unused by REVERSED_INFINITE
+    Camera_Projection Projection;
+    float Aspect;
+    float NearPlane;
+    float FarPlane;
+
 private:
-    // calculates the front vector from the Camera's (updated) Euler Angles
-    void updateCameraVectors()
+    // inputs the cache was built from
+    mutable glm::vec3 cachedPosition;
+    mutable glm::vec3 cachedWorldUp;
+    mutable float cachedYaw;
+    mutable float cachedPitch;
+    mutable float cachedZoom;
+    mutable float cachedAspect;
+    mutable float cachedNear;
+    mutable float cachedFar;
+    mutable Camera_Projection cachedProjection;
+    mutable bool valid;
+    mutable unsigned version;
+
+    // cached results
+    mutable glm::vec3 front;
+    mutable glm::vec3 right;
+    mutable glm::vec3 up;
+    mutable glm::mat4 view;
+    mutable glm::mat4 projection;
+    mutable glm::mat4 viewProjection;
+    mutable Frustum frustum;
+
+    void initCache()
+    {
+        Projection = PERSPECTIVE;
+        Aspect = 4.0f / 3.0f;
+        NearPlane = 0.1f;
+        FarPlane = 100.0f;
+        valid = false;
+        version = 0;
+    }
+
+    // rebuilds whatever depends on inputs that changed since the last call
+    void refresh() const
     {
-        // calculate the new Front vector
-        glm::vec3 front;
-        front.x = cos(glm::radians(Yaw)) * cos(glm::radians(Pitch));
-        front.y = sin(glm::radians(Pitch));
-        front.z = sin(glm::radians(Yaw)) * cos(glm::radians(Pitch));
-        Front = glm::normalize(front);
-        // also re-calculate the Right and Up vector
-        Right = glm::normalize(glm::cross(Front, WorldUp));  // normalize the vectors, because their length gets closer to 0 the more you look up or down which results in slower movement.
-        Up    = glm::normalize(glm::cross(Right, Front));
+        bool orientationChanged = !valid || Yaw != cachedYaw || Pitch != cachedPitch || WorldUp != cachedWorldUp;
+        bool viewChanged = orientationChanged || Position != cachedPosition;
+        bool projectionChanged = !valid || Zoom != cachedZoom || Aspect != cachedAspect || NearPlane != cachedNear || FarPlane != cachedFar || Projection != cachedProjection;
+        if (!viewChanged && !projectionChanged)
+            return;
+
+        if (orientationChanged)
+        {
+            // yaw turns around the world up axis, pitch around the camera's right axis; (1, 0, 0) is the front at zero yaw and pitch
+            glm::quat alignUp(glm::vec3(0.0f, 1.0f, 0.0f), glm::normalize(WorldUp));
+            glm::quat orientation = alignUp
+                * glm::angleAxis(glm::radians(-Yaw), glm::vec3(0.0f, 1.0f, 0.0f))
+                * glm::angleAxis(glm::radians(Pitch), glm::vec3(0.0f, 0.0f, 1.0f));
+
+            front = glm::normalize(orientation * glm::vec3(1.0f, 0.0f, 0.0f));
+            right = glm::normalize(orientation * glm::vec3(0.0f, 0.0f, 1.0f));
+            up    = glm::normalize(orientation * glm::vec3(0.0f, 1.0f, 0.0f));
+
+            cachedYaw = Yaw;
+            cachedPitch = Pitch;
+            cachedWorldUp = WorldUp;
+        }
+
+        if (viewChanged)
+        {
+            // rows of the rotation are the camera axes; the camera looks down -Z
+            view = glm::mat4(1.0f);
+            view[0][0] = right.x; view[1][0] = right.y; view[2][0] = right.z;
+            view[0][1] = up.x;    view[1][1] = up.y;    view[2][1] = up.z;
+            view[0][2] = -front.x; view[1][2] = -front.y; view[2][2] = -front.z;
+            view[3][0] = -glm::dot(right, Position);
+            view[3][1] = -glm::dot(up, Position);
+            view[3][2] = glm::dot(front, Position);
+
+            cachedPosition = Position;
+        }
+
+        if (projectionChanged)
+        {
+            if (Projection == REVERSED_INFINITE)
+            {
+                // clip z is the near distance and w the view depth, so depth = near / distance
+                const float focal = 1.0f / glm::tan(glm::radians(Zoom) * 0.5f);
+                projection = glm::mat4(0.0f);
+                projection[0][0] = focal / Aspect;
+                projection[1][1] = focal;
+                projection[2][3] = -1.0f;
+                projection[3][2] = NearPlane;
+            }
+            else
+                projection = glm::perspective(glm::radians(Zoom), Aspect, NearPlane, FarPlane);
+            cachedZoom = Zoom;
+            cachedAspect = Aspect;
+            cachedNear = NearPlane;
+            cachedFar = FarPlane;
+            cachedProjection = Projection;
+        }
+
+        viewProjection = projection * view;
+        frustum.ExtractFrom(viewProjection, Projection == REVERSED_INFINITE ? FRUSTUM_DEPTH_ZERO_TO_ONE : FRUSTUM_DEPTH_NEGATIVE_ONE_TO_ONE);
+
+        valid = true;
+        ++version;
     }
 };
 #endif
\ No newline at end of file
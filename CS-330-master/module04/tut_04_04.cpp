@@ -1,5 +1,7 @@
 #include <iostream>             // cout, cerr
 #include <cstdlib>              // EXIT_FAILURE
+#include <deque>                // deque
+#include <functional>           // function
 #include <GL/glew.h>            // GLEW library
 #include <GLFW/glfw3.h>         // GLFW library
 
@@ -9,6 +11,25 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <learnOpengl/camera.h> // Camera class
+#include <cs330/job_system.h>   // Work-stealing job system
+#include <cs330/command_buffer.h> // Sorted draw submission
+#include <cs330/gl_state_cache.h> // Redundant GL call filtering
+#include <cs330/log.h>            // Asynchronous logging
+#include <cs330/profiler.h>     // CPU/GPU timers and trace export
+#include <cs330/perf_overlay.h> // On-screen performance overlay
+#include <cs330/input_recorder.h> // Input recording and replay
+#include <cs330/action_map.h>     // Key to action bindings
+#include <cs330/scene.h>          // Scene description files
+#include <cs330/scene_graph.h>    // Cached world transforms
+#include <cs330/entity_store.h>   // Structure of arrays entities
+#include <cs330/prefab_instancer.h> // GPU-expanded chair instances
+#include <cs330/primitives.h>     // Procedural primitive meshes
+#include <cs330/sphere_impostors.h> // Ray-cast spheres
+#include <cs330/cylinder_impostors.h> // Ray-cast cylinders
+#include <cs330/stream_buffer.h>  // Persistently mapped per-frame data
+#include <cs330/dynamic_resolution.h> // GPU time driven render scale
+#include <cs330/render_graph.h>   // Frame passes and transient targets
+#include <cs330/startup_profiler.h> // Initialization phase timings
 
 using namespace std; // Standard namespace
 
@@ -26,18 +47,32 @@ namespace
     const int WINDOW_WIDTH = 800;
     const int WINDOW_HEIGHT = 600;
 
+    // Vertices of a mesh, built on the CPU before the upload
+    struct MeshSource
+    {
+        vector<PrimitiveVertex> Vertices;
+        vector<GLuint> Indices;     // empty for a mesh drawn as arrays
+        JobCounter Built;           // the build job with --lazy, so a use waits for this mesh only
+    };
+    typedef function<void(PrimitiveGenerator&, MeshSource&)> MeshBuilder;
+
     // Stores the GL data relative to a given mesh
     struct GLMesh
     {
         GLuint vao;         // Handle for the vertex array object
         GLuint vbo;         // Handle for the vertex buffer object
         GLuint nVertices;    // Number of indices of the mesh
+        GLuint ebo;         // Handle for the element buffer object, 0 for a mesh drawn as arrays
+        GLuint nIndices;    // Number of 32-bit indices in the element buffer
+        MeshSource* source; // Vertices waiting for the upload with --lazy, nullptr once uploaded
     };
 
     // Main GLFW window
     GLFWwindow* gWindow = nullptr;
     // Triangle mesh data
-    GLMesh gPlaneMesh, gCubeMesh, gCylinderMesh, gSphereMesh, gMesh;
+    GLMesh gPlaneMesh, gCubeMesh, gCylinderMesh, gSphereMesh;
+    // One mesh per rounded cube of the scene, since their rounding does not scale
+    vector<GLMesh> gRoundedBoxMeshes;
     // Shader program
     GLuint gProgramId;
     GLuint gCubeProgramId;
@@ -59,20 +94,147 @@ namespace
     GLclampf gBackgroundColor_B = 0.4f;
     GLclampf gBackgroundColor_A = 0.5f;
 
-    // Subject position and scale
-    glm::vec3 gCubePosition(0.0f, 0.0f, 0.0f);
-    glm::vec3 gCubeScale(0.2f);
-
-    // Cube and light color
-    glm::vec3 gObjectColor(1.f, 0.2f, 0.0f);
-    glm::vec3 gLightColor(1.0f, 1.0f, 1.0f);
-
-    // Light position and scale
-    glm::vec3 gLightPosition(1.5f, 0.5f, 2.0f);
-    glm::vec3 gLightScale(0.2f);
+    // Position, scale and color of the subject cube and of the light, which is drawn as a lamp
+    EntityStore gEntities;
+    EntityHandle gCubeEntity;
+    EntityHandle gLampEntity;
 
     // Lamp animation
     bool gIsLampOrbiting = true;
+
+    // Input actions; the names are the ones used in bindings files
+    enum Action
+    {
+        ACTION_QUIT,
+        ACTION_MOVE_FORWARD, ACTION_MOVE_BACKWARD, ACTION_MOVE_LEFT, ACTION_MOVE_RIGHT, ACTION_MOVE_UP, ACTION_MOVE_DOWN,
+        ACTION_LAMP_ORBIT, ACTION_LAMP_STOP,
+        ACTION_LIGHT_UP, ACTION_LIGHT_DOWN, ACTION_LIGHT_FORWARD, ACTION_LIGHT_BACKWARD, ACTION_LIGHT_RIGHT, ACTION_LIGHT_LEFT,
+        ACTION_RED_UP, ACTION_GREEN_UP, ACTION_BLUE_UP, ACTION_ALPHA_UP,
+        ACTION_RED_DOWN, ACTION_GREEN_DOWN, ACTION_BLUE_DOWN, ACTION_ALPHA_DOWN,
+        ACTION_COUNT
+    };
+    const char* const ACTION_NAMES[ACTION_COUNT] = {
+        "QUIT",
+        "MOVE_FORWARD", "MOVE_BACKWARD", "MOVE_LEFT", "MOVE_RIGHT", "MOVE_UP", "MOVE_DOWN",
+        "LAMP_ORBIT", "LAMP_STOP",
+        "LIGHT_UP", "LIGHT_DOWN", "LIGHT_FORWARD", "LIGHT_BACKWARD", "LIGHT_RIGHT", "LIGHT_LEFT",
+        "RED_UP", "GREEN_UP", "BLUE_UP", "ALPHA_UP",
+        "RED_DOWN", "GREEN_DOWN", "BLUE_DOWN", "ALPHA_DOWN"
+    };
+    const int DEFAULT_KEYS[ACTION_COUNT] = {
+        GLFW_KEY_ESCAPE,
+        GLFW_KEY_W, GLFW_KEY_S, GLFW_KEY_A, GLFW_KEY_D, GLFW_KEY_Q, GLFW_KEY_E,
+        GLFW_KEY_K, GLFW_KEY_L,
+        GLFW_KEY_PAGE_UP, GLFW_KEY_PAGE_DOWN, GLFW_KEY_UP, GLFW_KEY_DOWN, GLFW_KEY_RIGHT, GLFW_KEY_LEFT,
+        GLFW_KEY_1, GLFW_KEY_2, GLFW_KEY_3, GLFW_KEY_4,
+        GLFW_KEY_6, GLFW_KEY_7, GLFW_KEY_8, GLFW_KEY_9
+    };
+    // Light movement of ACTION_LIGHT_UP..ACTION_LIGHT_LEFT
+    const glm::vec3 LIGHT_DIRECTIONS[6] = {
+        glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+        glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 0.0f, 1.0f),
+        glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f)
+    };
+    // Actions held down, fed by the key callback; --bindings <file> remaps them
+    ActionMap gActions(ACTION_NAMES, ACTION_COUNT);
+
+    // Worker threads for CPU work such as mesh generation
+    JobSystem gJobSystem;
+
+    // Builds the primitive meshes; keeps its sine tables between meshes
+    PrimitiveGenerator gPrimitives;
+
+    // --lazy builds the meshes on the job system while startup goes on and uploads each one
+    // on first use, and compiles the scene programs on first use; the deque keeps the
+    // sources in place while jobs write them
+    bool gLazyResources = false;
+    deque<MeshSource> gMeshSources;
+    unsigned gLazyMeshes = 0;
+    unsigned gLazyPrograms = 0;
+
+    // Time from the start of the process to each initialization phase, up to the first frame
+    StartupProfiler gStartup;
+
+    // Draws of the frame, sorted by state before they are issued
+    CommandBuffer gCommandBuffer;
+    // Color of the next meshes added to the scene graph
+    glm::vec3 gCurrentColor(1.0f);
+
+    // Last GL state set by the render loop
+    GLStateCache gGLState;
+
+    // Frame timings; T starts and stops a trace capture
+    Profiler gProfiler;
+    const char* const TRACE_FILE = "tut_04_04_trace.json";
+
+    // Frame statistics drawn over the scene; O shows/hides it
+    PerfOverlay gOverlay;
+
+    // The scene is drawn offscreen at 50% to 100% of the window size, following the GPU
+    // frame time, and upscaled to the window; R switches the scaling off/on
+    DynamicResolution gResolution;
+
+    // Passes of the frame, rebuilt each frame; its offscreen targets come from a pool
+    // and share memory when their passes do not overlap
+    RenderGraph gRenderGraph;
+
+    // --record <file> logs the input of the session, --replay <file> plays it back
+    // on the recorded frame times; --hidden replays without showing the window
+    InputRecorder gInputRecorder;
+    InputReplay gInputReplay;
+    bool gHiddenWindow = false;
+    // Measured time between frames, which differs from gDeltaTime during a replay
+    float gFrameTime = 0.0f;
+
+    // Objects drawn each frame, text or binary; --scene <file> replaces the chair
+    Scene gScene;
+    // Relative to the directory of the executable, which the Makefile puts in build/linux
+    const char* const DEFAULT_SCENE_FILE = "../../resources/scenes/chair.scene";
+
+    // The scene and the lamp as a transform hierarchy; world matrices are only
+    // recomputed for the nodes that moved since the last frame
+    struct GraphDraw
+    {
+        int Node;
+        GLMesh* Mesh;
+        glm::vec3 Color;
+        bool Impostor;      // drawn by gSpheres or gCylinders while gImpostors is set
+    };
+    SceneGraph gSceneGraph;
+    vector<GraphDraw> gGraphDraws;
+    int gLampNode = SceneGraph::NO_NODE;
+
+    // --showroom <chairs> draws a grid of chairs, expanded on the GPU, instead of the scene
+    PrefabInstancer gShowroom;
+    int gShowroomChairs = 0;
+
+    // std140 layout of the Frame uniform block of the scene and lamp shaders
+    struct FrameUniforms
+    {
+        glm::mat4 View;
+        glm::mat4 Projection;
+        glm::vec3 LightPosition;
+        float Padding0;
+        glm::vec3 LightColor;
+        float Padding1;
+        glm::vec3 ViewPosition;
+        float Padding2;
+    };
+    const GLuint FRAME_BLOCK_BINDING = 0;
+    // Per-frame data written straight into mapped memory, three frames in flight
+    StreamBuffer gFrameStream;
+    const GLsizeiptr FRAME_STREAM_BYTES = 64 * 1024;
+
+    // Far plane distance, pushed back to see the whole showroom
+    float gViewDistance = 100.0f;
+
+    // The uniformly scaled spheres of the scene, or the --spheres <count> field drawn
+    // instead of the scene, ray-cast on quads, and the round cylinders of the scene
+    // ray-cast in their boxes; I switches them to meshes
+    SphereImpostors gSpheres;
+    CylinderImpostors gCylinders;
+    bool gImpostors = true;
+    int gStressSpheres = 0;
 }
 
 /* User-defined Function prototypes to:
@@ -81,20 +243,33 @@ namespace
  * and render graphics on the screen
  */
 bool UInitialize(int, char* [], GLFWwindow** window);
+string UExecutableRelative(const char* executable, const char* path);
 void UResizeWindow(GLFWwindow* window, int width, int height);
 void UProcessInput(GLFWwindow* window);
+void UReplayEvents();
 void UKeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
 void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos);
 void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
-void UCreateMesh(GLMesh& mesh, vector<glm::vec3>& positions, vector<glm::vec3>& normals);
+void UCreateMesh(GLMesh& mesh, MeshBuilder build);
+GLMesh& UUseMesh(GLMesh& mesh);
+void UCreateMesh(GLMesh& mesh, const vector<PrimitiveVertex>& vertices);
+void UCreateMesh(GLMesh& mesh, const vector<PrimitiveVertex>& vertices, const vector<GLuint>& indices);
 void UCreatePlaneMesh(GLMesh& mesh);
 void UCreateCubeMesh(GLMesh& mesh);
 void UCreateCylinderMesh(GLMesh& mesh);
 void UCreateSphereMesh(GLMesh& mesh);
+void UCreateRoundedBoxMesh(GLMesh& mesh, glm::vec3 size, float radius);
+void UCreateEntities();
+void UBuildSceneGraph();
+bool UCreateShowroom(int chairs);
+bool UCreateImpostors();
+SphereImpostors& USphereMeshes();
 void UDestroyMesh(GLMesh& mesh);
+void URenderScene(const glm::vec3& lightPosition, const glm::vec3& lightColor, const glm::vec3& objectColor);
 void URender();
 bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
+bool UUseProgram(GLuint& programId, const char* vtxShaderSource, const char* fragShaderSource);
 void UDestroyShaderProgram(GLuint programId);
 
 
@@ -108,8 +283,15 @@ const GLchar* vertexShaderSource = GLSL(440,
 
     // Global variables for the transform matrices
     uniform mat4 model;
-    uniform mat4 view;
-    uniform mat4 projection;
+    // Camera and light of the frame, streamed by URender
+    layout(std140, binding = 0) uniform Frame
+    {
+        mat4 view;
+        mat4 projection;
+        vec3 lightPos;
+        vec3 lightColor;
+        vec3 viewPosition;
+    };
 
     void main()
     {
@@ -129,9 +311,15 @@ const GLchar* fragmentShaderSource = GLSL(440,
     out vec4 fragmentColor; // Final output color
 
     uniform vec3 objectColor; // Current object color
-    uniform vec3 lightColor;
-    uniform vec3 lightPos;
-    uniform vec3 viewPosition;
+    // Camera and light of the frame, streamed by URender
+    layout(std140, binding = 0) uniform Frame
+    {
+        mat4 view;
+        mat4 projection;
+        vec3 lightPos;
+        vec3 lightColor;
+        vec3 viewPosition;
+    };
 
 
     void main()
@@ -240,8 +428,15 @@ const GLchar* lampVertexShaderSource = GLSL(440,
 
     //Uniform / Global variables for the  transform matrices
     uniform mat4 model;
-    uniform mat4 view;
-    uniform mat4 projection;
+    // Camera and light of the frame, streamed by URender
+    layout(std140, binding = 0) uniform Frame
+    {
+        mat4 view;
+        mat4 projection;
+        vec3 lightPos;
+        vec3 lightColor;
+        vec3 viewPosition;
+    };
 
     void main()
     {
@@ -272,30 +467,76 @@ int main(int argc, char* argv[])
         return EXIT_FAILURE;
     }
 
-    // Create the meshes for primitive shapes
+    // Create the meshes for primitive shapes; the cube is also the lamp
     UCreatePlaneMesh(gPlaneMesh);
     UCreateCubeMesh(gCubeMesh);
     UCreateCylinderMesh(gCylinderMesh);
     UCreateSphereMesh(gSphereMesh);
-    UCreateCubeMesh(gMesh); // Calls the function to create the Vertex Buffer Object
+    gStartup.Mark("Meshes");
 
-    // Create the shader program
-    if (!UCreateShaderProgram(vertexShaderSource, fragmentShaderSource, gProgramId))
+    // Subject and lamp entities, then the scene objects and lamp as scene graph nodes
+    UCreateEntities();
+    UBuildSceneGraph();
+    if (gShowroomChairs > 0 && !UCreateShowroom(gShowroomChairs))
     {
         // Let the user read the error message before exiting
         cin.get();
         return EXIT_FAILURE;
     }
+    if (!UCreateImpostors())
+    {
+        // Let the user read the error message before exiting
+        cin.get();
+        return EXIT_FAILURE;
+    }
+
+    gStartup.Mark("Scene setup");
+
+    // Create the shader programs; --lazy compiles the scene and lamp programs at their first draw
+    if (!gLazyResources)
+    {
+        if (!UCreateShaderProgram(vertexShaderSource, fragmentShaderSource, gProgramId))
+        {
+            // Let the user read the error message before exiting
+            cin.get();
+            return EXIT_FAILURE;
+        }
+
+        if (!UCreateShaderProgram(cubeVertexShaderSource, cubeFragmentShaderSource, gCubeProgramId))
+            return EXIT_FAILURE;
+
+        if (!UCreateShaderProgram(lampVertexShaderSource, lampFragmentShaderSource, gLampProgramId))
+            return EXIT_FAILURE;
+    }
+    gStartup.Mark("Shaders");
 
-    if (!UCreateShaderProgram(cubeVertexShaderSource, cubeFragmentShaderSource, gCubeProgramId))
+    if (!gOverlay.Create())
         return EXIT_FAILURE;
 
-    if (!UCreateShaderProgram(lampVertexShaderSource, lampFragmentShaderSource, gLampProgramId))
+    int framebufferWidth, framebufferHeight;
+    glfwGetFramebufferSize(gWindow, &framebufferWidth, &framebufferHeight);
+    if (!gResolution.Create(framebufferWidth, framebufferHeight))
         return EXIT_FAILURE;
 
+    if (!gFrameStream.Create(FRAME_STREAM_BYTES))
+    {
+        cerr << "Cannot map the frame stream buffer" << endl;
+        return EXIT_FAILURE;
+    }
+
     // Sets the background color of the window to black (it will be implicitely used by glClear)
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
+    // Mesh and shader creation bound objects behind the state cache's back
+    gGLState.Invalidate();
+    gStartup.Mark("Frame resources");
+
+    gCamera.SetPerspective((GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, gViewDistance);
+
+    const bool isReplay = gInputReplay.IsPlaying();
+    const double loopStart = glfwGetTime();
+    gLastFrame = (float)loopStart;
+
     // render loop
     // -----------
     while (!glfwWindowShouldClose(gWindow))
@@ -303,25 +544,68 @@ int main(int argc, char* argv[])
         // per-frame timing
         // --------------------
         float currentFrame = (float)glfwGetTime();
-        gDeltaTime = currentFrame - gLastFrame;
+        gFrameTime = currentFrame - gLastFrame;
         gLastFrame = currentFrame;
 
+        // A replay runs on the recorded frame times, so it goes through the same frames as the recording
+        if (isReplay)
+        {
+            if (!gInputReplay.NextFrame(gDeltaTime))
+                break;
+        }
+        else
+            gDeltaTime = gFrameTime;
+        gInputRecorder.Frame(gDeltaTime);
+
+        gProfiler.BeginFrame();
+
         // input
         // -----
-        UProcessInput(gWindow);
+        {
+            CpuScope scope(gProfiler, "UProcessInput");
+            UProcessInput(gWindow);
+        }
 
         // Render this frame
         URender();
 
+        // Startup ends when the first frame is swapped
+        if (!gStartup.IsFinished())
+        {
+            gStartup.Finish("First frame");
+            cout << "STARTUP: " << gStartup.TotalMs() << " ms to the first frame (" << (gLazyResources ? "lazy" : "eager") << " resources, "
+                 << gLazyMeshes << " meshes and " << gLazyPrograms << " programs created on first use)" << endl;
+            for (size_t i = 0; i < gStartup.PhaseCount(); ++i)
+                cout << "    " << gStartup.PhaseName(i) << ": " << gStartup.PhaseMs(i) << " ms" << endl;
+        }
+
         glfwPollEvents();
+        UReplayEvents();
+    }
+
+    if (isReplay)
+    {
+        const double seconds = glfwGetTime() - loopStart;
+        const unsigned frames = gInputReplay.Frames();
+        cout << "REPLAY: " << frames << " frames in " << seconds << " s, "
+             << (frames > 0 ? seconds * 1000.0 / frames : 0.0) << " ms/frame"
+             << " (CPU " << gProfiler.CpuFrameMs << " ms, GPU " << gProfiler.GpuFrameMs << " ms, " << gProfiler.Bound() << ")" << endl;
     }
+    if (gInputRecorder.IsRecording() && !gInputRecorder.Close())
+        cerr << "RECORD: could not write the input recording" << endl;
 
-    // Release mesh data
+    // Release mesh data; lazy meshes never drawn may still be building
+    for (size_t i = 0; i < gMeshSources.size(); ++i)
+        gJobSystem.Wait(gMeshSources[i].Built);
     UDestroyMesh(gPlaneMesh);
     UDestroyMesh(gCubeMesh);
     UDestroyMesh(gCylinderMesh);
     UDestroyMesh(gSphereMesh);
-    UDestroyMesh(gMesh);
+    for (size_t i = 0; i < gRoundedBoxMeshes.size(); ++i)
+        UDestroyMesh(gRoundedBoxMeshes[i]);
+    gShowroom.Release();
+    gSpheres.Release();
+    gCylinders.Release();
 
 
     // Release shader program
@@ -330,24 +614,99 @@ int main(int argc, char* argv[])
     UDestroyShaderProgram(gCubeProgramId);
     UDestroyShaderProgram(gLampProgramId);
 
+    // Release the timer queries and the overlay
+    gProfiler.Release();
+    gOverlay.Release();
+    gFrameStream.Release();
+    gResolution.Release();
+    gRenderGraph.Release();
+
     exit(EXIT_SUCCESS); // Terminates the program successfully
 }
 
 
+// Path of a file given relative to the directory of the executable, so it is
+// found whatever the working directory the program was started from
+string UExecutableRelative(const char* executable, const char* path)
+{
+    string directory = executable;
+    string::size_type separator = directory.find_last_of("/\\");
+    directory = separator == string::npos ? string(".") : directory.substr(0, separator);
+    return directory + "/" + path;
+}
+
 // Initialize GLFW, GLEW, and create a window
 bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 {
+    for (int action = 0; action < ACTION_COUNT; ++action)
+        gActions.Bind(DEFAULT_KEYS[action], action);
+    const string defaultScenePath = UExecutableRelative(argv[0], DEFAULT_SCENE_FILE);
+    const char* scenePath = defaultScenePath.c_str();
+
+    // Command line: input recording and replay, key bindings, scene
+    for (int i = 1; i < argc; ++i)
+    {
+        string argument = argv[i];
+        if (argument == "--record" && i + 1 < argc)
+        {
+            if (!gInputRecorder.Open(argv[++i]))
+            {
+                cerr << "Cannot create the input recording " << argv[i] << endl;
+                return false;
+            }
+        }
+        else if (argument == "--replay" && i + 1 < argc)
+        {
+            if (!gInputReplay.Open(argv[++i]))
+            {
+                cerr << "Cannot read the input recording " << argv[i] << endl;
+                return false;
+            }
+        }
+        else if (argument == "--hidden")
+            gHiddenWindow = true;
+        else if (argument == "--bindings" && i + 1 < argc)
+        {
+            if (!gActions.Load(argv[++i]))
+                return false;
+        }
+        else if (argument == "--scene" && i + 1 < argc)
+            scenePath = argv[++i];
+        else if (argument == "--showroom" && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            gShowroomChairs = atoi(argv[++i]);
+        else if (argument == "--spheres" && i + 1 < argc && atoi(argv[i + 1]) > 0)
+            gStressSpheres = atoi(argv[++i]);
+        else if (argument == "--lazy")
+            gLazyResources = true;
+        else
+        {
+            cerr << "Usage: " << argv[0] << " [--record <file> | --replay <file> [--hidden]] [--bindings <file>] [--scene <file>] [--showroom <chairs>] [--spheres <count>] [--lazy]" << endl;
+            return false;
+        }
+    }
+    if (!gScene.Load(scenePath))
+    {
+        if (scenePath == defaultScenePath.c_str())
+            cerr << "ERROR::SCENE::the default scene is looked up from the executable's directory; pass --scene <file>" << endl;
+        return false;
+    }
+    gStartup.Mark("Command line and scene");
+
     // GLFW: initialize and configure
     // ------------------------------
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    gStartup.Mark("GLFW init");
 
 #ifdef __APPLE__
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
+    if (gHiddenWindow)
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
     // GLFW: window creation
     // ---------------------
     * window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_TITLE, NULL, NULL);
@@ -366,6 +725,7 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 
     // tell GLFW to capture our mouse
     glfwSetInputMode(*window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    gStartup.Mark("Window and context");
 
     // GLEW: initialize
     // ----------------
@@ -379,6 +739,8 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
         return false;
     }
 
+    gStartup.Mark("GLEW");
+
     // Displays GPU OpenGL version
     cout << "INFO: OpenGL Version: " << glGetString(GL_VERSION) << endl;
 
@@ -386,128 +748,79 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 }
 
 
-// process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
+// process all input: walk the actions held this frame and react accordingly
 void UProcessInput(GLFWwindow* window)
 {
-    static const float cameraSpeed = 2.5f;
-
-    // Pause and resume lamp orbiting
-    static bool isLKeyDown = false;
+    const uint64_t held = gActions.Held();
+    // Taps shorter than a frame still count for the one-shot actions
+    const uint64_t pressed = held | gActions.Pressed();
 
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+    if (held & ActionBits(ACTION_QUIT, ACTION_QUIT))
         glfwSetWindowShouldClose(window, true);
 
-    // Camera Control
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(FORWARD, gDeltaTime);
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(BACKWARD, gDeltaTime);
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(LEFT, gDeltaTime);
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(RIGHT, gDeltaTime);
-    if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(UP, gDeltaTime);
-    if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(DOWN, gDeltaTime);
+    // Camera Control: the movement actions are in Camera_Movement order
+    for (uint64_t mask = held & ActionBits(ACTION_MOVE_FORWARD, ACTION_MOVE_DOWN); mask != 0; mask &= mask - 1)
+        gCamera.ProcessKeyboard(Camera_Movement(LowestAction(mask) - ACTION_MOVE_FORWARD), gDeltaTime);
 
     // Light Control
-    if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS && !gIsLampOrbiting)
+    if (pressed & ActionBits(ACTION_LAMP_ORBIT, ACTION_LAMP_ORBIT))
         gIsLampOrbiting = true;
-    if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS && gIsLampOrbiting)
+    if (pressed & ActionBits(ACTION_LAMP_STOP, ACTION_LAMP_STOP))
         gIsLampOrbiting = false;
-    if (!gIsLampOrbiting) {
-        if (glfwGetKey(window, GLFW_KEY_PAGE_UP) == GLFW_PRESS) {
-            gLightPosition.y += gDeltaTime;
-        }
-        if (glfwGetKey(window, GLFW_KEY_PAGE_DOWN) == GLFW_PRESS) {
-            gLightPosition.y -= gDeltaTime;
-        }
-        if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS) {
-            gLightPosition.z -= gDeltaTime;
-        }
-        if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) {
-            gLightPosition.z += gDeltaTime;
-        }
-        if (glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS) {
-            gLightPosition.x += gDeltaTime;
-        }
-        if (glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS) {
-            gLightPosition.x -= gDeltaTime;
-        }
-    }
-    if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS) {
-        gBackgroundColor_R += gDeltaTime;
-        if (gBackgroundColor_R > 1.0f) {
-            gBackgroundColor_R = 1.0f;
-        }
-        cout << "BACKGROUND COLOR (RGBA) " << " R: " << gBackgroundColor_R << " G: " << gBackgroundColor_G << " B: " << gBackgroundColor_B << " A: " << gBackgroundColor_A << endl;
-
-    }
-    if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS) {
-        gBackgroundColor_G += gDeltaTime;
-        if (gBackgroundColor_G > 1.0f) {
-            gBackgroundColor_G = 1.0f;
-        }
-        cout << "BACKGROUND COLOR (RGBA) " << " R: " << gBackgroundColor_R << " G: " << gBackgroundColor_G << " B: " << gBackgroundColor_B << " A: " << gBackgroundColor_A << endl;
-
+    if (!gIsLampOrbiting)
+    {
+        for (uint64_t mask = held & ActionBits(ACTION_LIGHT_UP, ACTION_LIGHT_LEFT); mask != 0; mask &= mask - 1)
+            gEntities.SetPosition(gLampEntity, gEntities.Position(gLampEntity) + LIGHT_DIRECTIONS[LowestAction(mask) - ACTION_LIGHT_UP] * gDeltaTime);
     }
-    if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS) {
-        gBackgroundColor_B += gDeltaTime;
-        if (gBackgroundColor_B > 1.0f) {
-            gBackgroundColor_B = 1.0f;
-        }
-        cout << "BACKGROUND COLOR (RGBA) " << " R: " << gBackgroundColor_R << " G: " << gBackgroundColor_G << " B: " << gBackgroundColor_B << " A: " << gBackgroundColor_A << endl;
 
-    }
-    if (glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS) {
-        gBackgroundColor_A += gDeltaTime;
-        if (gBackgroundColor_A > 1.0f) {
-            gBackgroundColor_A = 1.0f;
+    // Background color: the first four actions raise R, G, B, A, the next four lower them
+    const uint64_t colorActions = held & ActionBits(ACTION_RED_UP, ACTION_ALPHA_DOWN);
+    if (colorActions != 0)
+    {
+        GLclampf* const channels[4] = { &gBackgroundColor_R, &gBackgroundColor_G, &gBackgroundColor_B, &gBackgroundColor_A };
+        for (uint64_t mask = colorActions; mask != 0; mask &= mask - 1)
+        {
+            const int index = LowestAction(mask) - ACTION_RED_UP;
+            GLclampf& channel = *channels[index % 4];
+            channel = glm::clamp(channel + (index < 4 ? gDeltaTime : -gDeltaTime), 0.0f, 1.0f);
         }
-        cout << "BACKGROUND COLOR (RGBA) " << " R: " << gBackgroundColor_R << " G: " << gBackgroundColor_G << " B: " << gBackgroundColor_B << " A: " << gBackgroundColor_A << endl;
-
+        LOG_INFO_EVERY(250, "BACKGROUND COLOR (RGBA)  R: %g G: %g B: %g A: %g", gBackgroundColor_R, gBackgroundColor_G, gBackgroundColor_B, gBackgroundColor_A);
     }
-    if (glfwGetKey(window, GLFW_KEY_6) == GLFW_PRESS) {
-        gBackgroundColor_R -= gDeltaTime;
-        if (gBackgroundColor_R < 0.0f) {
-            gBackgroundColor_R = 0.0f;
-        }
-        cout << "BACKGROUND COLOR (RGBA) " << " R: " << gBackgroundColor_R << " G: " << gBackgroundColor_G << " B: " << gBackgroundColor_B << " A: " << gBackgroundColor_A << endl;
+}
 
-    }
-    if (glfwGetKey(window, GLFW_KEY_7) == GLFW_PRESS) {
-        gBackgroundColor_G -= gDeltaTime;
-        if (gBackgroundColor_G < 0.0f) {
-            gBackgroundColor_G = 0.0f;
-        }
-        cout << "BACKGROUND COLOR (RGBA) " << " R: " << gBackgroundColor_R << " G: " << gBackgroundColor_G << " B: " << gBackgroundColor_B << " A: " << gBackgroundColor_A << endl;
 
-    }
-    if (glfwGetKey(window, GLFW_KEY_8) == GLFW_PRESS) {
-        gBackgroundColor_B -= gDeltaTime;
-        if (gBackgroundColor_B < 0.0f) {
-            gBackgroundColor_B = 0.0f;
+// Feeds the recorded events of the current frame to the input callbacks
+void UReplayEvents()
+{
+    InputEvent event;
+    while (gInputReplay.NextEvent(event))
+    {
+        switch (event.Type)
+        {
+        case INPUT_KEY:
+            UKeyCallback(nullptr, event.Code, 0, event.Action, event.Mods);
+            break;
+        case INPUT_CURSOR:
+            UMousePositionCallback(nullptr, event.X, event.Y);
+            break;
+        case INPUT_SCROLL:
+            UMouseScrollCallback(nullptr, event.X, event.Y);
+            break;
+        case INPUT_BUTTON:
+            UMouseButtonCallback(nullptr, event.Code, event.Action, event.Mods);
+            break;
+        default:
+            break;
         }
-        cout << "BACKGROUND COLOR (RGBA) " << " R: " << gBackgroundColor_R << " G: " << gBackgroundColor_G << " B: " << gBackgroundColor_B << " A: " << gBackgroundColor_A << endl;
-
     }
-    if (glfwGetKey(window, GLFW_KEY_9) == GLFW_PRESS) {
-        gBackgroundColor_A -= gDeltaTime;
-        if (gBackgroundColor_A < 0.0f) {
-            gBackgroundColor_A = 0.0f;
-        }
-        cout << "BACKGROUND COLOR (RGBA) " << " R: " << gBackgroundColor_R << " G: " << gBackgroundColor_G << " B: " << gBackgroundColor_B << " A: " << gBackgroundColor_A << endl;
-
-    }    
-
 }
 
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
 void UResizeWindow(GLFWwindow* window, int width, int height)
 {
-    glViewport(0, 0, width, height);
+    // The viewport is set every frame for the scene scale; the attachments only grow, at the next frame
+    gResolution.Resize(width, height);
 }
 
 
@@ -515,9 +828,74 @@ void UResizeWindow(GLFWwindow* window, int width, int height)
 // -------------------------------------------------------
 void UKeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
+    // Live input is ignored during a replay, which calls back with no window; Escape still stops it
+    if (window != nullptr && gInputReplay.IsPlaying() && key != GLFW_KEY_ESCAPE)
+        return;
+    gInputRecorder.Key(key, action, mods);
+    gActions.OnKey(key, action);
+
     // Switch perspective/orthographic camera
     if (key == GLFW_KEY_C && action == GLFW_PRESS)
         perspectiveCamera = !perspectiveCamera;
+
+    // Report the draw state changes of the last frame
+    if (key == GLFW_KEY_P && action == GLFW_PRESS)
+    {
+        const CommandStats& stats = gCommandBuffer.Stats;
+        cout << "DRAWS: " << stats.Draws
+             << " STATE CHANGES immediate: " << stats.ImmediateStateChanges()
+             << " (program " << stats.ImmediateProgramChanges << ", vao " << stats.ImmediateVertexArrayBinds << ", material " << stats.ImmediateMaterialChanges << ")"
+             << " sorted: " << stats.SortedStateChanges()
+             << " (program " << stats.SortedProgramChanges << ", vao " << stats.SortedVertexArrayBinds << ", material " << stats.SortedMaterialChanges << ")" << endl;
+        cout << "GL STATE CALLS issued: " << gGLState.LastFrame.Issued << " suppressed: " << gGLState.LastFrame.Suppressed << endl;
+        cout << "STREAM: " << gFrameStream.LastFrameBytes << " of " << gFrameStream.BytesPerFrame() << " bytes last frame, "
+             << gFrameStream.Stalls << " stalls (" << gFrameStream.StallMs << " ms), " << gFrameStream.Overflows << " overflows" << endl;
+        cout << "RESOLUTION: " << gResolution.RenderWidth() << "x" << gResolution.RenderHeight() << " (scale " << gResolution.Scale() << ", "
+             << gResolution.Reallocations << " allocations)" << endl;
+        cout << "RENDER GRAPH: " << gRenderGraph.LivePasses << " passes, " << gRenderGraph.CulledPasses << " culled, "
+             << gRenderGraph.TransientTextures << " targets in " << gRenderGraph.PhysicalTextures << " textures, "
+             << gRenderGraph.GraphBytes / (1024.0 * 1024.0) << " MB (" << gRenderGraph.NaiveBytes / (1024.0 * 1024.0) << " MB unshared), "
+             << gRenderGraph.Allocations << " allocations" << endl;
+        cout << "FRAME CPU: " << gProfiler.CpuFrameMs << " ms GPU: " << gProfiler.GpuFrameMs << " ms (" << gProfiler.Bound() << ")" << endl;
+    }
+
+    // Switch the spheres and cylinders between impostors and meshes
+    if (key == GLFW_KEY_I && action == GLFW_PRESS)
+    {
+        gImpostors = !gImpostors;
+        cout << "IMPOSTORS: " << (gImpostors ? "on" : "off") << ", " << gSpheres.Count() << " spheres and " << gCylinders.Count()
+             << " cylinders in " << (gImpostors ? gSpheres.ImpostorVertices() + gCylinders.Vertices() : USphereMeshes().MeshVertices() + gCylinders.Count() * UUseMesh(gCylinderMesh).nVertices)
+             << " vertices" << endl;
+    }
+
+    // Switch dynamic resolution off/on
+    if (key == GLFW_KEY_R && action == GLFW_PRESS)
+    {
+        gResolution.Enabled = !gResolution.Enabled;
+        cout << "DYNAMIC RESOLUTION: " << (gResolution.Enabled ? "on" : "off") << endl;
+    }
+
+    // Show/hide the performance overlay
+    if (key == GLFW_KEY_O && action == GLFW_PRESS)
+        gOverlay.Visible = !gOverlay.Visible;
+
+    // Start/stop a Chrome trace capture
+    if (key == GLFW_KEY_T && action == GLFW_PRESS)
+    {
+        if (!gProfiler.IsCapturing())
+        {
+            gProfiler.StartCapture();
+            cout << "TRACE: capturing, press T again to write " << TRACE_FILE << endl;
+        }
+        else
+        {
+            size_t events = gProfiler.EventCount();
+            if (gProfiler.StopCapture(TRACE_FILE))
+                cout << "TRACE: wrote " << events << " events to " << TRACE_FILE << " (" << gProfiler.Bound() << ")" << endl;
+            else
+                cerr << "TRACE: could not write " << TRACE_FILE << endl;
+        }
+    }
 }
 
 
@@ -525,6 +903,11 @@ void UKeyCallback(GLFWwindow* window, int key, int scancode, int action, int mod
 // -------------------------------------------------------
 void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos)
 {
+    // Live input is ignored during a replay, which calls back with no window
+    if (window != nullptr && gInputReplay.IsPlaying())
+        return;
+    gInputRecorder.Cursor(xpos, ypos);
+
     if (gFirstMouse)
     {
         gLastX = (float)xpos;
@@ -546,6 +929,11 @@ void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos)
 // ----------------------------------------------------------------------
 void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 {
+    // Live input is ignored during a replay, which calls back with no window
+    if (window != nullptr && gInputReplay.IsPlaying())
+        return;
+    gInputRecorder.Scroll(xoffset, yoffset);
+
     gCamera.ProcessMouseScroll((float)yoffset);
 }
 
@@ -553,291 +941,492 @@ void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 // --------------------------------
 void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 {
+    // Live input is ignored during a replay, which calls back with no window
+    if (window != nullptr && gInputReplay.IsPlaying())
+        return;
+    gInputRecorder.Button(button, action, mods);
+
     switch (button)
     {
     case GLFW_MOUSE_BUTTON_LEFT:
     {
         if (action == GLFW_PRESS)
-            cout << "Left mouse button pressed" << endl;
+            LOG_INFO("Left mouse button pressed");
         else
-            cout << "Left mouse button released" << endl;
+            LOG_INFO("Left mouse button released");
     }
     break;
 
     case GLFW_MOUSE_BUTTON_MIDDLE:
     {
         if (action == GLFW_PRESS)
-            cout << "Middle mouse button pressed" << endl;
+            LOG_INFO("Middle mouse button pressed");
         else
-            cout << "Middle mouse button released" << endl;
+            LOG_INFO("Middle mouse button released");
     }
     break;
 
     case GLFW_MOUSE_BUTTON_RIGHT:
     {
         if (action == GLFW_PRESS)
-            cout << "Right mouse button pressed" << endl;
+            LOG_INFO("Right mouse button pressed");
         else
-            cout << "Right mouse button released" << endl;
+            LOG_INFO("Right mouse button released");
     }
     break;
 
     default:
-        cout << "Unhandled mouse button event" << endl;
+        LOG_WARN("Unhandled mouse button event %d", button);
         break;
     }
 }
 
-// Draws the specified mesh
-void UDrawMesh(GLMesh& mesh)
+// Adds a node drawn with the mesh in the current color
+int UAddMesh(int parent, GLMesh& mesh, glm::vec3 position, glm::quat rotation, glm::vec3 scale)
 {
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(mesh.vao);
-
-    // Draws the triangles
-    glDrawArrays(GL_TRIANGLES, 0, mesh.nVertices);
-
-    // Deactivate the Vertex Array Object
-    glBindVertexArray(0);
+    int node = gSceneGraph.AddNode(parent, position, rotation, scale);
+    GraphDraw draw = { node, &mesh, gCurrentColor, false };
+    gGraphDraws.push_back(draw);
+    return node;
 }
 
-// Draws a plane at the location using the size value
-void UDrawPlane(glm::vec3 center, float size)
+// Adds a rounded cube at the location using the sizes vector and angle value, drawn as one mesh of its own.
+// Edges are rounded by half the smaller of the y and z sizes; the angle sets whether the rounding spans y or z.
+int UAddRoundedCube(int parent, glm::vec3 center, glm::vec3 sizes, float angle)
 {
-    // Model matrix: transformations are applied right-to-left order
-    glm::mat4 scale = glm::scale(glm::vec3(size, size, size));
-    glm::mat4 translation = glm::translate(center);
-    glm::mat4 model = translation * scale;
+    // Box the rounding runs around, shrunk by the radius on every side
+    float radius = glm::min(sizes.y, sizes.z) * 0.5f;
+    glm::vec3 inner(sizes.x * 0.5f, fabsf(sizes.y * 0.5f * sinf(angle)), fabsf(sizes.z * 0.5f * cosf(angle)));
 
-    // Draw the plane mesh using the model matrix
-    GLint modelLoc = glGetUniformLocation(gProgramId, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    UDrawMesh(gPlaneMesh);
+    gRoundedBoxMeshes.push_back(GLMesh());
+    GLMesh& mesh = gRoundedBoxMeshes.back();
+    UCreateRoundedBoxMesh(mesh, 2.0f * (inner + glm::vec3(radius)), radius);
+    return UAddMesh(parent, mesh, center, glm::quat(1.0f, 0.0f, 0.0f, 0.0f), glm::vec3(1.0f));
 }
 
-// Draws a cube at the location using the sizes vector
-void UDrawCube(glm::vec3 center, glm::vec3 sizes)
+// Creates the subject cube and the lamp
+void UCreateEntities()
 {
-    // Model matrix: transformations are applied right-to-left order
-    glm::mat4 scale = glm::scale(sizes);
-    glm::mat4 translation = glm::translate(center);
-    glm::mat4 model = translation * scale;
+    const glm::quat noRotation(1.0f, 0.0f, 0.0f, 0.0f);
+    const float cubeBounds = 0.5f * glm::sqrt(3.0f);
 
-    // Draw the cube mesh using the model matrix
-    GLint modelLoc = glGetUniformLocation(gProgramId, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    UDrawMesh(gCubeMesh);
+    gCubeEntity = gEntities.Create(glm::vec3(0.0f), noRotation, glm::vec3(0.2f), glm::vec3(1.0f, 0.2f, 0.0f), 0.2f * cubeBounds);
+    gLampEntity = gEntities.Create(glm::vec3(1.5f, 0.5f, 2.0f), noRotation, glm::vec3(0.2f), glm::vec3(1.0f), 0.2f * cubeBounds);
 }
 
-// Draws a cylinder between start and end using the radius value
-void UDrawCylinder(glm::vec3 start, glm::vec3 end, float radius)
+// Turns the loaded scene into nodes under one root, and adds the lamp
+void UBuildSceneGraph()
 {
-    // Bounds of cylinder endpoints
-    glm::vec3 bounds = glm::abs(end - start);
+    GLMesh* const meshes[SCENE_PRIMITIVE_COUNT] = { &gPlaneMesh, &gCubeMesh, &gCylinderMesh, &gSphereMesh, nullptr };
+    int root = gSceneGraph.AddNode(SceneGraph::NO_NODE, glm::vec3(0.0f));
 
-    // No rotation for cylinders going along the Y axis
-    glm::mat4 rotation(1.0f);
+    // Draws point into the rounded box meshes, so they must not move
+    uint32_t roundedCubes = 0;
+    for (uint32_t i = 0; i < gScene.ObjectCount; ++i)
+        roundedCubes += gScene.Objects[i].Primitive == SCENE_ROUNDED_CUBE ? 1 : 0;
+    gRoundedBoxMeshes.reserve(roundedCubes);
 
-    if (bounds.x > bounds.y && bounds.x > bounds.z)
+    for (uint32_t i = 0; i < gScene.ObjectCount; ++i)
     {
-        // Rotate 90 degrees right for cylinders going along the X axis
-        rotation = glm::rotate(glm::radians(90.0f), glm::vec3(0.0, 0.0f, 1.0f));
+        const SceneObject& object = gScene.Objects[i];
+        glm::vec3 position(object.Position[0], object.Position[1], object.Position[2]);
+        glm::quat rotation(object.Rotation[3], object.Rotation[0], object.Rotation[1], object.Rotation[2]);
+        glm::vec3 scale(object.Scale[0], object.Scale[1], object.Scale[2]);
+        gCurrentColor = glm::vec3(object.Color[0], object.Color[1], object.Color[2]);
+
+        // Rounded cubes get a mesh of their own, the others share the primitive meshes
+        if (object.Primitive == SCENE_ROUNDED_CUBE)
+            UAddRoundedCube(root, position, scale, object.Parameter);
+        else if (object.Primitive < SCENE_PRIMITIVE_COUNT)
+            UAddMesh(root, *meshes[object.Primitive], position, rotation, scale);
     }
-    else if (bounds.z > bounds.y)
+
+    // The lamp is drawn by its own program, so it is a node without a draw
+    gLampNode = gSceneGraph.AddNode(SceneGraph::NO_NODE, gEntities.Position(gLampEntity), gEntities.Rotation(gLampEntity), gEntities.Scale(gLampEntity));
+}
+
+// Sets up the showroom: the scene is the prefab, instanced on a square grid
+bool UCreateShowroom(int chairs)
+{
+    vector<GLMesh*> meshes;
+    meshes.push_back(&gPlaneMesh);
+    meshes.push_back(&gCubeMesh);
+    meshes.push_back(&gCylinderMesh);
+    meshes.push_back(&gSphereMesh);
+    for (size_t i = 0; i < gRoundedBoxMeshes.size(); ++i)
+        meshes.push_back(&gRoundedBoxMeshes[i]);
+    for (size_t i = 0; i < meshes.size(); ++i)
+        UUseMesh(*meshes[i]);
+
+    // Meshes past PrefabInstancer::MAX_MESHES are left out of the chairs
+    const int meshCount = glm::min((int)meshes.size(), (int)PrefabInstancer::MAX_MESHES);
+    vector<PrefabMesh> prefabMeshes(meshCount);
+    for (int i = 0; i < meshCount; ++i)
     {
-        // Rotate 90 degrees backwards for cylinders going along the Z axis
-        rotation = glm::rotate(glm::radians(90.0f), glm::vec3(1.0, 0.0f, 0.0f));
+        prefabMeshes[i].Vbo = meshes[i]->vbo;
+        prefabMeshes[i].VertexCount = meshes[i]->nVertices;
+        prefabMeshes[i].Ebo = meshes[i]->ebo;
+        prefabMeshes[i].IndexCount = meshes[i]->nIndices;
     }
+    if (!gShowroom.Create(prefabMeshes.data(), meshCount))
+        return false;
 
-    // Cylinder length and center position
-    float length = glm::distance(start, end);
-    glm::vec3 center = (start + end) * 0.5f;
+    // Parts relative to the scene root, which sits at the origin
+    gSceneGraph.Update();
+    vector<PrefabPart> parts;
+    for (size_t i = 0; i < gGraphDraws.size(); ++i)
+    {
+        PrefabPart part = { 0, Affine3x4::FromMat4(gSceneGraph.World(gGraphDraws[i].Node)), gGraphDraws[i].Color };
+        while (part.Mesh < meshCount && meshes[part.Mesh] != gGraphDraws[i].Mesh)
+            ++part.Mesh;
+        parts.push_back(part);
+    }
+    gShowroom.SetPrefab(parts.data(), (int)parts.size());
 
-    // Model matrix: transformations are applied right-to-left order
-    glm::mat4 scale = glm::scale(glm::vec3(radius, length, radius));
-    glm::mat4 translation = glm::translate(center);
-    glm::mat4 model = translation * rotation * scale;
+    // Chairs 3 units apart around the origin
+    const float spacing = 3.0f;
+    const int side = (int)ceil(sqrt((double)chairs));
+    vector<Affine3x4> transforms(chairs, Affine3x4::Identity());
+    for (int i = 0; i < chairs; ++i)
+    {
+        transforms[i].Rows[0].w = (i % side - side / 2) * spacing;
+        transforms[i].Rows[2].w = (i / side - side / 2) * spacing;
+    }
+    gShowroom.SetInstances(transforms.data(), chairs);
 
-    // Draw the cylinder mesh using the model matrix
-    GLint modelLoc = glGetUniformLocation(gProgramId, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    UDrawMesh(gCylinderMesh);
+    gViewDistance = glm::max(gViewDistance, 1.5f * side * spacing);
+    gCamera.MovementSpeed *= glm::max(1.0f, side / 10.0f);
+    LOG_INFO("Showroom: %d chairs of %d parts, %u part draws in %d indirect commands",
+        chairs, (int)parts.size(), gShowroom.PartCount(), gShowroom.CommandCount());
+    return true;
 }
 
-// Draws a sphere at the location using the radius value
-void UDrawSphere(glm::vec3 center, float radius)
+// Sets up the impostors: the --spheres field on a cubic grid, else the scene's uniformly
+// scaled spheres and its cylinders with a round section
+bool UCreateImpostors()
 {
-    // Model matrix: transformations are applied right-to-left order
-    glm::mat4 scale = glm::scale(glm::vec3(radius, radius, radius));
-    glm::mat4 translation = glm::translate(center);
-    glm::mat4 model = translation * scale;
+    // The sphere mesh path gets the sphere mesh's buffer at its first draw, see USphereMeshes
+    if (!gSpheres.Create() || !gCylinders.Create())
+        return false;
 
-    // Draw the sphere mesh using the model matrix
-    GLint modelLoc = glGetUniformLocation(gProgramId, "model");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    UDrawMesh(gSphereMesh);
+    vector<SphereInstance> spheres;
+    vector<CylinderInstance> cylinders;
+    if (gStressSpheres > 0)
+    {
+        // Spheres 1 unit apart around the origin, with hashed radii and colors
+        const float spacing = 1.0f;
+        const int side = (int)ceil(cbrt((double)gStressSpheres));
+        spheres.resize(gStressSpheres);
+        for (int i = 0; i < gStressSpheres; ++i)
+        {
+            glm::vec3 cell((float)(i % side), (float)(i / side % side), (float)(i / (side * side)));
+            uint32_t hash = (uint32_t)i * 2654435761u;
+            float radius = spacing * (0.25f + 0.2f * (float)(hash >> 24) / 255.0f);
+            spheres[i].Sphere = glm::vec4((cell - glm::vec3(side / 2)) * spacing, radius);
+            spheres[i].Color = glm::vec4(cell / (float)side * 0.8f + 0.2f, 1.0f);
+        }
+        gViewDistance = glm::max(gViewDistance, 1.5f * side * spacing);
+        gCamera.MovementSpeed *= glm::max(1.0f, side / 10.0f);
+    }
+    else if (gShowroomChairs == 0)
+    {
+        // A sphere scaled unevenly is an ellipsoid, and a cylinder scaled unevenly across its
+        // axis has an elliptic section; both stay meshes. The unit meshes are centered on the origin.
+        gSceneGraph.Update();
+        for (size_t i = 0; i < gGraphDraws.size(); ++i)
+        {
+            GraphDraw& draw = gGraphDraws[i];
+            if (draw.Mesh != &gSphereMesh && draw.Mesh != &gCylinderMesh)
+                continue;
+            const glm::mat4& world = gSceneGraph.World(draw.Node);
+            glm::vec3 scale(glm::length(glm::vec3(world[0])), glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2])));
+            if (draw.Mesh == &gSphereMesh)
+            {
+                if (glm::max(scale.x, glm::max(scale.y, scale.z)) - glm::min(scale.x, glm::min(scale.y, scale.z)) > 1e-4f * scale.x)
+                    continue;
+                SphereInstance sphere = { glm::vec4(glm::vec3(world[3]), scale.x), glm::vec4(draw.Color, 1.0f) };
+                spheres.push_back(sphere);
+            }
+            else
+            {
+                if (fabsf(scale.x - scale.z) > 1e-4f * scale.x)
+                    continue;
+                CylinderInstance cylinder = { glm::vec4(glm::vec3(world * glm::vec4(0.0f, -0.5f, 0.0f, 1.0f)), scale.x),
+                    world * glm::vec4(0.0f, 0.5f, 0.0f, 1.0f), glm::vec4(draw.Color, 1.0f) };
+                cylinders.push_back(cylinder);
+            }
+            draw.Impostor = true;
+        }
+    }
+    gSpheres.SetSpheres(spheres.data(), (GLsizei)spheres.size());
+    gCylinders.SetCylinders(cylinders.data(), (GLsizei)cylinders.size());
+    if (gStressSpheres > 0)
+        LOG_INFO("Spheres: %d, %u vertices as impostors", gStressSpheres, gSpheres.ImpostorVertices());
+    return true;
 }
 
-// Draws a rounded cube at the location using the sizes vector and angle value
-void UDrawRoundedCube(glm::vec3 center, glm::vec3 sizes, float angle)
+// The spheres with their mesh path attached, which uploads the sphere mesh if it was built lazily
+SphereImpostors& USphereMeshes()
 {
-    // Draw a stretched cube at the center
-    UDrawCube(center, sizes);
-
-    // Cube half sizes
-    float hx = sizes.x * 0.5f;
-    float hy = sizes.y * 0.5f * sinf(angle);
-    float hz = sizes.z * 0.5f * cosf(angle);
-
-    // Rounding radius for edges and corners
-    float radius = glm::min(sizes.y, sizes.z) * 0.5f;
-
-    // Draw 4 cylinders for rounded edges
-    UDrawCylinder(center + glm::vec3(-hx, -hy, -hz), center + glm::vec3(+hx, -hy, -hz), radius);
-    UDrawCylinder(center + glm::vec3(-hx, +hy, +hz), center + glm::vec3(+hx, +hy, +hz), radius);
-    UDrawCylinder(center + glm::vec3(-hx, -hy, -hz), center + glm::vec3(-hx, +hy, +hz), radius);
-    UDrawCylinder(center + glm::vec3(+hx, -hy, -hz), center + glm::vec3(+hx, +hy, +hz), radius);
-
-    // Draw 4 spheres for rounded corners
-    UDrawSphere(center + glm::vec3(-hx, -hy, -hz), radius);
-    UDrawSphere(center + glm::vec3(-hx, +hy, +hz), radius);
-    UDrawSphere(center + glm::vec3(+hx, -hy, -hz), radius);
-    UDrawSphere(center + glm::vec3(+hx, +hy, +hz), radius);
+    if (!gSpheres.HasMesh())
+    {
+        const GLMesh& sphereMesh = UUseMesh(gSphereMesh);
+        gSpheres.AttachMesh(sphereMesh.vbo, sphereMesh.nVertices);
+        gGLState.Invalidate();
+    }
+    return gSpheres;
 }
 
-// Draws the chair on the floor
-void UDrawChair()
+// Records the draws of the scene graph nodes with their cached world matrices
+void UDrawScene()
 {
-    // Draw a plane for the floor
-    GLint colorLoc = glGetUniformLocation(gProgramId, "objectColor");
-    glUniform3f(colorLoc, 0.35f, 0.32f, 0.30f);
-    UDrawPlane(glm::vec3(0.0f, -1.0f, 0.0f), 3.0f);
-
-    // Draw stretched rounded cubes for the seat and back
-    glUniform3f(colorLoc, 0.2f, 0.4f, 1.0f);
-    UDrawRoundedCube(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.2f, 1.0f), 0.0f);
-    UDrawRoundedCube(glm::vec3(0.0f, 1.0f, -0.5f), glm::vec3(1.2f, 0.5f, 0.2f), glm::radians(90.0f));
-
-    // Draw 4 cylinders for the legs
-    glUniform3f(colorLoc, 0.2f, 0.2f, 0.2f);
-    UDrawCylinder(glm::vec3(-0.5f, -1, +0.5f), glm::vec3(-0.5f, 0, +0.5f), 0.04f);
-    UDrawCylinder(glm::vec3(+0.5f, -1, +0.5f), glm::vec3(+0.5f, 0, +0.5f), 0.04f);
-    UDrawCylinder(glm::vec3(-0.5f, -1, -0.5f), glm::vec3(-0.5f, +1, -0.5f), 0.04f);
-    UDrawCylinder(glm::vec3(+0.5f, -1, -0.5f), glm::vec3(+0.5f, +1, -0.5f), 0.04f);
+    for (size_t i = 0; i < gGraphDraws.size(); ++i)
+    {
+        const GraphDraw& draw = gGraphDraws[i];
+        if (draw.Impostor && gImpostors)
+            continue;
+        const GLMesh& mesh = UUseMesh(*draw.Mesh);
+        if (mesh.nIndices > 0)
+            gCommandBuffer.DrawIndexed(gProgramId, mesh.vao, 0, mesh.nIndices, gSceneGraph.World(draw.Node), draw.Color);
+        else
+            gCommandBuffer.Draw(gProgramId, mesh.vao, 0, mesh.nVertices, gSceneGraph.World(draw.Node), draw.Color);
+    }
 }
 
-// Function called to render a frame
-void URender()
+// Draws the scene, the lamp, the showroom and the impostors into the bound target
+void URenderScene(const glm::vec3& lightPosition, const glm::vec3& lightColor, const glm::vec3& objectColor)
 {
-    // Lamp orbits around the origin
-    const float angularVelocity = glm::radians(45.0f);
-    if (gIsLampOrbiting)
+    // Lazy programs compile here on the first frame; a program that does not build ends the program as it would at startup
+    if (!UUseProgram(gProgramId, vertexShaderSource, fragmentShaderSource) || !UUseProgram(gLampProgramId, lampVertexShaderSource, lampFragmentShaderSource))
     {
-        float angle = angularVelocity * gDeltaTime;
-        glm::vec3 rotationAxis(0.0f, 1.0f, 0.0f);
-        glm::vec4 newPosition = glm::rotate(angle, rotationAxis) * glm::vec4(gLightPosition, 1.0f);
-        gLightPosition.x = newPosition.x;
-        gLightPosition.y = newPosition.y;
-        gLightPosition.z = newPosition.z;
+        glfwSetWindowShouldClose(gWindow, true);
+        return;
     }
 
+    // The graph bound the scene target; draw into the part the current scale covers
+    gResolution.SceneViewport();
+
     // Enable z-depth
-    glEnable(GL_DEPTH_TEST);
+    gGLState.SetDepthTest(true);
 
     // Clear the frame and z buffers
     glClearColor(gBackgroundColor_R, gBackgroundColor_G, gBackgroundColor_B, gBackgroundColor_A);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // Activate the cube VAO (used by cube and lamp)
-    // gPlaneMesh, gCubeMesh, gCylinderMesh, gSphereMesh
-
-    glBindVertexArray(gPlaneMesh.vao);
-    glBindVertexArray(gCubeMesh.vao);
-    glBindVertexArray(gCylinderMesh.vao);
-    glBindVertexArray(gSphereMesh.vao);
-
     // Set the shader to be used
-    glUseProgram(gProgramId);
+    gGLState.UseProgram(gProgramId);
 
     // Model matrix: transformations are applied right-to-left order
-    glm::mat4 model = glm::translate(gCubePosition) * glm::scale(gCubeScale);
+    glm::mat4 model = gEntities.ModelMatrix(gCubeEntity);
 
-    // camera/view transformation
+    // camera/view transformation and perspective projection, cached by the camera
     glm::mat4 view = gCamera.GetViewMatrix();
+    glm::mat4 projection = gCamera.GetProjectionMatrix();
+    const glm::vec3 cameraPosition = gCamera.Position;
 
-    // Creates a perspective projection
-    glm::mat4 projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
-
-    // Retrieves and passes transform matrices to the Shader program
+    // Camera and light go to the scene and lamp programs through the Frame block, written in
+    // place in the stream buffer; waiting here means the GPU is FRAMES frames behind
+    if (gFrameStream.BeginFrame())
+        LOG_WARN_EVERY(2000, "Stream buffer: waited for the GPU, %u stalls in %.2f ms so far", gFrameStream.Stalls, gFrameStream.StallMs);
+    GLintptr frameOffset = 0;
+    FrameUniforms* frameUniforms = (FrameUniforms*)gFrameStream.Allocate(sizeof(FrameUniforms), frameOffset);
+    frameUniforms->View = view;
+    frameUniforms->Projection = projection;
+    frameUniforms->LightPosition = lightPosition;
+    frameUniforms->LightColor = lightColor;
+    frameUniforms->ViewPosition = cameraPosition;
+    gGLState.BindBufferRange(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, gFrameStream.Buffer(), frameOffset, sizeof(FrameUniforms));
+
+    // Retrieves and passes the model matrix and the cube color to the Shader program
     GLint modelLoc = glGetUniformLocation(gProgramId, "model");
-    GLint viewLoc = glGetUniformLocation(gProgramId, "view");
-    GLint projLoc = glGetUniformLocation(gProgramId, "projection");
-
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-
-    // Reference matrix uniforms from the Cube Shader program for the cub color, light color, light position, and camera position
+    gGLState.UniformMatrix4fv(modelLoc, glm::value_ptr(model));
     GLint objectColorLoc = glGetUniformLocation(gProgramId, "objectColor");
-    GLint lightColorLoc = glGetUniformLocation(gProgramId, "lightColor");
-    GLint lightPositionLoc = glGetUniformLocation(gProgramId, "lightPos");
-    GLint viewPositionLoc = glGetUniformLocation(gProgramId, "viewPosition");
-
-    // Pass color, light, and camera data to the Cube Shader program's corresponding uniforms
-    glUniform3f(objectColorLoc, gObjectColor.r, gObjectColor.g, gObjectColor.b);
-    glUniform3f(lightColorLoc, gLightColor.r, gLightColor.g, gLightColor.b);
-    glUniform3f(lightPositionLoc, gLightPosition.x, gLightPosition.y, gLightPosition.z);
-    const glm::vec3 cameraPosition = gCamera.Position;
-    glUniform3f(viewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
+    gGLState.Uniform3f(objectColorLoc, objectColor.r, objectColor.g, objectColor.b);
+
+    // Bring the world matrices of the nodes that moved up to date; nothing is computed when nothing moved
+    {
+        CpuScope scope(gProfiler, "SceneGraph");
+        gSceneGraph.SetPosition(gLampNode, lightPosition);
+        gSceneGraph.Update();
+    }
 
-    // Draw the chair on the floor
-    UDrawChair();
+    // Record the scene; the showroom draws its chairs itself
+    gCommandBuffer.Begin(cameraPosition, gViewDistance);
+    if (gShowroomChairs == 0 && gStressSpheres == 0)
+    {
+        CpuScope scope(gProfiler, "UDrawScene");
+        UDrawScene();
+    }
 
     // LAMP: draw lamp
-    glBindVertexArray(gMesh.vao);
-    glUseProgram(gLampProgramId);
+    gGLState.UseProgram(gLampProgramId);
 
     //Transform the smaller cube used as a visual que for the light source
-    model = glm::translate(gLightPosition) * glm::scale(gLightScale);
+    model = gSceneGraph.World(gLampNode);
+
+    // The lamp program reads the camera from the Frame block
+    const GLMesh& lamp = UUseMesh(gCubeMesh);
+    gCommandBuffer.Draw(gLampProgramId, lamp.vao, 0, lamp.nVertices, model, lightColor);
+
+    // Sort the recorded draws by state and issue them
+    {
+        CpuScope scope(gProfiler, "Submit");
+        gCommandBuffer.Submit(gGLState);
+    }
 
-    // Reference matrix uniforms from the Lamp Shader program
-    modelLoc = glGetUniformLocation(gLampProgramId, "model");
-    viewLoc = glGetUniformLocation(gLampProgramId, "view");
-    projLoc = glGetUniformLocation(gLampProgramId, "projection");
+    // The whole showroom in one multi-draw call
+    if (gShowroomChairs > 0)
+    {
+        CpuScope scope(gProfiler, "Showroom");
+        gShowroom.Draw(gGLState, view, projection, lightPosition, lightColor, cameraPosition);
+        LOG_INFO_EVERY(2000, "Showroom: %d chairs, frame %.2f ms, CPU %.2f ms, GPU %.2f ms",
+            gShowroomChairs, gFrameTime * 1000.0f, gProfiler.CpuFrameMs, gProfiler.GpuFrameMs);
+    }
 
-    // Pass matrix data to the Lamp Shader program's matrix uniforms
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+    // The impostor spheres and cylinders in one instanced draw each; as meshes, the scene's are drawn with the scene
+    {
+        CpuScope scope(gProfiler, "Impostors");
+        if (gImpostors)
+        {
+            gSpheres.Draw(gGLState, view, projection, lightPosition, lightColor, cameraPosition);
+            gCylinders.Draw(gGLState, view, projection, lightPosition, lightColor);
+        }
+        else if (gStressSpheres > 0)
+            USphereMeshes().DrawMeshes(gGLState, view, projection, lightPosition, lightColor, cameraPosition);
+        if (gStressSpheres > 0)
+            LOG_INFO_EVERY(2000, "Spheres: %d %s, %u vertices, frame %.2f ms, CPU %.2f ms, GPU %.2f ms",
+                gStressSpheres, gImpostors ? "impostors" : "meshes", gImpostors ? gSpheres.ImpostorVertices() : gSpheres.MeshVertices(),
+                gFrameTime * 1000.0f, gProfiler.CpuFrameMs, gProfiler.GpuFrameMs);
+    }
+}
+
+// Function called to render a frame
+void URender()
+{
+    CpuScope renderScope(gProfiler, "URender");
+
+    // Lamp orbits around the origin
+    const float angularVelocity = glm::radians(45.0f);
+    if (gIsLampOrbiting)
+    {
+        float angle = angularVelocity * gDeltaTime;
+        glm::vec3 rotationAxis(0.0f, 1.0f, 0.0f);
+        glm::vec4 newPosition = glm::rotate(angle, rotationAxis) * glm::vec4(gEntities.Position(gLampEntity), 1.0f);
+        gEntities.SetPosition(gLampEntity, glm::vec3(newPosition));
+    }
+    const glm::vec3 lightPosition = gEntities.Position(gLampEntity);
+    const glm::vec3 lightColor = gEntities.Color(gLampEntity);
+    const glm::vec3 objectColor = gEntities.Color(gCubeEntity);
+
+    // The frame as a graph: the scene renders offscreen at the scale the last GPU frame
+    // times call for, into targets the graph takes from its pool, and is upscaled to the window
+    gResolution.Update(gProfiler.GpuFrameMs);
+    int width, height;
+    glfwGetFramebufferSize(gWindow, &width, &height);
+    gRenderGraph.Reset();
+    const int sceneColor = gRenderGraph.CreateTexture("SceneColor", gResolution.TargetWidth(), gResolution.TargetHeight(), GL_RGBA8);
+    const int sceneDepth = gRenderGraph.CreateTexture("SceneDepth", gResolution.TargetWidth(), gResolution.TargetHeight(), GL_DEPTH24_STENCIL8);
+    const int window = gRenderGraph.ImportTexture("Window", 0, width, height, GL_RGBA8);
+
+    // Every pass times its GPU work; the frame's GPU time is their sum
+    gRenderGraph.AddPass("Scene", {}, { sceneColor, sceneDepth }, [&]()
+    {
+        GpuScope gpuScope(gProfiler, "Scene");
+        URenderScene(lightPosition, lightColor, objectColor);
+    });
+    gRenderGraph.AddPass("Upscale", { sceneColor }, { window }, [&]()
+    {
+        GpuScope gpuScope(gProfiler, "Upscale");
+        gResolution.Upscale(gGLState, gRenderGraph.Texture(sceneColor));
+    });
+    // Overlay shows the scene's counters, taken before it adds its own draw
+    gRenderGraph.AddPass("Overlay", {}, { window }, [&]()
+    {
+        CpuScope scope(gProfiler, "Overlay");
+        GpuScope gpuScope(gProfiler, "Overlay");
+        const GLStateCounters sceneCounters = gGLState.Current();
+        gOverlay.AddFrameTime(gFrameTime * 1000.0f);
+        gOverlay.Draw(gGLState, width, height, sceneCounters, gProfiler.CpuFrameMs, gProfiler.GpuFrameMs);
+    });
 
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nVertices);
+    {
+        CpuScope scope(gProfiler, "RenderGraph");
+        if (gRenderGraph.Compile())
+            gRenderGraph.Execute(gGLState);
+        else
+            LOG_ERROR_EVERY(2000, "Render graph: the passes depend on each other in a cycle, nothing drawn");
+    }
 
     // Deactivate the Vertex Array Object and shader program
-    glBindVertexArray(0);
-    glUseProgram(0);
+    gGLState.BindVertexArray(0);
+    gGLState.UseProgram(0);
+    gGLState.EndFrame();
+    gFrameStream.EndFrame();
+
+    gProfiler.EndFrame();
 
     // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+    CpuScope swapScope(gProfiler, "Swap");
     glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
 }
 
-// Creates a mesh from positions and normals
-void UCreateMesh(GLMesh& mesh, vector<glm::vec3>& positions, vector<glm::vec3>& normals)
+// Builds and uploads a mesh now, or with --lazy builds it on the job system and leaves the upload to UUseMesh
+void UCreateMesh(GLMesh& mesh, MeshBuilder build)
 {
-    // Combine positions and normals into a vertex data array
-    vector<float> verts;
-    for (int i = 0; i < positions.size(); i++)
-    {
-        verts.push_back(positions[i].x);
-        verts.push_back(positions[i].y);
-        verts.push_back(positions[i].z);
-        verts.push_back(normals[i].x);
-        verts.push_back(normals[i].y);
-        verts.push_back(normals[i].z);
+    if (!gLazyResources)
+    {
+        MeshSource source;
+        build(gPrimitives, source);
+        if (source.Indices.empty())
+            UCreateMesh(mesh, source.Vertices);
+        else
+            UCreateMesh(mesh, source.Vertices, source.Indices);
+        return;
     }
 
+    // Each job has a generator of its own, as the generator keeps tables between meshes
+    gMeshSources.emplace_back();
+    MeshSource* source = &gMeshSources.back();
+    mesh.source = source;
+    gJobSystem.Run([build, source]()
+    {
+        PrimitiveGenerator generator;
+        build(generator, *source);
+    }, &source->Built);
+}
+
+// The mesh, uploaded first if it was built lazily; the first upload waits for that mesh's build
+GLMesh& UUseMesh(GLMesh& mesh)
+{
+    if (mesh.source == nullptr)
+        return mesh;
+
+    gJobSystem.Wait(mesh.source->Built);
+    MeshSource& source = *mesh.source;
+    if (source.Indices.empty())
+        UCreateMesh(mesh, source.Vertices);
+    else
+        UCreateMesh(mesh, source.Vertices, source.Indices);
+
+    // The upload bound its vertex array and buffers behind the state cache's back.
+    // A vertex array bind the cache still defers survives this and is issued at the next draw.
+    gGLState.Invalidate();
+
+    vector<PrimitiveVertex>().swap(source.Vertices);
+    vector<GLuint>().swap(source.Indices);
+    mesh.source = nullptr;
+    ++gLazyMeshes;
+    return mesh;
+}
+
+// Creates a mesh from interleaved positions and normals
+void UCreateMesh(GLMesh& mesh, const vector<PrimitiveVertex>& vertices)
+{
     const GLuint floatsPerVertex = 3;
     const GLuint floatsPerNormal = 3;
-    mesh.nVertices = (GLuint)positions.size();
+    mesh.nVertices = (GLuint)vertices.size();
+    mesh.ebo = 0;
+    mesh.nIndices = 0;
 
     glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
     glBindVertexArray(mesh.vao);
@@ -845,7 +1434,7 @@ void UCreateMesh(GLMesh& mesh, vector<glm::vec3>& positions, vector<glm::vec3>&
     // Create VBO
     glGenBuffers(1, &mesh.vbo);
     glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verts[0]) * verts.size(), verts.data(), GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices[0]) * vertices.size(), vertices.data(), GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
 
     // Strides between vertex coordinates
     GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal);
@@ -858,233 +1447,96 @@ void UCreateMesh(GLMesh& mesh, vector<glm::vec3>& positions, vector<glm::vec3>&
     glEnableVertexAttribArray(1);
 }
 
+// Creates an indexed mesh from interleaved positions and normals
+void UCreateMesh(GLMesh& mesh, const vector<PrimitiveVertex>& vertices, const vector<GLuint>& indices)
+{
+    UCreateMesh(mesh, vertices);
+
+    // The element buffer binding is part of the vertex array, still bound
+    glGenBuffers(1, &mesh.ebo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices[0]) * indices.size(), indices.data(), GL_STATIC_DRAW);
+    mesh.nIndices = (GLuint)indices.size();
+}
+
 // Creates a plane mesh
 void UCreatePlaneMesh(GLMesh& mesh)
 {
-    // Positions of plane vertices
-    vector<glm::vec3> positions;
-    positions.push_back(glm::vec3(-0.5f, 0.0f, -0.5f));
-    positions.push_back(glm::vec3(0.5f, 0.0f, -0.5f));
-    positions.push_back(glm::vec3(0.5f, 0.0f, 0.5f));
-    positions.push_back(glm::vec3(0.5f, 0.0f, 0.5f));
-    positions.push_back(glm::vec3(-0.5f, 0.0f, 0.5f));
-    positions.push_back(glm::vec3(-0.5f, 0.0f, -0.5f));
-
-    // Normals of plane vertices
-    vector<glm::vec3> normals;
-    normals.push_back(glm::vec3(0.0f, +1.0f, 0.0f));
-    normals.push_back(glm::vec3(0.0f, +1.0f, 0.0f));
-    normals.push_back(glm::vec3(0.0f, +1.0f, 0.0f));
-    normals.push_back(glm::vec3(0.0f, +1.0f, 0.0f));
-    normals.push_back(glm::vec3(0.0f, +1.0f, 0.0f));
-    normals.push_back(glm::vec3(0.0f, +1.0f, 0.0f));
-
-    // Create a mesh from positions and normals
-    UCreateMesh(mesh, positions, normals);
+    UCreateMesh(mesh, [](PrimitiveGenerator& generator, MeshSource& source)
+    {
+        // Unit square on Y = 0, facing up
+        source.Vertices.resize(PrimitiveGenerator::GridVertexCount(1, 1));
+        generator.Grid(&source.Vertices[0], 1, 1, 1.0f, 1.0f);
+    });
 }
 
 // Creates a cube mesh
 void UCreateCubeMesh(GLMesh& mesh)
 {
-    // Positions of cube vertices
-    vector<glm::vec3> positions;
-
-    positions.push_back(glm::vec3(-0.5f, -0.5f, -0.5f));
-    positions.push_back(glm::vec3(0.5f, -0.5f, -0.5f));
-    positions.push_back(glm::vec3(0.5f, 0.5f, -0.5f));
-    positions.push_back(glm::vec3(0.5f, 0.5f, -0.5f));
-    positions.push_back(glm::vec3(-0.5f, 0.5f, -0.5f));
-    positions.push_back(glm::vec3(-0.5f, -0.5f, -0.5f));
-
-    positions.push_back(glm::vec3(-0.5f, -0.5f, 0.5f));
-    positions.push_back(glm::vec3(0.5f, -0.5f, 0.5f));
-    positions.push_back(glm::vec3(0.5f, 0.5f, 0.5f));
-    positions.push_back(glm::vec3(0.5f, 0.5f, 0.5f));
-    positions.push_back(glm::vec3(-0.5f, 0.5f, 0.5f));
-    positions.push_back(glm::vec3(-0.5f, -0.5f, 0.5f));
-
-    positions.push_back(glm::vec3(-0.5f, 0.5f, 0.5f));
-    positions.push_back(glm::vec3(-0.5f, 0.5f, -0.5f));
-    positions.push_back(glm::vec3(-0.5f, -0.5f, -0.5f));
-    positions.push_back(glm::vec3(-0.5f, -0.5f, -0.5f));
-    positions.push_back(glm::vec3(-0.5f, -0.5f, 0.5f));
-    positions.push_back(glm::vec3(-0.5f, 0.5f, 0.5f));
-
-    positions.push_back(glm::vec3(0.5f, 0.5f, 0.5f));
-    positions.push_back(glm::vec3(0.5f, 0.5f, -0.5f));
-    positions.push_back(glm::vec3(0.5f, -0.5f, -0.5f));
-    positions.push_back(glm::vec3(0.5f, -0.5f, -0.5f));
-    positions.push_back(glm::vec3(0.5f, -0.5f, 0.5f));
-    positions.push_back(glm::vec3(0.5f, 0.5f, 0.5f));
-
-    positions.push_back(glm::vec3(-0.5f, -0.5f, -0.5f));
-    positions.push_back(glm::vec3(0.5f, -0.5f, -0.5f));
-    positions.push_back(glm::vec3(0.5f, -0.5f, 0.5f));
-    positions.push_back(glm::vec3(0.5f, -0.5f, 0.5f));
-    positions.push_back(glm::vec3(-0.5f, -0.5f, 0.5f));
-    positions.push_back(glm::vec3(-0.5f, -0.5f, -0.5f));
-
-    positions.push_back(glm::vec3(-0.5f, 0.5f, -0.5f));
-    positions.push_back(glm::vec3(0.5f, 0.5f, -0.5f));
-    positions.push_back(glm::vec3(0.5f, 0.5f, 0.5f));
-    positions.push_back(glm::vec3(0.5f, 0.5f, 0.5f));
-    positions.push_back(glm::vec3(-0.5f, 0.5f, 0.5f));
-    positions.push_back(glm::vec3(-0.5f, 0.5f, -0.5f));
-
-    // Normals of cube vertices
-    vector<glm::vec3> normals;
-
-    normals.push_back(glm::vec3(0.0f, 0.0f, -1.0f));
-    normals.push_back(glm::vec3(0.0f, 0.0f, -1.0f));
-    normals.push_back(glm::vec3(0.0f, 0.0f, -1.0f));
-    normals.push_back(glm::vec3(0.0f, 0.0f, -1.0f));
-    normals.push_back(glm::vec3(0.0f, 0.0f, -1.0f));
-    normals.push_back(glm::vec3(0.0f, 0.0f, -1.0f));
-
-    normals.push_back(glm::vec3(0.0f, 0.0f, +1.0f));
-    normals.push_back(glm::vec3(0.0f, 0.0f, +1.0f));
-    normals.push_back(glm::vec3(0.0f, 0.0f, +1.0f));
-    normals.push_back(glm::vec3(0.0f, 0.0f, +1.0f));
-    normals.push_back(glm::vec3(0.0f, 0.0f, +1.0f));
-    normals.push_back(glm::vec3(0.0f, 0.0f, +1.0f));
-
-    normals.push_back(glm::vec3(-1.0f, 0.0f, 0.0f));
-    normals.push_back(glm::vec3(-1.0f, 0.0f, 0.0f));
-    normals.push_back(glm::vec3(-1.0f, 0.0f, 0.0f));
-    normals.push_back(glm::vec3(-1.0f, 0.0f, 0.0f));
-    normals.push_back(glm::vec3(-1.0f, 0.0f, 0.0f));
-    normals.push_back(glm::vec3(-1.0f, 0.0f, 0.0f));
-
-    normals.push_back(glm::vec3(+1.0f, 0.0f, 0.0f));
-    normals.push_back(glm::vec3(+1.0f, 0.0f, 0.0f));
-    normals.push_back(glm::vec3(+1.0f, 0.0f, 0.0f));
-    normals.push_back(glm::vec3(+1.0f, 0.0f, 0.0f));
-    normals.push_back(glm::vec3(+1.0f, 0.0f, 0.0f));
-    normals.push_back(glm::vec3(+1.0f, 0.0f, 0.0f));
-
-    normals.push_back(glm::vec3(0.0f, -1.0f, 0.0f));
-    normals.push_back(glm::vec3(0.0f, -1.0f, 0.0f));
-    normals.push_back(glm::vec3(0.0f, -1.0f, 0.0f));
-    normals.push_back(glm::vec3(0.0f, -1.0f, 0.0f));
-    normals.push_back(glm::vec3(0.0f, -1.0f, 0.0f));
-    normals.push_back(glm::vec3(0.0f, -1.0f, 0.0f));
-
-    normals.push_back(glm::vec3(0.0f, +1.0f, 0.0f));
-    normals.push_back(glm::vec3(0.0f, +1.0f, 0.0f));
-    normals.push_back(glm::vec3(0.0f, +1.0f, 0.0f));
-    normals.push_back(glm::vec3(0.0f, +1.0f, 0.0f));
-    normals.push_back(glm::vec3(0.0f, +1.0f, 0.0f));
-    normals.push_back(glm::vec3(0.0f, +1.0f, 0.0f));
-
-    // Create a mesh from positions and normals
-    UCreateMesh(mesh, positions, normals);
-}
-
-// Position of vertex(i) on a circle with n subdivisions
-glm::vec3 UCircularCoordinates(int i, int n)
-{
-    // Angle for vertex(i) with n subdivisions
-    float angle = glm::radians(360.0f * i / n);
-
-    // Rotate the initial vertex (1, 0, 0) around the Y axis
-    glm::vec4 vertex(1.0f, 0.0f, 0.0f, 1.0f);
-    vertex = glm::rotate(angle, glm::vec3(0.0, 1.0f, 0.0f)) * vertex;
-    return glm::vec3(vertex);
+    UCreateMesh(mesh, [](PrimitiveGenerator& generator, MeshSource& source)
+    {
+        // Unit cube, one tile per face
+        source.Vertices.resize(PrimitiveGenerator::BoxVertexCount(1));
+        generator.Box(&source.Vertices[0], 1, glm::vec3(1.0f));
+    });
 }
 
 // Creates a cylinder mesh
 void UCreateCylinderMesh(GLMesh& mesh)
 {
-    // Positions and normals of cylinder vertices
-    vector<glm::vec3> positions;
-    vector<glm::vec3> normals;
-
-    // Subdivide the cylinder into n tiles
-    const int n = 16;
-    for (int i = 0; i < n; i++)
-    {
-        // Vertices of the current tile
-        glm::vec3 a = UCircularCoordinates(i + 0, n);
-        glm::vec3 b = UCircularCoordinates(i + 1, n);
-
-        // 1st triangle of the tile
-        positions.push_back(a - glm::vec3(0.0f, 0.5f, 0.0f));
-        positions.push_back(b - glm::vec3(0.0f, 0.5f, 0.0f));
-        positions.push_back(a + glm::vec3(0.0f, 0.5f, 0.0f));
-        normals.push_back(a);
-        normals.push_back(b);
-        normals.push_back(a);
-
-        // 2nd triangle of the tile
-        positions.push_back(b - glm::vec3(0.0f, 0.5f, 0.0f));
-        positions.push_back(b + glm::vec3(0.0f, 0.5f, 0.0f));
-        positions.push_back(a + glm::vec3(0.0f, 0.5f, 0.0f));
-        normals.push_back(b);
-        normals.push_back(b);
-        normals.push_back(a);
-    }
-
-    // Create a mesh from positions and normals
-    UCreateMesh(mesh, positions, normals);
-}
-
-// Position of vertex(i, j) on a circle with n*n subdivisions
-glm::vec3 USphericalCoordinates(int i, int j, int n)
-{
-    // Longitude and latitude angles for vertex(i, j) with n*n subdivisions
-    float longitude = glm::radians(360.0f * j / n);
-    float latitude = glm::radians(180.0f * i / n) - glm::radians(90.0f);
-
-    // Rotate the initial vertex (1, 0, 0) around the Z and Y axes
-    glm::vec4 vertex(1.0f, 0.0f, 0.0f, 1.0f);
-    vertex = glm::rotate(latitude, glm::vec3(0.0, 0.0f, 1.0f)) * vertex;
-    vertex = glm::rotate(longitude, glm::vec3(0.0, 1.0f, 0.0f)) * vertex;
-    return glm::vec3(vertex);
+    UCreateMesh(mesh, [](PrimitiveGenerator& generator, MeshSource& source)
+    {
+        // Unit radius and height, 16 segments, open ends
+        source.Vertices.resize(PrimitiveGenerator::CylinderVertexCount(16, 1, false));
+        generator.Cylinder(&source.Vertices[0], 16, 1, 1.0f, 1.0f, false);
+    });
 }
 
 // Creates a sphere mesh
 void UCreateSphereMesh(GLMesh& mesh)
 {
-    // Positions and normals of sphere vertices
-    vector<glm::vec3> positions;
-    vector<glm::vec3> normals;
-
-    // Subdivide the sphere into n*n tiles
-    const int n = 8;
-    for (int i = 0; i < n; i++)
-        for (int j = 0; j < n; j++)
-        {
-            // Vertices of the current tile
-            glm::vec3 a = USphericalCoordinates(i + 0, j + 0, n);
-            glm::vec3 b = USphericalCoordinates(i + 0, j + 1, n);
-            glm::vec3 c = USphericalCoordinates(i + 1, j + 1, n);
-            glm::vec3 d = USphericalCoordinates(i + 1, j + 0, n);
-
-            // 1st triangle of the tile
-            positions.push_back(a);
-            positions.push_back(b);
-            positions.push_back(c);
-            normals.push_back(a);
-            normals.push_back(b);
-            normals.push_back(c);
-
-            // 2nd triangle of the tile
-            positions.push_back(a);
-            positions.push_back(c);
-            positions.push_back(d);
-            normals.push_back(a);
-            normals.push_back(c);
-            normals.push_back(d);
-        }
+    UCreateMesh(mesh, [](PrimitiveGenerator& generator, MeshSource& source)
+    {
+        // Unit radius, 8 segments and 8 rings
+        source.Vertices.resize(PrimitiveGenerator::SphereVertexCount(8, 8));
+        generator.Sphere(&source.Vertices[0], 8, 8, 1.0f);
+    });
+}
 
-    // Create a mesh from positions and normals
-    UCreateMesh(mesh, positions, normals);
+// Creates a rounded box mesh of the given outer size
+void UCreateRoundedBoxMesh(GLMesh& mesh, glm::vec3 size, float radius)
+{
+    UCreateMesh(mesh, [size, radius](PrimitiveGenerator& generator, MeshSource& source)
+    {
+        // 8 segments around each rounded edge
+        const int segments = 8;
+        source.Vertices.resize(PrimitiveGenerator::RoundedBoxVertexCount(size, radius, segments));
+        source.Indices.resize(PrimitiveGenerator::RoundedBoxIndexCount(size, radius, segments));
+        generator.RoundedBox(source.Vertices.data(), source.Indices.data(), size, radius, segments);
+    });
 }
 
 void UDestroyMesh(GLMesh& mesh)
 {
     glDeleteVertexArrays(1, &mesh.vao);
     glDeleteBuffers(1, &mesh.vbo);
+    glDeleteBuffers(1, &mesh.ebo);
+}
+
+
+// Compiles the program on first use when --lazy left it out at startup; false when it does not build
+bool UUseProgram(GLuint& programId, const char* vtxShaderSource, const char* fragShaderSource)
+{
+    if (programId != 0)
+        return true;
+    if (!UCreateShaderProgram(vtxShaderSource, fragShaderSource, programId))
+    {
+        LOG_ERROR("A lazily compiled program does not build");
+        return false;
+    }
+    ++gLazyPrograms;
+    gGLState.Invalidate();
+    return true;
 }
 
 
@@ -1,5 +1,6 @@
 #include <iostream>             // cout, cerr
 #include <cstdlib>              // EXIT_FAILURE
+#include <vector>               // vector
 #include <GL/glew.h>            // GLEW library
 #include <GLFW/glfw3.h>         // GLFW library
 
@@ -9,6 +10,13 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <learnOpengl/camera.h> // Camera class
+#include <cs330/frustum.h>      // Frustum culling
+#include <cs330/job_system.h>   // Work-stealing job system
+#include <cs330/gpu_culler.h>     // Culling and indirect draws on the GPU
+#include <cs330/gl_state_cache.h> // Redundant GL call filtering
+#include <cs330/log.h>            // Asynchronous logging
+#include <cs330/render_target.h>  // Float depth framebuffer
+#include <cs330/scene.h>          // Scene description files
 
 using namespace std; // Standard namespace
 
@@ -51,6 +59,36 @@ bool gFirstMouse = true;
 float gDeltaTime = 0.0f; // time between current frame and last frame
 float gLastFrame = 0.0f;
 
+// Worker threads for per-frame CPU work
+JobSystem gJobSystem;
+
+// Model transforms and bounds of the cubes, filled in parallel and uploaded when the objects change
+std::vector<CullInstance> gCullInstances;
+// Camera version the view/projection uniforms were computed for
+unsigned gCameraVersion = 0;
+
+// Culls the cubes and writes their draw commands on the GPU every frame
+GpuCuller gCuller;
+// Cubes farther than this many lattice spacings are culled, even with the infinite far plane
+const float CULL_DISTANCE_SPACINGS = 100.0f;
+
+// Last GL state set by the render loop
+GLStateCache gGLState;
+
+// Scene framebuffer with a 32-bit float depth buffer
+RenderTarget gSceneTarget;
+// Reversed-Z infinite projection, when the driver supports glClipControl
+bool gClipControlSupported = false;
+bool gReversedZ = false;
+
+// Distance between neighbouring cubes; [ and ] scale it to show the depth precision at large distances
+float gLatticeSpacing = 10.0f;
+float gBuiltLatticeSpacing = 0.0f;
+std::vector<SceneObject> gLattice;
+
+// Cubes drawn instead of the lattice, from --scene <file>
+Scene gScene;
+
 }
 
 /* User-defined Function prototypes to:
@@ -61,12 +99,14 @@ float gLastFrame = 0.0f;
 bool UInitialize(int, char*[], GLFWwindow** window);
 void UResizeWindow(GLFWwindow* window, int width, int height);
 void UProcessInput(GLFWwindow* window);
+void UKeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
 void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos);
 void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
 void UCreateMesh(GLMesh &mesh);
 void UDestroyMesh(GLMesh &mesh);
 void URender();
+void UApplyDepthMode();
 bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint &programId);
 void UDestroyShaderProgram(GLuint programId);
 
@@ -75,17 +115,30 @@ void UDestroyShaderProgram(GLuint programId);
 const GLchar * vertexShaderSource = GLSL(440,
     layout (location = 0) in vec3 position; // Vertex data from Vertex Attrib Pointer 0
     layout (location = 1) in vec4 color;  // Color data from Vertex Attrib Pointer 1
+    layout (location = 2) in uint record; // Visible list entry of the instance
 
     out vec4 vertexColor; // variable to transfer color data to the fragment shader
 
+    // Instances and visible lists written by the culling pass
+    struct CullInstance
+    {
+        vec4 model[3]; // rows of the affine model transform
+        vec4 bounds;
+        uvec4 mesh;
+    };
+    layout(std430, binding = 0) readonly buffer Instances { CullInstance instances[]; };
+    layout(std430, binding = 1) readonly buffer Visible { uint visible[]; };
+
     //Global variables for the  transform matrices
-    uniform mat4 model;
     uniform mat4 view;
     uniform mat4 projection;
 
     void main()
     {
-        gl_Position = projection * view * model * vec4(position, 1.0f); // transforms vertices to clip coordinates
+        CullInstance instance = instances[visible[record]];
+        vec4 p = vec4(position, 1.0f);
+        vec3 world = vec3(dot(instance.model[0], p), dot(instance.model[1], p), dot(instance.model[2], p));
+        gl_Position = projection * view * vec4(world, 1.0f); // transforms vertices to clip coordinates
         vertexColor = color; // references incoming color data
     }
 );
@@ -112,6 +165,11 @@ int main(int argc, char* argv[])
     // Create the mesh
     UCreateMesh(gMesh); // Calls the function to create the Vertex Buffer Object
 
+    // Create the culling pass and feed the instance records to the cube's vertex array
+    if (!gCuller.Create())
+        return EXIT_FAILURE;
+    gCuller.AttachRecordAttribute(gMesh.vao, 2);
+
     // Create the shader program
     if (!UCreateShaderProgram(vertexShaderSource, fragmentShaderSource, gProgramId))
         return EXIT_FAILURE;
@@ -119,6 +177,19 @@ int main(int argc, char* argv[])
     // Sets the background color of the window to black (it will be implicitely used by glClear)
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 
+    // Render the scene into a float depth buffer, in reversed-Z when the driver can
+    int width, height;
+    glfwGetFramebufferSize(gWindow, &width, &height);
+    if (!gSceneTarget.Create(width, height, GL_DEPTH_COMPONENT32F))
+        return EXIT_FAILURE;
+    gCamera.Aspect = (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT;
+    gClipControlSupported = GLEW_VERSION_4_5 || GLEW_ARB_clip_control;
+    gReversedZ = gClipControlSupported;
+    UApplyDepthMode();
+
+    // Mesh, shader and framebuffer creation bound objects behind the state cache's back
+    gGLState.Invalidate();
+
     // render loop
     // -----------
     while (!glfwWindowShouldClose(gWindow))
@@ -145,6 +216,12 @@ int main(int argc, char* argv[])
     // Release shader program
     UDestroyShaderProgram(gProgramId);
 
+    // Release the culling buffers
+    gCuller.Release();
+
+    // Release the scene framebuffer
+    gSceneTarget.Release();
+
     exit(EXIT_SUCCESS); // Terminates the program successfully
 }
 
@@ -152,6 +229,22 @@ int main(int argc, char* argv[])
 // Initialize GLFW, GLEW, and create a window
 bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 {
+    // Command line: a scene to draw instead of the lattice
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string argument = argv[i];
+        if (argument == "--scene" && i + 1 < argc)
+        {
+            if (!gScene.Load(argv[++i]))
+                return false;
+        }
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--scene <file>]" << std::endl;
+            return false;
+        }
+    }
+
     // GLFW: initialize and configure
     // ------------------------------
     glfwInit();
@@ -174,6 +267,7 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
     }
     glfwMakeContextCurrent(*window);
     glfwSetFramebufferSizeCallback(*window, UResizeWindow);
+    glfwSetKeyCallback(*window, UKeyCallback);
     glfwSetCursorPosCallback(*window, UMousePositionCallback);
     glfwSetScrollCallback(*window, UMouseScrollCallback);
     glfwSetMouseButtonCallback(*window, UMouseButtonCallback);
@@ -223,6 +317,71 @@ void UProcessInput(GLFWwindow* window)
 void UResizeWindow(GLFWwindow* window, int width, int height)
 {
     glViewport(0, 0, width, height);
+
+    // Minimized windows report a zero size
+    if (width == 0 || height == 0)
+        return;
+    gCamera.Aspect = (GLfloat)width / (GLfloat)height;
+    gSceneTarget.Resize(width, height);
+    gGLState.Invalidate();
+}
+
+
+// Switches between the standard projection and reversed-Z with an infinite far plane
+void UApplyDepthMode()
+{
+    if (gReversedZ)
+    {
+        // Depth 1 at the near plane, 0 at infinity: clear to 0 and keep the greater depth
+        glClipControl(GL_LOWER_LEFT, GL_ZERO_TO_ONE);
+        glClearDepth(0.0);
+        gCamera.SetReversedInfinitePerspective(gCamera.Aspect, 0.1f);
+    }
+    else
+    {
+        if (gClipControlSupported)
+            glClipControl(GL_LOWER_LEFT, GL_NEGATIVE_ONE_TO_ONE);
+        glClearDepth(1.0);
+        gCamera.SetPerspective(gCamera.Aspect, 0.1f, 100.0f);
+    }
+}
+
+
+// glfw: whenever the key is pressed/released, this callback is called
+// -------------------------------------------------------
+void UKeyCallback(GLFWwindow* /*window*/, int key, int /*scancode*/, int action, int /*mods*/)
+{
+    // Report the draw state changes of the last frame
+    if (key == GLFW_KEY_P && action == GLFW_PRESS)
+    {
+        cout << "INSTANCES culled on the GPU: " << gCuller.InstanceCount()
+             << " DRAWS: " << gGLState.LastFrame.Draws << endl;
+        cout << "GL STATE CALLS issued: " << gGLState.LastFrame.Issued << " suppressed: " << gGLState.LastFrame.Suppressed << endl;
+    }
+
+    // Toggle reversed-Z
+    if (key == GLFW_KEY_Z && action == GLFW_PRESS)
+    {
+        if (!gClipControlSupported)
+            cout << "Reversed-Z needs OpenGL 4.5 or ARB_clip_control" << endl;
+        else
+        {
+            gReversedZ = !gReversedZ;
+            UApplyDepthMode();
+            cout << (gReversedZ ? "Reversed-Z, infinite far plane" : "Standard depth, far plane at 100") << endl;
+        }
+    }
+
+    // Scale the lattice spacing by 10, from 10 units up to 100 km
+    if (key == GLFW_KEY_RIGHT_BRACKET && action == GLFW_PRESS && gLatticeSpacing < 100000.0f)
+        gLatticeSpacing *= 10.0f;
+    if (key == GLFW_KEY_LEFT_BRACKET && action == GLFW_PRESS && gLatticeSpacing > 10.0f)
+        gLatticeSpacing /= 10.0f;
+    if ((key == GLFW_KEY_LEFT_BRACKET || key == GLFW_KEY_RIGHT_BRACKET) && action == GLFW_PRESS)
+    {
+        gCamera.MovementSpeed = SPEED * gLatticeSpacing / 10.0f;
+        cout << "Lattice spacing: " << gLatticeSpacing << endl;
+    }
 }
 
 
@@ -263,101 +422,137 @@ void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
         case GLFW_MOUSE_BUTTON_LEFT:
         {
             if (action == GLFW_PRESS)
-                cout << "Left mouse button pressed" << endl;
+                LOG_INFO("Left mouse button pressed");
             else
-                cout << "Left mouse button released" << endl;
+                LOG_INFO("Left mouse button released");
         }
         break;
 
         case GLFW_MOUSE_BUTTON_MIDDLE:
         {
             if (action == GLFW_PRESS)
-                cout << "Middle mouse button pressed" << endl;
+                LOG_INFO("Middle mouse button pressed");
             else
-                cout << "Middle mouse button released" << endl;
+                LOG_INFO("Middle mouse button released");
         }
         break;
 
         case GLFW_MOUSE_BUTTON_RIGHT:
         {
             if (action == GLFW_PRESS)
-                cout << "Right mouse button pressed" << endl;
+                LOG_INFO("Right mouse button pressed");
             else
-                cout << "Right mouse button released" << endl;
+                LOG_INFO("Right mouse button released");
         }
         break;
 
         default:
-            cout << "Unhandled mouse button event" << endl;
+            LOG_WARN("Unhandled mouse button event %d", button);
             break;
     }
 }
 
 
-// Function called to render a frame
-void URender()
+// Builds the 10x10x10 lattice of cubes with the spacing value
+void UBuildLattice(float spacing)
 {
     const int nrows = 10;
     const int ncols = 10;
     const int nlevels = 10;
 
-    const float xsize = 10.0f;
-    const float ysize = 10.0f;
-    const float zsize = 10.0f;
+    // Cubes scaled by 2 and rotated 45 radians around the diagonal
+    const glm::quat rotation = glm::angleAxis(45.0f, glm::normalize(glm::vec3(1.0f, 1.0f, 1.0f)));
+    SceneObject cube = MakeSceneObject(SCENE_CUBE);
+    cube.Rotation[0] = rotation.x;
+    cube.Rotation[1] = rotation.y;
+    cube.Rotation[2] = rotation.z;
+    cube.Rotation[3] = rotation.w;
+    cube.Scale[0] = cube.Scale[1] = cube.Scale[2] = 2.0f;
+
+    gLattice.resize(nrows * ncols * nlevels);
+    for (int index = 0; index < (int)gLattice.size(); ++index)
+    {
+        cube.Position[0] = (index / (ncols * nlevels)) * spacing;
+        cube.Position[1] = ((index / nlevels) % ncols) * spacing;
+        cube.Position[2] = (index % nlevels) * spacing;
+        gLattice[index] = cube;
+    }
+}
+
 
-    // Enable z-depth
-    glEnable(GL_DEPTH_TEST);
-    
-    // Clear the frame and z buffers
+// Function called to render a frame
+void URender()
+{
+    // Enable z-depth; reversed-Z keeps the fragment with the greater depth
+    gGLState.SetDepthTest(true);
+    gGLState.SetDepthFunc(gReversedZ ? GL_GREATER : GL_LESS);
+
+    // Clear the frame and z buffers of the scene framebuffer
+    gSceneTarget.Bind();
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // camera/view transformation
-    glm::mat4 view = gCamera.GetViewMatrix();
+    // The lattice only moves when its spacing changes; a loaded scene never does
+    const bool latticeChanged = gScene.Objects == nullptr && gBuiltLatticeSpacing != gLatticeSpacing;
+    if (latticeChanged)
+    {
+        gBuiltLatticeSpacing = gLatticeSpacing;
+        UBuildLattice(gLatticeSpacing);
+    }
+    const SceneObject* objects = gScene.Objects != nullptr ? gScene.Objects : &gLattice[0];
+    const int nobjects = gScene.Objects != nullptr ? (int)gScene.ObjectCount : (int)gLattice.size();
 
-    // Creates a perspective projection
-    glm::mat4 projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
+    // Model transforms and bounds are built on all cores and uploaded only when the objects change
+    const bool objectsChanged = latticeChanged || (int)gCullInstances.size() != nobjects;
+    if (objectsChanged)
+    {
+        gCullInstances.resize(nobjects);
+        gJobSystem.ParallelFor(0, nobjects, 64, [&](int first, int last)
+        {
+            for (int index = first; index < last; ++index)
+            {
+                // Sphere bounding a unit cube with the object's largest scale
+                const float* scale = objects[index].Scale;
+                CullInstance& instance = gCullInstances[index];
+                instance.Model = SceneAffine(objects[index]);
+                instance.Bounds = glm::vec4(instance.Model.Translation(), 0.5f * glm::sqrt(3.0f) * glm::max(scale[0], glm::max(scale[1], scale[2])));
+                instance.Mesh = 0;
+            }
+        });
 
-    // Set the shader to be used
-    glUseProgram(gProgramId);
+        // Every object is drawn with the cube mesh
+        CullMesh cube = { 0, (GLsizei)gMesh.nVertices };
+        gCuller.SetInstances(gCullInstances.empty() ? nullptr : &gCullInstances[0], (GLuint)nobjects, &cube, 1);
+        gGLState.Invalidate();
+    }
 
-    // Retrieves and passes transform matrices to the Shader program
-    GLint modelLoc = glGetUniformLocation(gProgramId, "model");
-    GLint viewLoc = glGetUniformLocation(gProgramId, "view");
-    GLint projLoc = glGetUniformLocation(gProgramId, "projection");
+    // Cull against the camera's cached frustum; the CPU work is the same whatever the number of objects
+    gCuller.Cull(gGLState, gCamera.GetFrustum(), gCamera.Position, CULL_DISTANCE_SPACINGS * gLatticeSpacing);
 
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+    // Set the shader to be used
+    gGLState.UseProgram(gProgramId);
 
-    // Activate the VBOs contained within the mesh's VAO
-    glBindVertexArray(gMesh.vao);
+    // The camera matrices only change with the camera
+    if (gCamera.Version() != gCameraVersion)
+    {
+        gCameraVersion = gCamera.Version();
 
-    // 1. Scales the object by 2
-    glm::mat4 scale = glm::scale(glm::vec3(2.0f, 2.0f, 2.0f));
-    // 2. Rotates shape by 15 degrees in the x axis
-    glm::mat4 rotation = glm::rotate(45.0f, glm::vec3(1.0, 1.0f, 1.0f));
+        // Retrieves and passes the cached camera matrices to the Shader program
+        GLint viewLoc = glGetUniformLocation(gProgramId, "view");
+        GLint projLoc = glGetUniformLocation(gProgramId, "projection");
 
-    for (int i = 0; i < nrows; ++i)
-    {
-        for (int j = 0; j < ncols; ++j)
-        {
-            for (int k = 0; k < nlevels; ++k)
-            {
-                glm::vec3 location = glm::vec3(i * xsize, j * ysize, k * zsize);
-                // 3. Place object at the origin
-                glm::mat4 translation = glm::translate(location);
-                // Model matrix: transformations are applied right-to-left order
-                glm::mat4 model = translation * rotation * scale;
-                glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-            
-                // Draws the triangles
-                glDrawArrays(GL_TRIANGLES, 0, gMesh.nVertices);
-            }
-        }
+        gGLState.UniformMatrix4fv(viewLoc, glm::value_ptr(gCamera.GetViewMatrix()));
+        gGLState.UniformMatrix4fv(projLoc, glm::value_ptr(gCamera.GetProjectionMatrix()));
     }
 
-    // Deactivate the Vertex Array Object
-    glBindVertexArray(0);
+    // Draws the visible cubes with the commands the culling pass wrote
+    gCuller.Draw(gGLState, gMesh.vao);
+    gGLState.EndFrame();
+
+    // Copy the scene to the window
+    int width, height;
+    glfwGetFramebufferSize(gWindow, &width, &height);
+    gSceneTarget.BlitToDefault(width, height);
 
     // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
     glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.